@@ -27,6 +27,7 @@
 #import "AudioSegmentTree.h"
 #import "PCMAudioBuffer.h"
 #import "SeekIndex.h"
+#import "LoudnessEnvelope.h"
 
 // if you want to play to end of file
 #define AudioFileEndTime	1000000000.0
@@ -38,6 +39,11 @@
 
 extern NSString *AudioFileProgressChangedNotification;
 extern NSString *AudioFileAnalyzingFinishedNotification;
+extern NSString *AudioFileDecodingFailedNotification;
+
+// keys of the threshold pairs an audio file can be analyzed with at once
+extern NSString *AudioFileSilenceDurationKey;
+extern NSString *AudioFileSilenceVolumeKey;
 
 @interface AudioFile : NSObject <NSCoding> {
 	NSString			*filePath;
@@ -45,6 +51,9 @@ extern NSString *AudioFileAnalyzingFinishedNotification;
 	double				duration;   // duration of audio in seconds
 	AudioSegmentTree	*audioSegmentTree;
 	SeekIndex			*seekIndex;
+	SeekIndex			*analysisSeekIndex;	// filled by the running analysis, replaces seekIndex when it succeeded
+	NSLock				*indexLock;			// playback reads the indexes while an analysis replaces them
+	LoudnessEnvelope	*loudnessEnvelope;
 	
 	// audio output
 	AudioUnit			audioUnit;
@@ -62,6 +71,9 @@ extern NSString *AudioFileAnalyzingFinishedNotification;
 	// analysis settings
 	double				silenceDurationThreshold;   // min secs a silence has to last to be recorded
 	int					silenceVolumeThreshold;		// max volume level in pcm scale
+	BOOL				backgroundAnalysis;			// nobody is waiting for the result, yield to other work
+	NSArray				*silenceThresholds;			// all pairs analyzed at once, the first one is the one above
+	NSArray				*silenceLists;				// the silences of the last analysis, one list per pair
 	
 	// attributes to generate the overlayed beep sound
 	double				overlayBeepFrequency;
@@ -91,6 +103,15 @@ extern NSString *AudioFileAnalyzingFinishedNotification;
 - (AudioSegmentTree *)audioSegmentTree;
 
 - (void)analyzeSilencesLongerThan:(double)time quieterThan:(double)volume;
+- (BOOL)analyzeSilencesSynchronouslyLongerThan:(double)time quieterThan:(double)volume;
+- (void)analyzeSilencesWithThresholds:(NSArray *)thresholds;
+- (NSArray *)analyzeSilencesSynchronouslyWithThresholds:(NSArray *)thresholds;
+- (NSArray *)silenceLists;
+- (void)setBackgroundAnalysis:(BOOL)flag;
+- (BOOL)backgroundAnalysis;
+- (BOOL)canRescanSilencesLongerThan:(double)time quieterThan:(double)volume;
+- (BOOL)rescanSilencesLongerThan:(double)time quieterThan:(double)volume;
+- (void)setAudioSegmentTree:(AudioSegmentTree *)tree silencesLongerThan:(double)time quieterThan:(double)volume;
 - (void)abortAnalyzing;
 - (BOOL)writeToFile:(NSString *)path from:(double)start to:(double)end;
 - (void)startPlayingFrom:(double)start to:(double)end;
@@ -105,6 +126,8 @@ extern NSString *AudioFileAnalyzingFinishedNotification;
 // methods to be used by subclasses while decoding
 
 - (void)foundSilenceFrom:(double)start to:(double)end;
+- (void)foundSilenceFrom:(double)start to:(double)end quietestAt:(double)quietest;
+- (void)foundSilences:(NSArray *)silences;
 - (BOOL)canContinueDecoding;
 - (int)getNextOverlayedBeepSampleAtTime:(double)time;
 - (void)writePCMData:(void *)dataPtr length:(size_t)length;
@@ -120,10 +143,15 @@ extern NSString *AudioFileAnalyzingFinishedNotification;
 - (double)progressMaxValue;
 - (double)progressValue;
 - (void)sendProgressChangedNotification;
+- (void)sendDecodingFailedNotification;
 
 - (SeekIndex *)seekIndex;
+- (SeekIndex *)analysisSeekIndex;
+- (void)setLoudnessEnvelope:(LoudnessEnvelope *)envelope;
+- (LoudnessEnvelope *)loudnessEnvelope;
 
 - (BOOL)doAnalyzeAudio;
+- (BOOL)doScanLoudnessEnvelope;
 - (void)doDecodeToAudioBufferFrom:(double)start to:(double)end;
 - (void)doWriteAudioToFile:(NSFileHandle *)file from:(double)start to:(double)end;
 
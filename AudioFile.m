@@ -23,11 +23,15 @@
 
 #import "AudioFile.h"
 #import "AudioFileMP3.h"
-#import "ProgressPanel.h"
+#import "MADWorkStealingPool.h"
 
 
 NSString	*AudioFileProgressChangedNotification = @"AudioFileProgressChangedNotification";
 NSString	*AudioFileAnalyzingFinishedNotification = @"AudioFileAnalyzingFinishedNotification";
+NSString	*AudioFileDecodingFailedNotification = @"AudioFileDecodingFailedNotification";
+
+NSString	*AudioFileSilenceDurationKey = @"silenceDuration";
+NSString	*AudioFileSilenceVolumeKey = @"silenceVolume";
 
 
 @interface AudioFile (Private)
@@ -36,7 +40,11 @@ NSString	*AudioFileAnalyzingFinishedNotification = @"AudioFileAnalyzingFinishedN
 - (void)audioThread:(id)obj;
 - (void)audioThreadFinished:(NSNotification *)notification;
 - (void)analyzerThread:(id)obj;
+- (void)createAudioSegments;
 - (void)analyzerThreadFinished:(NSNotification *)notification;
+- (BOOL)runAnalysis;
+- (void)setSilenceThresholds:(NSArray *)thresholds;
+- (void)setSeekIndex:(SeekIndex *)index;
 
 - (void)openAudioUnitForChannels:(int)channels sampleRate:(float)speed;
 - (void)closeAudioUnit;
@@ -77,6 +85,7 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 		audioVolume = 1.0;
 		overlayBeepFrequency = 2000.0;
 		overlayBeepVolume = 0.4;
+		indexLock = [[NSLock alloc] init];
 		
 		[self openFile];
 	}
@@ -92,6 +101,11 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 	[filePath release];
 	
 	[audioSegmentTree release];
+	[seekIndex release];
+	[indexLock release];
+	[loudnessEnvelope release];
+	[silenceThresholds release];
+	[silenceLists release];
 	
 	[super dealloc];
 }
@@ -123,14 +137,17 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 				
 				// read out the old format and convert to the new one
 				seekIndex = [[SeekIndex alloc] initWithCapacity:seekIndexSize];
+				SeekIndexEntry *entries = (SeekIndexEntry *) malloc(MAX(seekIndexSize, 1) * sizeof(SeekIndexEntry));
 				for (NSUInteger i = 0; i < seekIndexSize; i++) {
 					mad_timer_t time;
 					time.seconds = CFSwapInt32BigToHost((uint32_t)ptr[i].time.seconds);
 					time.fraction = CFSwapInt32BigToHost((uint32_t)ptr[i].time.fraction);
-					NSUInteger byteOffset = CFSwapInt32BigToHost((uint32_t)ptr[i].byteOffset);
-					[seekIndex addOffset:byteOffset
-							forTimeIndex:[MADDecoderProcessor timerToSeconds:time]];
+					entries[i].time = [MADDecoderProcessor timerToSeconds:time];
+					entries[i].byteOffset = CFSwapInt32BigToHost((uint32_t)ptr[i].byteOffset);
 				}
+				[seekIndex addEntries:entries count:seekIndexSize];
+				[seekIndex setComplete];
+				free(entries);
 				
 				// this is the old code that did the encoding/decoding of the binary format
 				/*			unsigned int	bufSize;
@@ -142,6 +159,9 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 				/*        [coder encodeBytes:(const uint8_t *)seekIndex length:(sizeof(SeekIndexEntry) * seekIndexSize) forKey:@"seekIndex"];
 				[coder encodeInt:seekIndexSize forKey:@"seekIndexSize"];*/
 			}
+			
+			// documents from before the envelope was recorded simply have to be decoded again
+			loudnessEnvelope = [[coder decodeObjectForKey:@"loudnessEnvelope"] retain];
 		}
 		
 		return self;
@@ -161,7 +181,9 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 		
 		// save new seekIndex version
         [coder encodeInt:1 forKey:@"seekIndexVersion"];
-        [coder encodeObject:seekIndex forKey:@"seekIndex"];
+        [coder encodeObject:[self seekIndex] forKey:@"seekIndex"];
+		
+		[coder encodeObject:loudnessEnvelope forKey:@"loudnessEnvelope"];
 	} else {
         [NSException raise:NSInvalidArchiveOperationException format:@"Only supports NSKeyedArchiver coders"];
 	}
@@ -214,11 +236,99 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 {
 	silenceDurationThreshold = time;
 	silenceVolumeThreshold = volume * SAMPLE_MAX_VALUE;
+	[silenceThresholds release];
+	silenceThresholds = nil;
 	
 	decoderThreadRunning = YES;
 	[NSThread detachNewThreadSelector:@selector(analyzerThread:) toTarget:self withObject:nil];
 }
 
+// analyzes on the calling thread and returns once done, without posting the finished notification
+- (BOOL)analyzeSilencesSynchronouslyLongerThan:(double)time quieterThan:(double)volume
+{
+	silenceDurationThreshold = time;
+	silenceVolumeThreshold = volume * SAMPLE_MAX_VALUE;
+	[silenceThresholds release];
+	silenceThresholds = nil;
+	
+	return [self runAnalysis];
+}
+
+// analyzes once for several pairs of thresholds, each a dictionary with the duration in seconds and the volume
+// as a fraction of full scale. the slices are made with the first pair, silenceLists has the silences of all pairs.
+- (void)analyzeSilencesWithThresholds:(NSArray *)thresholds
+{
+	[self setSilenceThresholds:thresholds];
+	
+	decoderThreadRunning = YES;
+	[NSThread detachNewThreadSelector:@selector(analyzerThread:) toTarget:self withObject:nil];
+}
+
+// returns the silence lists, or nil if the file could not be analyzed
+- (NSArray *)analyzeSilencesSynchronouslyWithThresholds:(NSArray *)thresholds
+{
+	[self setSilenceThresholds:thresholds];
+	
+	return ([self runAnalysis] ? [self silenceLists] : nil);
+}
+
+// one array of silences per pair of thresholds of the last analysis, each silence a dictionary with its
+// start, end and quietest time in seconds
+- (NSArray *)silenceLists
+{
+	return [[silenceLists retain] autorelease];
+}
+
+- (void)setBackgroundAnalysis:(BOOL)flag
+{
+	backgroundAnalysis = flag;
+}
+
+- (BOOL)backgroundAnalysis
+{
+	return backgroundAnalysis;
+}
+
+- (BOOL)canRescanSilencesLongerThan:(double)time quieterThan:(double)volume
+{
+	return [loudnessEnvelope canScanWithVolumeThreshold:(int)(volume * SAMPLE_MAX_VALUE) durationThreshold:time];
+}
+
+// finds the silences with new thresholds from the loudness envelope of the last analysis.
+// this takes only a moment, so unlike analyzing it runs right away on the calling thread.
+- (BOOL)rescanSilencesLongerThan:(double)time quieterThan:(double)volume
+{
+	if (![self canRescanSilencesLongerThan:time quieterThan:volume]) {
+		return NO;
+	}
+	
+	silenceDurationThreshold = time;
+	silenceVolumeThreshold = volume * SAMPLE_MAX_VALUE;
+	
+	[audioSegmentTree release];
+	audioSegmentTree = [[AudioSegmentTree alloc] init];
+	if (![self doScanLoudnessEnvelope]) {
+		[audioSegmentTree release];
+		audioSegmentTree = nil;
+		return NO;
+	}
+	
+	[self createAudioSegments];
+	
+	return YES;
+}
+
+// puts back slices found earlier, like undoing a rescan does, so that the next rescan starts from them
+- (void)setAudioSegmentTree:(AudioSegmentTree *)tree silencesLongerThan:(double)time quieterThan:(double)volume
+{
+	silenceDurationThreshold = time;
+	silenceVolumeThreshold = volume * SAMPLE_MAX_VALUE;
+	
+	[tree retain];
+	[audioSegmentTree release];
+	audioSegmentTree = tree;
+}
+
 - (void)abortAnalyzing
 {
 	abortDecoding = YES;
@@ -329,11 +439,37 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 #pragma mark -
 
 - (void)foundSilenceFrom:(double)start to:(double)end
+{
+	[self foundSilenceFrom:start to:end quietestAt:-1.0];
+}
+
+- (void)foundSilenceFrom:(double)start to:(double)end quietestAt:(double)quietest
 {
 	// don't allow a silence at the beginning to be treated as such
 	if (start > 0.0) {
-		[audioSegmentTree addSilenceSegmentFrom:start to:end];
+		[audioSegmentTree addSilenceSegmentFrom:start to:end quietestAt:quietest];
+	}
+}
+
+// adds all silences of an analysis at once, each one a dictionary with its start, end and quietest time
+- (void)foundSilences:(NSArray *)silences
+{
+	NSMutableArray *nodes = [NSMutableArray arrayWithCapacity:[silences count]];
+	NSEnumerator *enumerator = [silences objectEnumerator];
+	NSDictionary *silence;
+	while (silence = [enumerator nextObject]) {
+		double start = [[silence objectForKey:@"start"] doubleValue];
+		
+		// don't allow a silence at the beginning to be treated as such
+		if (start > 0.0) {
+			AudioSegmentNode *node = [AudioSegmentNode silenceSegmentNodeFrom:start to:[[silence objectForKey:@"end"] doubleValue]];
+			NSNumber *quietest = [silence objectForKey:@"quietest"];
+			[node setQuietestTime:(quietest ? [quietest doubleValue] : -1.0)];
+			[nodes addObject:node];
+		}
 	}
+	
+	[audioSegmentTree addSilenceSegments:nodes];
 }
 
 - (BOOL)canContinueDecoding
@@ -402,9 +538,35 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 	[[NSNotificationCenter defaultCenter] postNotificationName:AudioFileProgressChangedNotification object:self];
 }
 
+- (void)sendDecodingFailedNotification
+{
+	[[NSNotificationCenter defaultCenter] postNotificationName:AudioFileDecodingFailedNotification object:self];
+}
+
+// playback keeps the index it got even if an analysis replaces it in the meantime
 - (SeekIndex *)seekIndex
 {
-	return seekIndex;
+	[indexLock lock];
+	SeekIndex *index = [[seekIndex retain] autorelease];
+	[indexLock unlock];
+	return index;
+}
+
+// only for the analysis that fills it
+- (SeekIndex *)analysisSeekIndex
+{
+	return analysisSeekIndex;
+}
+
+- (void)setLoudnessEnvelope:(LoudnessEnvelope *)envelope
+{
+	[loudnessEnvelope autorelease];
+	loudnessEnvelope = [envelope retain];
+}
+
+- (LoudnessEnvelope *)loudnessEnvelope
+{
+	return loudnessEnvelope;
 }
 
 
@@ -414,6 +576,12 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 	return NO;
 }
 
+- (BOOL)doScanLoudnessEnvelope
+{
+	// to be implemented in subclass
+	return NO;
+}
+
 - (void)doDecodeToAudioBufferFrom:(double)start to:(double)end
 {
 	// to be implemented in subclass
@@ -486,7 +654,13 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 	[self release];
 	
 	NSAutoreleasePool   *pool = [[NSAutoreleasePool alloc] init];
+	
+	// playback must not stutter, so analysis running at the same time has to make room for us
+	[NSThread setThreadPriority:1.0];
+	[[MADWorkStealingPool sharedPool] beginInteractiveWork];
 	[self doDecodeToAudioBufferFrom:decoderFromTime to:decoderToTime];
+	[[MADWorkStealingPool sharedPool] endInteractiveWork];
+	
     [pool release];
 	
 	[self retain];
@@ -499,6 +673,7 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 	NSLog(@"audioThread started");
 	NSAutoreleasePool   *pool = [[NSAutoreleasePool alloc] init];
 	[self release];
+	[NSThread setThreadPriority:1.0];
 	
 	while (decoderThreadRunning || ![audioBuffer isEmpty]) {
 		if (abortDecoding) {
@@ -527,27 +702,68 @@ static OSStatus coreAudioRenderProc(void *inRefCon, AudioUnitRenderActionFlags *
 {
 	NSAutoreleasePool   *pool = [[NSAutoreleasePool alloc] init];
 	
+	[self runAnalysis];
+	[self performSelectorOnMainThread:@selector(analyzerThreadFinished:) withObject:nil waitUntilDone:NO];
+	
+    [pool release];
+}
+
+- (void)setSilenceThresholds:(NSArray *)thresholds
+{
+	NSDictionary *firstPair = [thresholds objectAtIndex:0];
+	silenceDurationThreshold = [[firstPair objectForKey:AudioFileSilenceDurationKey] doubleValue];
+	silenceVolumeThreshold = [[firstPair objectForKey:AudioFileSilenceVolumeKey] doubleValue] * SAMPLE_MAX_VALUE;
+	
+	[silenceThresholds release];
+	silenceThresholds = [thresholds copy];
+}
+
+- (void)setSeekIndex:(SeekIndex *)index
+{
+	[indexLock lock];
+	SeekIndex *oldIndex = seekIndex;
+	seekIndex = [index retain];
+	[indexLock unlock];
+	[oldIndex autorelease];
+}
+
+- (BOOL)runAnalysis
+{
+	[audioSegmentTree release];
 	audioSegmentTree = [[AudioSegmentTree alloc] init];
-	seekIndex = [[SeekIndex alloc] init];
-	if ([self doAnalyzeAudio]) {
-		duration = [self getAudioDuration];
-		[audioSegmentTree setDuration:duration];
-		[audioSegmentTree createAudioSegmentsBetweenSilences];
-		
-		[[audioSegmentTree sliceAtIndex:0] setAttributesFromTags:[AudioFile readTagsFromFile:filePath]];
-		if ([[audioSegmentTree sliceAtIndex:0] title] == nil) {
-			[[audioSegmentTree sliceAtIndex:0] setTitle:[[filePath lastPathComponent] stringByDeletingPathExtension]];
-		}
+	// playback goes on with the old seek index until the new one is complete
+	analysisSeekIndex = [[SeekIndex alloc] init];
+	BOOL success = [self doAnalyzeAudio];
+	if (success) {
+		// from here on the seek index is only read, and without locking
+		[analysisSeekIndex setComplete];
+		[self setSeekIndex:analysisSeekIndex];
+	}
+	[analysisSeekIndex release];
+	analysisSeekIndex = nil;
+	
+	if (success) {
+		[self createAudioSegments];
+		return YES;
 	} else {
 		[audioSegmentTree release];
 		audioSegmentTree = nil;
-		[seekIndex release];
-		seekIndex = nil;
+		[silenceLists release];
+		silenceLists = nil;
+		return NO;
 	}
+}
+
+- (void)createAudioSegments
+{
+	duration = [self getAudioDuration];
+	[audioSegmentTree setDuration:duration];
+	[audioSegmentTree createAudioSegmentsBetweenSilences];
 	
-	[self performSelectorOnMainThread:@selector(analyzerThreadFinished:) withObject:nil waitUntilDone:NO];
-	
-    [pool release];
+	[[audioSegmentTree sliceAtIndex:0] setAttributesFromTags:[AudioFile readTagsFromFile:filePath]];
+	if ([[audioSegmentTree sliceAtIndex:0] title] == nil) {
+		[[audioSegmentTree sliceAtIndex:0] setTitle:[[filePath lastPathComponent] stringByDeletingPathExtension]];
+	}
 }
 
 - (void)analyzerThreadFinished:(NSNotification *)notification
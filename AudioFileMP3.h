@@ -26,12 +26,23 @@
 #import "AudioFile.h"
 #import "MADDecoder.h"
 #import "MADDecoderThreaded.h"
+#import "MP3FrameIndex.h"
+#import "MP3InputSource.h"
+#import "MP3VBRHeader.h"
+
+// user default with the name of the input source files are opened with (see MP3InputSource.h)
+#define AudioFileMP3InputSourceKey	@"InputSource"
 
 @interface AudioFileMP3 : AudioFile <NSCoding> {
 	// general file information
 	NSFileHandle			*fileHandle;
 	size_t					fileLength;
-	void					*fileData;
+	MP3InputSource			inputSource;
+	MP3InputSourceType		inputSourceType;
+	BOOL					hasInputSourceType;		// otherwise the user default decides
+	MP3FrameIndex			*frameIndex;			// built when opening, or right before the analysis if there is a vbr header
+	MP3VBRHeader			vbrHeader;
+	BOOL					hasVBRHeader;
 	
 	MADDecoder				*madDecoder;
 	
@@ -41,6 +52,13 @@
 	double					audioDuration;
 }
 
++ (MP3InputSourceType)defaultInputSourceType;
+
+- (void)setInputSourceType:(MP3InputSourceType)type;
+- (MP3InputSourceType)inputSourceType;
+- (NSUInteger)numberOfFrames;
+- (const MP3VBRHeader *)vbrHeader;
+
 @end
 
 
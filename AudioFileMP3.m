@@ -23,20 +23,33 @@
 
 #import "AudioFileMP3.h"
 
+#include <errno.h>
+#include <string.h>
 #include <unistd.h>
-#include <sys/mman.h>
+
+
+@interface AudioFileMP3 (Private)
+- (void)connectDecoder;
+- (MP3FrameIndex *)buildFrameIndex;
+- (void)setFrameIndex:(MP3FrameIndex *)index;
+- (MP3FrameIndex *)frameIndex;
+@end
 
 
 @implementation AudioFileMP3
 
++ (MP3InputSourceType)defaultInputSourceType
+{
+	NSString *name = [[NSUserDefaults standardUserDefaults] stringForKey:AudioFileMP3InputSourceKey];
+	return MP3InputSourceTypeForName([name UTF8String], MP3InputSourceMapped);
+}
+
 - (id)initWithPath:(NSString *)path
 {
 	if (self = [super initWithPath:path]) {
 		madDecoder = [[MADDecoderThreaded alloc] initWithAudioFile:self];
 		//madDecoder = [[MADDecoder alloc] initWithAudioFile:self];
-		if (fileData != nil) {
-			[madDecoder setMP3Data:[NSData dataWithBytesNoCopy:fileData length:fileLength freeWhenDone:NO]];
-		}
+		[self connectDecoder];
 	}
 	
 	return self;
@@ -44,7 +57,9 @@
 
 - (void)dealloc
 {
-	[madDecoder dealloc];
+	// closing the file in the super class talks to the decoder
+	[madDecoder release];
+	madDecoder = nil;
 	[super dealloc];
 }
 
@@ -84,6 +99,39 @@
 	return @"mp3";
 }
 
+// switching the input source reopens the file, the decoder must not be busy
+- (void)setInputSourceType:(MP3InputSourceType)type
+{
+	BOOL reopen = (fileHandle != nil && type != inputSource.type);
+	
+	inputSourceType = type;
+	hasInputSourceType = YES;
+	if (reopen) {
+		[self closeFile];
+		[self openFile];
+	}
+}
+
+- (MP3InputSourceType)inputSourceType
+{
+	return (fileHandle != nil) ? inputSource.type : inputSourceType;
+}
+
+// as found by the frame index, or as the vbr header says until there is one
+- (NSUInteger)numberOfFrames
+{
+	MP3FrameIndex *index = [self frameIndex];
+	if (index == nil && hasVBRHeader) {
+		return vbrHeader.numFrames + 1;
+	}
+	return [index numberOfFrames];
+}
+
+- (const MP3VBRHeader *)vbrHeader
+{
+	return hasVBRHeader ? &vbrHeader : NULL;
+}
+
 - (BOOL)openFile
 {
 	if (fileHandle) {
@@ -94,10 +142,27 @@
 	fileLength = [[[[NSFileManager defaultManager] fileAttributesAtPath:filePath traverseLink:NO] objectForKey:NSFileSize] unsignedLongValue];
 	fileHandle = [[NSFileHandle fileHandleForReadingAtPath:filePath] retain];
 	if (fileHandle) {
-		fileData = mmap(0, fileLength, PROT_READ, MAP_SHARED, [fileHandle fileDescriptor], 0);
-		if (!fileData) {
-			return NO;
+		MP3InputSourceType type = hasInputSourceType ? inputSourceType : [AudioFileMP3 defaultInputSourceType];
+		int fd = [fileHandle fileDescriptor];
+		
+		if (!MP3InputSourceOpen(&inputSource, fd, fileLength, type)) {
+			NSLog(@"could not open %@ with input source %s: %s", filePath, MP3InputSourceTypeName(type), strerror(errno));
+			if (type == MP3InputSourceMapped || !MP3InputSourceOpen(&inputSource, fd, fileLength, MP3InputSourceMapped)) {
+				[fileHandle closeFile];
+				[fileHandle release];
+				fileHandle = nil;
+				fileLength = 0;
+				return NO;
+			}
 		}
+		
+		// a Xing or VBRI header gives the duration and approximate seek points without reading any further.
+		// without one, walking the frame headers is cheap and gives exact ones right away.
+		hasVBRHeader = MP3VBRHeaderParse(inputSource.bytes, inputSource.length, &vbrHeader);
+		if (!hasVBRHeader) {
+			[self setFrameIndex:[self buildFrameIndex]];
+		}
+		[self connectDecoder];
 	}
 	
 	return YES;
@@ -105,10 +170,14 @@
 
 - (void)closeFile
 {
-	if (fileData) {
-		munmap(fileData, fileLength);
-		fileData = NULL;
-	}
+	// the decoder must not hold on to the bytes after they are gone
+	[madDecoder setMP3Data:nil];
+	[madDecoder setInputSource:NULL];
+	[madDecoder setVBRHeader:NULL];
+	[self setFrameIndex:nil];
+	hasVBRHeader = NO;
+	
+	MP3InputSourceClose(&inputSource);
 	
 	[fileHandle closeFile];
 	[fileHandle release];
@@ -139,13 +208,37 @@
 {
 	int result = 0;
 	
-	result = [madDecoder analyzeSilencesWithVolumeThreshold:silenceVolumeThreshold
-										  durationThreshold:silenceDurationThreshold];
+	// the exact seek points take over from the vbr header now, and the analysis splits the file with them
+	if ([self frameIndex] == nil && inputSource.bytes != NULL) {
+		[self setFrameIndex:[self buildFrameIndex]];
+	}
+	
+	// all pairs are analyzed in one pass, the slices are made from the first one
+	NSUInteger count = MAX([silenceThresholds count], 1);
+	MADSilenceThresholds *thresholds = (MADSilenceThresholds *) malloc(count * sizeof(MADSilenceThresholds));
+	thresholds[0].volumeThreshold = silenceVolumeThreshold;
+	thresholds[0].durationThreshold = silenceDurationThreshold;
+	for (NSUInteger i = 1; i < count; i++) {
+		NSDictionary *pair = [silenceThresholds objectAtIndex:i];
+		thresholds[i].volumeThreshold = (long)([[pair objectForKey:AudioFileSilenceVolumeKey] doubleValue] * SAMPLE_MAX_VALUE);
+		thresholds[i].durationThreshold = [[pair objectForKey:AudioFileSilenceDurationKey] doubleValue];
+	}
+	
+	NSArray *lists = nil;
+	[madDecoder setAnalysisPriority:(backgroundAnalysis ? MADWorkPriorityBackground : MADWorkPriorityNormal)];
+	result = [madDecoder analyzeSilencesWithThresholds:thresholds count:count silences:&lists];
+	free(thresholds);
 	
 	if (result < 0) {
 		return NO;
 	}
 	
+	[silenceLists release];
+	silenceLists = [lists retain];
+	if ([lists count] > 0) {
+		[madDecoder foundSilences:[lists objectAtIndex:0]];
+	}
+	
 	audioDuration = [madDecoder audioDuration];
 	audioChannels = [madDecoder audioChannels];
 	audioSamplingFrequency = [madDecoder audioSamplingFrequency];
@@ -153,6 +246,21 @@
 	return YES;
 }
 
+- (BOOL)doScanLoudnessEnvelope
+{
+	int result = [madDecoder scanSilencesInEnvelope:loudnessEnvelope
+									volumeThreshold:silenceVolumeThreshold
+								  durationThreshold:silenceDurationThreshold];
+	
+	if (result < 0) {
+		return NO;
+	}
+	
+	audioDuration = [madDecoder audioDuration];
+	
+	return YES;
+}
+
 - (void)doDecodeToAudioBufferFrom:(double)start to:(double)end
 {
 	[madDecoder playAudioStartTime:start endTime:end];
@@ -167,18 +275,81 @@
 
 - (double)getAudioDuration
 {
+	if (audioDuration == 0.0) {
+		// not analyzed yet
+		MP3FrameIndex *index = [self frameIndex];
+		if (index == nil && hasVBRHeader) {
+			return MP3VBRHeaderDuration(&vbrHeader);
+		}
+		return [index duration];
+	}
+	
 	return audioDuration;
 }
 
 - (int)getAudioSampleRate
 {
+	if (audioSamplingFrequency == 0 && hasVBRHeader) {
+		// not analyzed yet, good enough for playing a preview
+		return vbrHeader.frameHeader.samplerate;
+	}
 	return audioSamplingFrequency;
 }
 
 - (int)getAudioChannels
 {
+	if (audioChannels == 0 && hasVBRHeader) {
+		return vbrHeader.frameHeader.channels;
+	}
 	return audioChannels;
 }
 
 @end
 
+
+#pragma mark -
+
+
+@implementation AudioFileMP3 (Private)
+
+- (void)connectDecoder
+{
+	if (inputSource.bytes != NULL) {
+		[madDecoder setMP3Data:[NSData dataWithBytesNoCopy:(void *)inputSource.bytes length:inputSource.length freeWhenDone:NO]];
+		[madDecoder setInputSource:&inputSource];
+		[madDecoder setFrameIndex:[self frameIndex]];
+		[madDecoder setVBRHeader:(hasVBRHeader ? &vbrHeader : NULL)];
+	}
+}
+
+// afterwards playback seeks around, the analyzers give their own advice about their sections
+- (MP3FrameIndex *)buildFrameIndex
+{
+	MP3InputSourceAdvise(&inputSource, 0, inputSource.length, MP3InputSourceAdviceSequential);
+	MP3FrameIndex *index = [[[MP3FrameIndex alloc] initWithBytes:inputSource.bytes length:inputSource.length] autorelease];
+	MP3InputSourceAdvise(&inputSource, 0, inputSource.length, MP3InputSourceAdviceNormal);
+	return index;
+}
+
+// the analysis builds the index while playback may be seeking with the old one, which is only
+// autoreleased here, and the decoder swaps its own reference the same way
+- (void)setFrameIndex:(MP3FrameIndex *)index
+{
+	[indexLock lock];
+	MP3FrameIndex *oldIndex = frameIndex;
+	frameIndex = [index retain];
+	[indexLock unlock];
+	[oldIndex autorelease];
+	
+	[madDecoder setFrameIndex:index];
+}
+
+- (MP3FrameIndex *)frameIndex
+{
+	[indexLock lock];
+	MP3FrameIndex *index = [[frameIndex retain] autorelease];
+	[indexLock unlock];
+	return index;
+}
+
+@end
@@ -35,6 +35,7 @@ typedef NS_ENUM(NSUInteger, AudioSegmentNodeType) {
 	AudioSegmentNodeType	nodeType;
 	double					startTime;
 	double					endTime;
+	double					quietestTime;	// where to cut inside a silence, negative if not known
 	
 	BOOL					doesSplit;
 	
@@ -55,6 +56,8 @@ typedef NS_ENUM(NSUInteger, AudioSegmentNodeType) {
 - (double)startTime;
 - (double)endTime;
 - (double)duration;
+- (void)setQuietestTime:(double)time;
+- (double)quietestTime;
 
 - (void)setDoesSplit:(BOOL)flag;
 - (BOOL)doesSplit;
@@ -64,6 +67,7 @@ typedef NS_ENUM(NSUInteger, AudioSegmentNodeType) {
 - (NSUInteger)indexOfChild:(AudioSegmentNode *)child;
 
 - (void)addNodeToChildren:(AudioSegmentNode *)node;
+- (void)addSortedNodesToChildren:(NSArray *)nodes;
 - (void)mergeChildWithNeighbours:(AudioSegmentNode *)node;
 - (void)unmergeNode:(AudioSegmentNode *)node inChild:(AudioSegmentNode *)child;
 
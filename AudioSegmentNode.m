@@ -47,6 +47,7 @@
 		nodeType = type;
 		startTime = start;
 		endTime = end;
+		quietestTime = -1.0;
 		childNodes = [[SkipList alloc] init];
 	}
 	
@@ -74,6 +75,7 @@
 			nodeType = [coder decodeIntegerForKey:@"nodeType"];
 			startTime = [coder decodeDoubleForKey:@"startTime"];
 			endTime = [coder decodeDoubleForKey:@"endTime"];
+			quietestTime = [coder containsValueForKey:@"quietestTime"] ? [coder decodeDoubleForKey:@"quietestTime"] : -1.0;
 			doesSplit = [coder decodeBoolForKey:@"doesSplit"];
 			childNodes = [[coder decodeObjectForKey:@"childNodes"] retain];
 		} else {
@@ -90,6 +92,7 @@
         [coder encodeInteger:nodeType forKey:@"nodeType"];
         [coder encodeDouble:startTime forKey:@"startTime"];
         [coder encodeDouble:endTime forKey:@"endTime"];
+        [coder encodeDouble:quietestTime forKey:@"quietestTime"];
         [coder encodeBool:doesSplit forKey:@"doesSplit"];
         [coder encodeObject:childNodes forKey:@"childNodes"];
 	} else {
@@ -141,6 +144,16 @@
 	return endTime - startTime;
 }
 
+- (void)setQuietestTime:(double)time
+{
+	quietestTime = time;
+}
+
+- (double)quietestTime
+{
+	return quietestTime;
+}
+
 - (void)setDoesSplit:(BOOL)flag
 {
 	doesSplit = flag;
@@ -198,6 +211,37 @@
 	}
 }
 
+// adds many nodes sorted by start time at once. into an empty collection this only needs one pass
+// to join overlapping silences, instead of checking every new node against all children.
+- (void)addSortedNodesToChildren:(NSArray *)nodes
+{
+	if (nodeType != AudioSegmentNodeTypeCollection || [childNodes count] > 0) {
+		NSEnumerator *enumerator = [nodes objectEnumerator];
+		AudioSegmentNode *node;
+		while (node = [enumerator nextObject]) {
+			[self addNodeToChildren:node];
+		}
+		return;
+	}
+	
+	AudioSegmentNode *previous = nil;
+	NSEnumerator *enumerator = [nodes objectEnumerator];
+	AudioSegmentNode *node;
+	while (node = [enumerator nextObject]) {
+		if (previous && (node->nodeType == AudioSegmentNodeTypeSilence) && (previous->nodeType == AudioSegmentNodeTypeSilence) && [previous overlapsWith:node]) {
+			previous->endTime = MAX(previous->endTime, node->endTime);
+		} else {
+			[childNodes addObject:node];
+			previous = node;
+		}
+	}
+	
+	if ([childNodes count] > 0) {
+		startTime = ((AudioSegmentNode *)[childNodes firstObject])->startTime;
+		endTime = ((AudioSegmentNode *)[childNodes lastObject])->endTime;
+	}
+}
+
 - (void)mergeChildWithNeighbours:(AudioSegmentNode *)node
 {
 	NSUInteger		nodeIndex = [childNodes indexOfObjectIdenticalTo:node];
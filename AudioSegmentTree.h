@@ -71,6 +71,8 @@ extern NSString *AudioSegmentTreeDidChangeNotification;
 - (double)longestSilenceInTree;
 
 - (void)addSilenceSegmentFrom:(double)start to:(double)end;
+- (void)addSilenceSegmentFrom:(double)start to:(double)end quietestAt:(double)quietest;
+- (void)addSilenceSegments:(NSArray *)nodes;
 - (void)addAudioSegmentFrom:(double)start to:(double)end;
 - (void)createAudioSegmentsBetweenSilences;
 - (void)reorder;
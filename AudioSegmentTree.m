@@ -317,7 +317,20 @@ NSString *AudioSegmentTreeDidChangeNotification = @"AudioSegmentTreeDidChangeNot
 
 - (void)addSilenceSegmentFrom:(double)start to:(double)end
 {
-	[rootNode addNodeToChildren:[AudioSegmentNode silenceSegmentNodeFrom:start to:end]];
+	[self addSilenceSegmentFrom:start to:end quietestAt:-1.0];
+}
+
+- (void)addSilenceSegmentFrom:(double)start to:(double)end quietestAt:(double)quietest
+{
+	AudioSegmentNode *node = [AudioSegmentNode silenceSegmentNodeFrom:start to:end];
+	[node setQuietestTime:quietest];
+	[rootNode addNodeToChildren:node];
+}
+
+// adds a whole analysis worth of silence segment nodes in one go
+- (void)addSilenceSegments:(NSArray *)nodes
+{
+	[rootNode addSortedNodesToChildren:[nodes sortedArrayUsingSelector:@selector(compare:)]];
 }
 
 - (void)addAudioSegmentFrom:(double)start to:(double)end
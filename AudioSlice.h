@@ -69,6 +69,10 @@ extern NSString *AudioSliceDidChangeNotification;
 - (double)endTime;
 - (double)duration;
 
+// where to cut when exporting, only the sides that have a silence are set
+- (void)getSplitStartTime:(double *)start endTime:(double *)end relativeSilenceSplitPoint:(double)splitPoint;
+- (NSString *)filenameUsingFormat:(NSString *)format extension:(NSString *)extension;
+
 - (void)setAttributesFromTags:(NSDictionary *)tagDict;
 - (NSDictionary *)tagsFromAttributes;
 
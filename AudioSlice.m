@@ -235,6 +235,60 @@ NSString *AudioSliceDidChangeNotification = @"AudioSliceDidChangeNotification";
 	return [self endTime] - [self startTime];
 }
 
+- (void)getSplitStartTime:(double *)start endTime:(double *)end relativeSilenceSplitPoint:(double)splitPoint
+{
+	if (leftSilenceSegment) {
+		if ([leftSilenceSegment quietestTime] >= 0.0) {
+			// the analysis found the quietest point of the silence
+			*start = [leftSilenceSegment quietestTime];
+		} else {
+			*start = [leftSilenceSegment endTime];
+			*start -= ([leftSilenceSegment duration] * (1.0 - splitPoint));
+		}
+	}
+	if (rightSilenceSegment) {
+		if ([rightSilenceSegment quietestTime] >= 0.0) {
+			*end = [rightSilenceSegment quietestTime];
+		} else {
+			*end = [rightSilenceSegment startTime];
+			*end += ([rightSilenceSegment duration] * splitPoint);
+		}
+	}
+}
+
+- (NSString *)filenameUsingFormat:(NSString *)format extension:(NSString *)extension
+{
+	NSMutableString		*name = [[format mutableCopy] autorelease];
+	NSUInteger			trackNumberDigits = [(NSString *)[NSString stringWithFormat:@"%lu", (unsigned long)[self trackCount]] length];
+	NSUInteger			cdNumberDigits = [(NSString *)[NSString stringWithFormat:@"%lu", (unsigned long)[self cdCount]] length];
+	NSString			*key;
+	NSEnumerator		*keys = [[NSArray arrayWithObjects:@"title", @"artist", @"album", @"composer", @"genre", @"year",
+														   @"trackNumber", @"trackCount", @"cdNumber", @"cdCount",
+														   nil] objectEnumerator];
+	
+	while (key = [keys nextObject]) {
+		id  replacement = [self valueForKey:key];
+		if (replacement) {
+			if (trackNumberDigits > 0 && [key isEqualToString:@"trackNumber"]) {
+				replacement = [NSString stringWithFormat:[NSString stringWithFormat:@"%%0%lud", (unsigned long)trackNumberDigits], [replacement integerValue]];
+			} else if (cdNumberDigits > 0 && [key isEqualToString:@"cdNumber"]) {
+				replacement = [NSString stringWithFormat:[NSString stringWithFormat:@"%%0%lud", (unsigned long)cdNumberDigits], [replacement integerValue]];
+			}
+		} else {
+			replacement = @"";
+		}
+		[name replaceOccurrencesOfString:[NSString stringWithFormat:@"[%@]", key]
+							  withString:[NSString stringWithFormat:@"%@", replacement]
+								 options:NSCaseInsensitiveSearch
+								   range:NSMakeRange(0, [name length])];
+	}
+	
+	[name replaceOccurrencesOfString:@":" withString:@"_" options:0 range:NSMakeRange(0, [name length])];
+	[name replaceOccurrencesOfString:@"/" withString:@":" options:0 range:NSMakeRange(0, [name length])];
+	
+	return [name stringByAppendingPathExtension:extension];
+}
+
 #pragma mark -
 
 - (void)setAttributesFromTags:(NSDictionary *)tagDict
@@ -0,0 +1,512 @@
+//
+//  AudioSlicerEngine.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#include "AudioSlicerEngine.h"
+#include "MADSilenceTracker.h"
+#include "MADEnergyKernel.h"
+#include "MP3FrameHeader.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <mad/mad.h>
+
+// how much of the input is decoded at once, bounds the buffer no matter how much is fed in one call
+#define ASEngineInputChunkSize		65536
+
+typedef struct {
+	double			startTime;
+	double			endTime;
+	double			quietestTime;
+} ASEngineSilence;
+
+struct ASEngineSession {
+	ASEngineSettings		settings;
+	ASEngineSilenceCallback	callback;
+	void					*context;
+	int						finished;
+	ASEngineResult			error;			// sticky, once something failed the session is useless
+	
+	struct mad_stream		stream;
+	struct mad_frame		frame;
+	unsigned long			badFrameCount;
+	
+	// input that wasn't decoded yet, the stream keeps the bit reservoir across refills
+	uint8_t					*buffer;
+	size_t					bufferLength;
+	size_t					bufferCapacity;
+	uint64_t				bufferByteOffset;	// position of buffer[0] in the stream
+	
+	// every call to feed is one section of the silence trackers, the stitcher joins them
+	mad_timer_t				currentTime;
+	mad_timer_t				sectionStartTime;
+	mad_timer_t				sectionTime;		// currentTime relative to the section
+	MADSilenceTracker		tracker;
+	MADSilenceStitcher		stitcher;
+	
+	ASEngineFrame			*frames;
+	size_t					numFrames;
+	size_t					allocedFrames;
+	
+	ASEngineSilence			*silences;
+	size_t					numSilences;
+	size_t					allocedSilences;
+};
+
+static void collectSilence(void *context, double start, double end, double quietest);
+static ASEngineResult decodeBuffer(ASEngineSession *session);
+
+
+void
+ASEngineSettingsInitDefault(ASEngineSettings *settings)
+{
+	settings->silenceDurationThreshold = 1.1;
+	settings->silenceVolumeThreshold = 983;		// 3% of full scale
+	settings->silenceResolution = ASEngineSilenceResolutionFrame;
+	settings->relativeSilenceSplitPoint = 0.66;
+	settings->maxBadFrames = 500;
+}
+
+ASEngineSession *
+ASEngineSessionCreate(const ASEngineSettings *settings, ASEngineSilenceCallback callback, void *context)
+{
+	ASEngineSession *session = (ASEngineSession *) calloc(1, sizeof(ASEngineSession));
+	if (session == NULL) {
+		return NULL;
+	}
+	
+	if (settings != NULL) {
+		session->settings = *settings;
+	} else {
+		ASEngineSettingsInitDefault(&session->settings);
+	}
+	session->callback = callback;
+	session->context = context;
+	session->error = ASEngineResultOK;
+	
+	mad_stream_init(&session->stream);
+	mad_frame_init(&session->frame);
+	
+	session->currentTime = mad_timer_zero;
+	session->sectionStartTime = mad_timer_zero;
+	session->sectionTime = mad_timer_zero;
+	MADSilenceTrackerInit(&session->tracker, session->settings.silenceVolumeThreshold);
+	MADSilenceStitcherInit(&session->stitcher, session->settings.silenceDurationThreshold, collectSilence, session);
+	
+	return session;
+}
+
+void
+ASEngineSessionDestroy(ASEngineSession *session)
+{
+	if (session == NULL) {
+		return;
+	}
+	
+	mad_frame_finish(&session->frame);
+	mad_stream_finish(&session->stream);
+	MADSilenceTrackerFinish(&session->tracker);
+	
+	free(session->buffer);
+	free(session->frames);
+	free(session->silences);
+	free(session);
+}
+
+
+#pragma mark -
+
+
+static int
+appendToBuffer(ASEngineSession *session, const uint8_t *bytes, size_t length)
+{
+	if (session->bufferLength + length > session->bufferCapacity) {
+		size_t capacity = session->bufferLength + length;
+		uint8_t *buffer = (uint8_t *) realloc(session->buffer, capacity);
+		if (buffer == NULL) {
+			return 0;
+		}
+		session->buffer = buffer;
+		session->bufferCapacity = capacity;
+	}
+	
+	if (bytes != NULL) {
+		memcpy(session->buffer + session->bufferLength, bytes, length);
+	} else {
+		memset(session->buffer + session->bufferLength, 0, length);
+	}
+	session->bufferLength += length;
+	return 1;
+}
+
+// the stitcher joined the sections so far into the next silence that is long enough
+static void
+endSection(ASEngineSession *session)
+{
+	MADSilenceStitcherAddSection(&session->stitcher, &session->tracker, session->sectionStartTime);
+	MADSilenceTrackerReset(&session->tracker);
+	session->sectionStartTime = session->currentTime;
+	session->sectionTime = mad_timer_zero;
+}
+
+ASEngineResult
+ASEngineSessionFeed(ASEngineSession *session, const void *bytes, size_t length)
+{
+	const uint8_t *input = (const uint8_t *) bytes;
+	
+	if (session->error != ASEngineResultOK) {
+		return session->error;
+	}
+	if (session->finished) {
+		return ASEngineResultInvalidState;
+	}
+	
+	while (length > 0) {
+		size_t chunk = (length < ASEngineInputChunkSize) ? length : ASEngineInputChunkSize;
+		if (!appendToBuffer(session, input, chunk)) {
+			session->error = ASEngineResultOutOfMemory;
+			return session->error;
+		}
+		session->error = decodeBuffer(session);
+		if (session->error != ASEngineResultOK) {
+			return session->error;
+		}
+		input += chunk;
+		length -= chunk;
+	}
+	
+	endSection(session);
+	return session->error;
+}
+
+ASEngineResult
+ASEngineSessionFinish(ASEngineSession *session)
+{
+	if (session->error != ASEngineResultOK) {
+		return session->error;
+	}
+	if (session->finished) {
+		return ASEngineResultInvalidState;
+	}
+	
+	// libmad only decodes the last frame if it is followed by MAD_BUFFER_GUARD bytes
+	if (!appendToBuffer(session, NULL, MAD_BUFFER_GUARD)) {
+		session->error = ASEngineResultOutOfMemory;
+		return session->error;
+	}
+	session->error = decodeBuffer(session);
+	if (session->error != ASEngineResultOK) {
+		return session->error;
+	}
+	
+	// a silence still going on at the end doesn't cut anything and isn't reported
+	endSection(session);
+	session->finished = 1;
+	return session->error;
+}
+
+
+#pragma mark -
+
+
+size_t
+ASEngineSessionNumberOfFrames(const ASEngineSession *session)
+{
+	return session->numFrames;
+}
+
+ASEngineResult
+ASEngineSessionFrameAtIndex(const ASEngineSession *session, size_t index, ASEngineFrame *frame)
+{
+	if (index >= session->numFrames) {
+		return ASEngineResultInvalidState;
+	}
+	*frame = session->frames[index];
+	return ASEngineResultOK;
+}
+
+size_t
+ASEngineSessionFrameIndexForTime(const ASEngineSession *session, double time)
+{
+	// the last frame starting at or before time
+	size_t low = 0;
+	size_t high = session->numFrames;
+	while (high - low > 1) {
+		size_t middle = low + (high - low) / 2;
+		if (session->frames[middle].time <= time) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+double
+ASEngineSessionDuration(const ASEngineSession *session)
+{
+	return session->currentTime.seconds + (double) session->currentTime.fraction / MAD_TIMER_RESOLUTION;
+}
+
+unsigned long
+ASEngineSessionBadFrameCount(const ASEngineSession *session)
+{
+	return session->badFrameCount;
+}
+
+ASEngineResult
+ASEngineSessionCreateSlicePlan(const ASEngineSession *session, ASEngineSlice **slices, size_t *numSlices)
+{
+	*slices = NULL;
+	*numSlices = 0;
+	
+	if (session->error != ASEngineResultOK) {
+		return session->error;
+	}
+	if (!session->finished) {
+		return ASEngineResultInvalidState;
+	}
+	if (session->numFrames == 0) {
+		return ASEngineResultOK;
+	}
+	
+	ASEngineSlice *plan = (ASEngineSlice *) malloc((session->numSilences + 1) * sizeof(ASEngineSlice));
+	if (plan == NULL) {
+		return ASEngineResultOutOfMemory;
+	}
+	
+	// cut in every silence, like -[AudioSlice getSplitStartTime:endTime:relativeSilenceSplitPoint:] does
+	double duration = ASEngineSessionDuration(session);
+	double startTime = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < session->numSilences; i++) {
+		const ASEngineSilence *silence = &session->silences[i];
+		if (silence->startTime <= 0.0 || silence->endTime >= duration) {
+			// nothing to cut off before or after it
+			continue;
+		}
+		
+		double cutTime = silence->quietestTime;
+		if (cutTime < 0.0) {
+			cutTime = silence->startTime + (silence->endTime - silence->startTime) * session->settings.relativeSilenceSplitPoint;
+		}
+		plan[count].startTime = startTime;
+		plan[count].endTime = cutTime;
+		count++;
+		startTime = cutTime;
+	}
+	plan[count].startTime = startTime;
+	plan[count].endTime = duration;
+	count++;
+	
+	// slices start at the frame playing at their start time and end where the next slice starts
+	const ASEngineFrame *lastFrame = &session->frames[session->numFrames - 1];
+	for (size_t i = 0; i < count; i++) {
+		plan[i].startByte = session->frames[ASEngineSessionFrameIndexForTime(session, plan[i].startTime)].byteOffset;
+		if (i + 1 < count) {
+			plan[i].endByte = session->frames[ASEngineSessionFrameIndexForTime(session, plan[i].endTime)].byteOffset;
+		} else {
+			plan[i].endByte = lastFrame->byteOffset + lastFrame->length;
+		}
+	}
+	
+	*slices = plan;
+	*numSlices = count;
+	return ASEngineResultOK;
+}
+
+
+#pragma mark -
+
+
+static void
+collectSilence(void *context, double start, double end, double quietest)
+{
+	ASEngineSession *session = (ASEngineSession *) context;
+	
+	// at frame resolution the quietest point is just the start of a frame, not worth cutting at
+	if (session->settings.silenceResolution == ASEngineSilenceResolutionFrame) {
+		quietest = -1.0;
+	}
+	
+	if (session->numSilences >= session->allocedSilences) {
+		size_t alloced = (session->allocedSilences > 0) ? (session->allocedSilences * 2) : 64;
+		ASEngineSilence *silences = (ASEngineSilence *) realloc(session->silences, alloced * sizeof(ASEngineSilence));
+		if (silences == NULL) {
+			session->error = ASEngineResultOutOfMemory;
+			return;
+		}
+		session->silences = silences;
+		session->allocedSilences = alloced;
+	}
+	session->silences[session->numSilences].startTime = start;
+	session->silences[session->numSilences].endTime = end;
+	session->silences[session->numSilences].quietestTime = quietest;
+	session->numSilences++;
+	
+	if (session->callback != NULL) {
+		session->callback(session->context, start, end, quietest);
+	}
+}
+
+static int
+recordFrame(ASEngineSession *session)
+{
+	if (session->numFrames >= session->allocedFrames) {
+		size_t alloced = (session->allocedFrames > 0) ? (session->allocedFrames * 2) : 1024;
+		ASEngineFrame *frames = (ASEngineFrame *) realloc(session->frames, alloced * sizeof(ASEngineFrame));
+		if (frames == NULL) {
+			return 0;
+		}
+		session->frames = frames;
+		session->allocedFrames = alloced;
+	}
+	
+	ASEngineFrame *frame = &session->frames[session->numFrames++];
+	frame->byteOffset = session->bufferByteOffset + (uint64_t)(session->stream.this_frame - session->buffer);
+	frame->length = (uint32_t)(session->stream.next_frame - session->stream.this_frame);
+	frame->time = ASEngineSessionDuration(session);
+	return 1;
+}
+
+// same volumes as the analyzer of MADDecoderProcessor
+static void
+trackFrame(ASEngineSession *session)
+{
+	int slots;
+	switch (session->settings.silenceResolution) {
+		case ASEngineSilenceResolutionGranule:
+			slots = 18;
+			break;
+		case ASEngineSilenceResolutionBlock:
+			slots = 1;
+			break;
+		default:
+			slots = 0;	// one volume for the whole frame
+			break;
+	}
+	
+	unsigned long blockVolumes[MADEnergyMaxBlocksPerFrame];
+	unsigned long frameVolume;
+	
+	int numBlocks = MADEnergyFrameVolumes(&session->frame, slots, blockVolumes, &frameVolume);
+	MADSilenceTrackerAddBlocks(&session->tracker, blockVolumes, numBlocks, slots * 32,
+							   session->frame.header.samplerate, session->sectionTime);
+}
+
+// returns whether decoding can go on after the error
+static int
+handleError(ASEngineSession *session)
+{
+	struct mad_stream *stream = &session->stream;
+	size_t available = stream->bufend - stream->this_frame;
+	size_t tagLength;
+	
+	switch (stream->error) {
+		case MAD_ERROR_LOSTSYNC:
+			if ((tagLength = MP3TagLength(stream->this_frame, available)) > 0) {
+				// libmad carries the rest of the skip over to the next buffer
+				mad_stream_skip(stream, tagLength);
+				return 1;
+			}
+			break;
+			
+		case MAD_ERROR_BADDATAPTR:
+		case MAD_ERROR_BADHUFFDATA:
+			// the bit reservoir isn't filled at the start of the stream, or after a damaged frame
+			return 1;
+			
+		default:
+			break;
+	}
+	
+	session->badFrameCount++;
+	return (session->badFrameCount <= session->settings.maxBadFrames);
+}
+
+static void
+advanceTime(ASEngineSession *session)
+{
+	mad_timer_add(&session->currentTime, session->frame.header.duration);
+	mad_timer_add(&session->sectionTime, session->frame.header.duration);
+}
+
+// decodes all complete frames in the buffer and keeps the rest for the next call
+static ASEngineResult
+decodeBuffer(ASEngineSession *session)
+{
+	struct mad_stream *stream = &session->stream;
+	ASEngineResult result = ASEngineResultOK;
+	
+	mad_stream_buffer(stream, session->buffer, session->bufferLength);
+	
+	while (result == ASEngineResultOK) {
+		if (mad_header_decode(&session->frame.header, stream) == -1) {
+			if (stream->error == MAD_ERROR_BUFLEN) {
+				break;
+			}
+			if (!MAD_RECOVERABLE(stream->error)) {
+				result = ASEngineResultDecodeFailed;
+			} else if (!handleError(session)) {
+				result = ASEngineResultTooManyErrors;
+			}
+			continue;
+		}
+		
+		int decoded = (mad_frame_decode(&session->frame, stream) == 0);
+		if (!decoded) {
+			if (stream->error == MAD_ERROR_BUFLEN) {
+				// the frame is decoded again once more data arrived
+				break;
+			}
+			if (!MAD_RECOVERABLE(stream->error)) {
+				result = ASEngineResultDecodeFailed;
+				continue;
+			}
+			if (!handleError(session)) {
+				result = ASEngineResultTooManyErrors;
+				continue;
+			}
+		}
+		
+		if (!recordFrame(session)) {
+			result = ASEngineResultOutOfMemory;
+			continue;
+		}
+		// a broken frame still takes its time, but its volume isn't known
+		if (decoded) {
+			trackFrame(session);
+		}
+		advanceTime(session);
+	}
+	
+	// keep everything from the first byte libmad hasn't consumed yet
+	size_t consumed = (stream->next_frame != NULL) ? (size_t)(stream->next_frame - session->buffer) : 0;
+	memmove(session->buffer, session->buffer + consumed, session->bufferLength - consumed);
+	session->bufferLength -= consumed;
+	session->bufferByteOffset += consumed;
+	
+	if (result == ASEngineResultOK) {
+		result = session->error;
+	}
+	return result;
+}
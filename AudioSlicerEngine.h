@@ -0,0 +1,109 @@
+//
+//  AudioSlicerEngine.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef AUDIOSLICERENGINE_H
+#define AUDIOSLICERENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the analysis and splitting engine as a plain C library. a session analyzes one mp3 stream that is
+// fed to it in pieces of any size, reports silences through a callback as soon as they are complete
+// and can afterwards answer frame index queries and plan the byte ranges of the slices.
+// sessions don't share any state, any number of them can be used concurrently, but a single session
+// must not be used by more than one thread at the same time.
+
+typedef struct ASEngineSession ASEngineSession;
+
+typedef enum {
+	ASEngineResultOK = 0,
+	ASEngineResultOutOfMemory,
+	ASEngineResultInvalidState,		// fed after finishing, or queried before
+	ASEngineResultTooManyErrors,	// the stream is not mp3 or too damaged to be analyzed
+	ASEngineResultDecodeFailed		// libmad failed with an error it can't recover from
+} ASEngineResult;
+
+typedef enum {
+	ASEngineSilenceResolutionFrame,		// one volume per frame
+	ASEngineSilenceResolutionGranule,	// one volume per granule of 576 samples
+	ASEngineSilenceResolutionBlock		// one volume per subband sample block of 32 samples
+} ASEngineSilenceResolution;
+
+typedef struct {
+	double						silenceDurationThreshold;	// min secs a silence has to last to be reported
+	long						silenceVolumeThreshold;		// max volume level in pcm scale
+	ASEngineSilenceResolution	silenceResolution;
+	double						relativeSilenceSplitPoint;	// 0.0 - 1.0, where to cut silences without a quietest point
+	unsigned long				maxBadFrames;				// how many broken frames are tolerated
+} ASEngineSettings;
+
+typedef struct {
+	uint64_t		byteOffset;		// of the frame header in the stream
+	uint32_t		length;			// in bytes including the header
+	double			time;			// secs from the start of the stream
+} ASEngineFrame;
+
+typedef struct {
+	double			startTime;
+	double			endTime;
+	uint64_t		startByte;		// frame aligned, endByte is the first byte not belonging to the slice
+	uint64_t		endByte;
+} ASEngineSlice;
+
+// quietest is -1 if it is unknown (at frame resolution), all times are in secs from the start of the stream
+typedef void (*ASEngineSilenceCallback)(void *context, double start, double end, double quietest);
+
+// the same defaults the application uses
+void ASEngineSettingsInitDefault(ASEngineSettings *settings);
+
+// settings are copied, callback may be NULL if the silences are only needed for the slice plan
+ASEngineSession *ASEngineSessionCreate(const ASEngineSettings *settings, ASEngineSilenceCallback callback, void *context);
+void ASEngineSessionDestroy(ASEngineSession *session);
+
+// analyzes the next length bytes of the stream. silences found in them are reported before it returns,
+// a silence that is still going on at the end is reported by a later call once it ends.
+ASEngineResult ASEngineSessionFeed(ASEngineSession *session, const void *bytes, size_t length);
+
+// analyzes what is left of the stream, afterwards the session can't be fed anymore
+ASEngineResult ASEngineSessionFinish(ASEngineSession *session);
+
+// the frame index grows while the session is fed, it can be queried at any time
+size_t ASEngineSessionNumberOfFrames(const ASEngineSession *session);
+ASEngineResult ASEngineSessionFrameAtIndex(const ASEngineSession *session, size_t index, ASEngineFrame *frame);
+// index of the frame playing at time, time before the first frame gives 0 and past the end the last frame
+size_t ASEngineSessionFrameIndexForTime(const ASEngineSession *session, double time);
+double ASEngineSessionDuration(const ASEngineSession *session);
+unsigned long ASEngineSessionBadFrameCount(const ASEngineSession *session);
+
+// cuts the stream at the silences found, only after finishing. the caller frees *slices with free()
+ASEngineResult ASEngineSessionCreateSlicePlan(const ASEngineSession *session, ASEngineSlice **slices, size_t *numSlices);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
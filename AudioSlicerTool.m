@@ -0,0 +1,897 @@
+//
+//  AudioSlicerTool.m
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+// headless front end to the analysis and export engine. it links no AppKit, so it can be scripted
+// and profiled, and it prints its results and timings as JSON for benchmarks to pick up.
+
+#import <Foundation/Foundation.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#import "AudioFile.h"
+#import "AudioFileMP3.h"
+#import "AudioSlice.h"
+#import "AudioSlicerEngine.h"
+#import "BatchAnalyzer.h"
+#import "MADEnergyKernel.h"
+#import "MADWorkStealingPool.h"
+
+
+typedef struct {
+	double		silenceDurationThreshold;		// seconds
+	double		silenceVolumeThreshold;			// fraction of full scale
+	NSArray		*silenceThresholds;				// all pairs to analyze with, the first one is the one above
+	double		relativeSilenceSplitPoint;		// fraction of the silence
+	double		breakDownMinutes;				// 0 to keep the slices found by the analysis
+	double		breakDownTolerance;				// fraction of breakDownMinutes
+	NSString	*exportDirectory;				// nil to not export
+	NSString	*batchDirectory;				// nil to analyze the files one by one and report their slices
+	NSString	*filenameFormat;
+	int			repeat;
+	NSArray		*rescans;						// duration and volume threshold pairs to find the silences again with
+	BOOL		showProgress;
+	BOOL		streaming;						// feed the input in chunks as it is written
+	double		streamIdleSeconds;				// stop following a file that hasn't grown for this long
+} ToolOptions;
+
+// how much of a streamed input is read and analyzed at once
+#define ToolStreamChunkSize			65536
+// how often a growing file is checked for new data, in microseconds
+#define ToolStreamPollInterval		250000
+
+// state of a streamed input, the silence callback cuts and writes the slices while it is read
+typedef struct {
+	const ToolOptions	*options;
+	ASEngineSession		*session;
+	NSMutableData		*spool;				// bytes not written to a slice yet, nil if not exporting
+	uint64_t			spoolByteOffset;	// position of the spool in the stream
+	uint64_t			sliceStartByte;
+	double				sliceStartTime;
+	NSUInteger			numSlices;
+	NSUInteger			numFailedSlices;
+} ToolStream;
+
+static double wallClockSeconds(void);
+
+
+@interface ToolAnalysisObserver : NSObject {
+	AudioFile	*audioFile;
+	BOOL		finished;
+	BOOL		decodingFailed;
+	BOOL		showProgress;
+}
+
+- (id)initWithAudioFile:(AudioFile *)file showProgress:(BOOL)flag;
+- (BOOL)runAnalysisWithThresholds:(NSArray *)thresholds;
+- (BOOL)decodingFailed;
+
+@end
+
+@implementation ToolAnalysisObserver
+
+- (id)initWithAudioFile:(AudioFile *)file showProgress:(BOOL)flag
+{
+	if (self = [super init]) {
+		audioFile = [file retain];
+		showProgress = flag;
+		
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(progressDidChange:)
+													 name:AudioFileProgressChangedNotification
+												   object:audioFile];
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(analyzingDidFinish:)
+													 name:AudioFileAnalyzingFinishedNotification
+												   object:audioFile];
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(decodingDidFail:)
+													 name:AudioFileDecodingFailedNotification
+												   object:audioFile];
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[audioFile release];
+	
+	[super dealloc];
+}
+
+// the analysis runs on a thread of its own and reports back on the main run loop, so keep it running
+- (BOOL)runAnalysisWithThresholds:(NSArray *)thresholds
+{
+	finished = NO;
+	[audioFile analyzeSilencesWithThresholds:thresholds];
+	while (!finished) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+		[pool release];
+	}
+	if (showProgress) {
+		fprintf(stderr, "\n");
+	}
+	
+	return ([audioFile audioSegmentTree] != nil && !decodingFailed);
+}
+
+- (BOOL)decodingFailed
+{
+	return decodingFailed;
+}
+
+- (void)progressDidChange:(NSNotification *)notification
+{
+	if (showProgress) {
+		double range = [audioFile progressMaxValue] - [audioFile progressMinValue];
+		if (range > 0.0) {
+			fprintf(stderr, "\ranalyzing %s: %3.0f%%", [[[audioFile filePath] lastPathComponent] UTF8String],
+					100.0 * ([audioFile progressValue] - [audioFile progressMinValue]) / range);
+		}
+	}
+}
+
+- (void)analyzingDidFinish:(NSNotification *)notification
+{
+	finished = YES;
+}
+
+- (void)decodingDidFail:(NSNotification *)notification
+{
+	decodingFailed = YES;
+}
+
+@end
+
+
+@interface ToolBatchObserver : NSObject {
+	NSMutableArray		*files;
+	NSMutableDictionary	*startTimes;
+	BOOL				finished;
+	BOOL				showProgress;
+}
+
+- (id)initShowingProgress:(BOOL)flag;
+- (NSArray *)runBatchAnalyzer:(BatchAnalyzer *)analyzer;
+
+@end
+
+@implementation ToolBatchObserver
+
+- (id)initShowingProgress:(BOOL)flag
+{
+	if (self = [super init]) {
+		files = [[NSMutableArray alloc] init];
+		startTimes = [[NSMutableDictionary alloc] init];
+		showProgress = flag;
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	[files release];
+	[startTimes release];
+	
+	[super dealloc];
+}
+
+// the batch reports back on the main run loop like a single analysis, returns a result for every file it worked on
+- (NSArray *)runBatchAnalyzer:(BatchAnalyzer *)analyzer
+{
+	finished = NO;
+	[analyzer setDelegate:self];
+	[analyzer start];
+	while (!finished) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+		[pool release];
+	}
+	[analyzer setDelegate:nil];
+	
+	return files;
+}
+
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didStartFile:(NSString *)path
+{
+	[startTimes setObject:[NSNumber numberWithDouble:wallClockSeconds()] forKey:path];
+}
+
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didProgress:(double)fraction onFile:(NSString *)path
+{
+	if (showProgress) {
+		fprintf(stderr, "analyzing %s: %3.0f%%\n", [[path lastPathComponent] UTF8String], 100.0 * fraction);
+	}
+}
+
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didFinishFile:(NSString *)path archive:(NSString *)archivePath
+{
+	[files addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+						path, @"file",
+						archivePath, @"archive",
+						[NSNumber numberWithDouble:(wallClockSeconds() - [[startTimes objectForKey:path] doubleValue])], @"seconds",
+						nil]];
+}
+
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didFailFile:(NSString *)path reason:(NSString *)reason
+{
+	[files addObject:[NSDictionary dictionaryWithObjectsAndKeys:path, @"file", reason, @"error", nil]];
+}
+
+- (void)batchAnalyzerDidFinish:(BatchAnalyzer *)analyzer
+{
+	finished = YES;
+}
+
+@end
+
+
+#pragma mark -
+
+
+static double
+wallClockSeconds(void)
+{
+	struct timeval	now;
+	
+	gettimeofday(&now, NULL);
+	return now.tv_sec + (now.tv_usec / 1000000.0);
+}
+
+static void
+processorSeconds(double *user, double *system)
+{
+	struct rusage	usage;
+	
+	getrusage(RUSAGE_SELF, &usage);
+	*user = usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1000000.0);
+	*system = usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1000000.0);
+}
+
+static void
+printUsage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] file.mp3 ...\n"
+		"  -d, --silence-duration <s>    minimum duration of a silence in seconds (1.1)\n"
+		"  -v, --silence-volume <%%>      maximum volume of a silence in percent (3)\n"
+		"                                both can be given more than once to find the silences for several pairs\n"
+		"                                in one analysis, the n-th -d and -v make the n-th pair. the slices are\n"
+		"                                made with the first pair\n"
+		"  -s, --split-point <%%>         where in a silence to cut, in percent (66)\n"
+		"  -b, --break-down <min>        break slices down to about this many minutes\n"
+		"  -t, --tolerance <%%>           tolerance of the break down in percent (15)\n"
+		"  -e, --export <dir>            write the slices with their tags into dir\n"
+		"  -B, --batch <dir>             write an AudioSlicer document for every file into dir, several files at once.\n"
+		"                                the files done by an earlier run into the same dir are skipped\n"
+		"  -f, --format <format>         file name format of exported slices ([trackNumber] - [title])\n"
+		"  -r, --repeat <n>              analyze every file n times, for timing\n"
+		"  -R, --rescan <s>,<%%>          after the analysis, find the silences again with these thresholds from\n"
+		"                                the loudness envelope, without decoding. can be given more than once\n"
+		"  -k, --benchmark-kernels       time the energy kernels of this machine\n"
+		"  -j, --threads <n>             number of analysis threads, 0 for one per available processor\n"
+		"  -p, --progress                show the analysis progress on stderr\n"
+		"  -i, --input <source>          analyze files with this input source: mapped, read, uring, or all of them in turn\n"
+		"  -P, --prefetch                fault the pages of mapped files in on a thread ahead of the analysis\n"
+		"  -c, --callback-loop           decode through the callbacks of mad_decoder_run instead of the inlined decode loop\n"
+		"  -S, --side-info-prescan       don't decode the frames the layer III side info shows to be loud\n"
+		"  -g, --resolution <r>          look at the volume per frame, granule or block of 32 samples (frame)\n"
+		"  -l, --live <s>                stream the file while it is written, until it hasn't grown for s seconds.\n"
+		"                                a file named - is read from stdin. silences and slices are printed as\n"
+		"                                JSON lines as soon as they are found, exported slices are written right away\n",
+		name);
+}
+
+static NSDictionary *
+benchmarkKernels(void)
+{
+	NSMutableDictionary *results = [NSMutableDictionary dictionary];
+	
+	for (int kernel = 0; kernel < MADEnergyKernelCount; kernel++) {
+		if (MADEnergyKernelAvailable(kernel)) {
+			[results setObject:[NSNumber numberWithDouble:MADEnergyBenchmark(kernel, 20000)]
+						forKey:[NSString stringWithUTF8String:MADEnergyKernelName(kernel)]];
+		}
+	}
+	
+	return results;
+}
+
+static NSDictionary *
+processFile(NSString *path, const ToolOptions *options)
+{
+	NSMutableDictionary	*result = [NSMutableDictionary dictionaryWithObject:path forKey:@"file"];
+	NSMutableDictionary	*timings = [NSMutableDictionary dictionary];
+	AudioFile			*audioFile = nil;
+	double				startTime = wallClockSeconds();
+	double				time, userStart, systemStart, user, system;
+	
+	[result setObject:timings forKey:@"timings"];
+	processorSeconds(&userStart, &systemStart);
+	
+	// opening walks all frame headers of the file
+	@try {
+		audioFile = [AudioFile audioFileWithPath:path];
+	} @catch (NSException *exception) {
+		[result setObject:[exception reason] forKey:@"error"];
+		return result;
+	}
+	if ([audioFile progressMaxValue] <= [audioFile progressMinValue]) {
+		[result setObject:@"the file could not be opened" forKey:@"error"];
+		return result;
+	}
+	[timings setObject:[NSNumber numberWithDouble:(wallClockSeconds() - startTime)] forKey:@"open"];
+	[result setObject:[NSNumber numberWithDouble:[audioFile progressMaxValue]] forKey:@"bytes"];
+	if ([audioFile isKindOfClass:[AudioFileMP3 class]]) {
+		// the one actually used, a source that isn't available falls back to the mapped one
+		[result setObject:[NSString stringWithUTF8String:MP3InputSourceTypeName([(AudioFileMP3 *)audioFile inputSourceType])] forKey:@"inputSource"];
+		
+		// what was known right after opening, before the analysis built the frame index
+		const MP3VBRHeader *vbrHeader = [(AudioFileMP3 *)audioFile vbrHeader];
+		if (vbrHeader != NULL) {
+			[result setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+								(vbrHeader->type == MP3VBRHeaderVBRI ? @"VBRI" : @"Xing"), @"type",
+								[NSNumber numberWithUnsignedInt:vbrHeader->numFrames], @"frames",
+								[NSNumber numberWithDouble:MP3VBRHeaderDuration(vbrHeader)], @"duration",
+								[NSNumber numberWithUnsignedInt:vbrHeader->encoderDelay], @"encoderDelay",
+								[NSNumber numberWithUnsignedInt:vbrHeader->encoderPadding], @"encoderPadding",
+								nil] forKey:@"vbrHeader"];
+		}
+	}
+	
+	ToolAnalysisObserver *observer = [[[ToolAnalysisObserver alloc] initWithAudioFile:audioFile showProgress:options->showProgress] autorelease];
+	NSMutableArray *analyzeTimes = [NSMutableArray array];
+	for (int i = 0; i < options->repeat; i++) {
+		time = wallClockSeconds();
+		if (![observer runAnalysisWithThresholds:options->silenceThresholds]) {
+			[result setObject:([observer decodingFailed] ? @"too many decoding errors" : @"the file could not be analyzed") forKey:@"error"];
+			return result;
+		}
+		[analyzeTimes addObject:[NSNumber numberWithDouble:(wallClockSeconds() - time)]];
+	}
+	[timings setObject:analyzeTimes forKey:@"analyze"];
+	
+	if ([options->silenceThresholds count] > 1) {
+		NSMutableArray	*silenceListResults = [NSMutableArray array];
+		NSArray			*silenceLists = [audioFile silenceLists];
+		for (NSUInteger i = 0; i < [silenceLists count]; i++) {
+			NSMutableDictionary *silenceListResult = [[[options->silenceThresholds objectAtIndex:i] mutableCopy] autorelease];
+			[silenceListResult setObject:[silenceLists objectAtIndex:i] forKey:@"silences"];
+			[silenceListResults addObject:silenceListResult];
+		}
+		[result setObject:silenceListResults forKey:@"silenceLists"];
+	}
+	
+	AudioSegmentTree *tree = [audioFile audioSegmentTree];
+	double duration = [tree duration];
+	double fastestAnalysis = [[analyzeTimes valueForKeyPath:@"@min.doubleValue"] doubleValue];
+	[result setObject:[NSNumber numberWithDouble:duration] forKey:@"duration"];
+	[result setObject:[NSNumber numberWithInteger:[tree numberOfSlices]] forKey:@"slicesFound"];
+	NSUInteger frames = [audioFile isKindOfClass:[AudioFileMP3 class]] ? [(AudioFileMP3 *)audioFile numberOfFrames] : 0;
+	if (frames > 0) {
+		[result setObject:[NSNumber numberWithUnsignedInteger:frames] forKey:@"frames"];
+	}
+	if (fastestAnalysis > 0.0) {
+		[result setObject:[NSNumber numberWithDouble:([audioFile progressMaxValue] / (1024.0 * 1024.0)) / fastestAnalysis] forKey:@"analyzeMegabytesPerSecond"];
+		[result setObject:[NSNumber numberWithDouble:duration / fastestAnalysis] forKey:@"analyzeRealtimeFactor"];
+		if (frames > 0) {
+			[result setObject:[NSNumber numberWithDouble:frames / fastestAnalysis] forKey:@"analyzeFramesPerSecond"];
+		}
+	}
+	
+	// split rules work on a copy of the slice list, breaking down a slice adds new ones to the tree
+	time = wallClockSeconds();
+	if (options->breakDownMinutes > 0.0) {
+		NSMutableArray *slices = [NSMutableArray array];
+		for (NSInteger i = 0; i < [tree numberOfSlices]; i++) {
+			[slices addObject:[tree sliceAtIndex:i]];
+		}
+		NSEnumerator *enumerator = [slices objectEnumerator];
+		AudioSlice *slice;
+		while (slice = [enumerator nextObject]) {
+			[slice breakDownToAverageDuration:(options->breakDownMinutes * 60.0) tolerance:options->breakDownTolerance];
+		}
+	}
+	[timings setObject:[NSNumber numberWithDouble:(wallClockSeconds() - time)] forKey:@"split"];
+	
+	NSMutableArray *sliceResults = [NSMutableArray array];
+	time = wallClockSeconds();
+	for (NSInteger i = 0; i < [tree numberOfSlices]; i++) {
+		AudioSlice			*slice = [tree sliceAtIndex:i];
+		NSMutableDictionary	*sliceResult = [NSMutableDictionary dictionary];
+		double				start = 0.0;
+		double				end = AudioFileEndTime;
+		
+		[slice getSplitStartTime:&start endTime:&end relativeSilenceSplitPoint:options->relativeSilenceSplitPoint];
+		[sliceResult setObject:[NSNumber numberWithDouble:start] forKey:@"start"];
+		[sliceResult setObject:[NSNumber numberWithDouble:MIN(end, duration)] forKey:@"end"];
+		if ([slice title] != nil) {
+			[sliceResult setObject:[slice title] forKey:@"title"];
+		}
+		
+		if (options->exportDirectory != nil) {
+			NSString	*filename = [slice filenameUsingFormat:options->filenameFormat extension:[audioFile fileExtension]];
+			NSString	*slicePath = [options->exportDirectory stringByAppendingPathComponent:filename];
+			double		sliceTime = wallClockSeconds();
+			
+			if (![audioFile writeToFile:slicePath from:start to:end] || ![AudioFile writeTags:[slice tagsFromAttributes] toFile:slicePath]) {
+				[sliceResult setObject:@"the slice could not be written" forKey:@"error"];
+			}
+			[sliceResult setObject:slicePath forKey:@"path"];
+			[sliceResult setObject:[NSNumber numberWithDouble:(wallClockSeconds() - sliceTime)] forKey:@"exportSeconds"];
+		}
+		[sliceResults addObject:sliceResult];
+	}
+	if (options->exportDirectory != nil) {
+		[timings setObject:[NSNumber numberWithDouble:(wallClockSeconds() - time)] forKey:@"export"];
+	}
+	[result setObject:sliceResults forKey:@"slices"];
+	
+	// this replaces the slices of the audio file, the ones above are done with
+	if ([options->rescans count] > 0) {
+		NSMutableArray	*rescanResults = [NSMutableArray array];
+		NSEnumerator	*enumerator = [options->rescans objectEnumerator];
+		NSArray			*pair;
+		while (pair = [enumerator nextObject]) {
+			double				rescanDuration = [[pair objectAtIndex:0] doubleValue];
+			double				rescanVolume = [[pair objectAtIndex:1] doubleValue];
+			NSMutableDictionary	*rescanResult = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+													[NSNumber numberWithDouble:rescanDuration], @"silenceDuration",
+													[NSNumber numberWithDouble:rescanVolume], @"silenceVolume",
+													nil];
+			
+			time = wallClockSeconds();
+			if ([audioFile rescanSilencesLongerThan:rescanDuration quieterThan:rescanVolume]) {
+				[rescanResult setObject:[NSNumber numberWithDouble:(wallClockSeconds() - time)] forKey:@"seconds"];
+				[rescanResult setObject:[NSNumber numberWithInteger:[[audioFile audioSegmentTree] numberOfSlices]] forKey:@"slicesFound"];
+			} else {
+				[rescanResult setObject:@"the loudness envelope can't be scanned with these thresholds" forKey:@"error"];
+			}
+			[rescanResults addObject:rescanResult];
+		}
+		[result setObject:rescanResults forKey:@"rescans"];
+	}
+	
+	processorSeconds(&user, &system);
+	[timings setObject:[NSNumber numberWithDouble:(wallClockSeconds() - startTime)] forKey:@"total"];
+	[timings setObject:[NSNumber numberWithDouble:(user - userStart)] forKey:@"user"];
+	[timings setObject:[NSNumber numberWithDouble:(system - systemStart)] forKey:@"system"];
+	
+	return result;
+}
+
+static void
+printEvent(NSDictionary *event)
+{
+	NSData *json = [NSJSONSerialization dataWithJSONObject:event options:0 error:NULL];
+	fwrite([json bytes], 1, [json length], stdout);
+	fputc('\n', stdout);
+	fflush(stdout);
+}
+
+// the stream is complete up to endByte, everything before it is the next slice
+static void
+finishStreamSlice(ToolStream *stream, double endTime, uint64_t endByte)
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	NSMutableDictionary	*event = [NSMutableDictionary dictionaryWithObject:@"slice" forKey:@"event"];
+	
+	[event setObject:[NSNumber numberWithUnsignedInteger:(stream->numSlices + 1)] forKey:@"number"];
+	[event setObject:[NSNumber numberWithDouble:stream->sliceStartTime] forKey:@"start"];
+	[event setObject:[NSNumber numberWithDouble:endTime] forKey:@"end"];
+	[event setObject:[NSNumber numberWithUnsignedLongLong:stream->sliceStartByte] forKey:@"startByte"];
+	[event setObject:[NSNumber numberWithUnsignedLongLong:endByte] forKey:@"endByte"];
+	
+	if (stream->spool != nil) {
+		NSString	*filename = [NSString stringWithFormat:@"%03lu.mp3", (unsigned long)(stream->numSlices + 1)];
+		NSString	*slicePath = [stream->options->exportDirectory stringByAppendingPathComponent:filename];
+		NSRange		range = NSMakeRange((NSUInteger)(stream->sliceStartByte - stream->spoolByteOffset), (NSUInteger)(endByte - stream->sliceStartByte));
+		
+		if (![[stream->spool subdataWithRange:range] writeToFile:slicePath atomically:YES]) {
+			[event setObject:@"the slice could not be written" forKey:@"error"];
+			stream->numFailedSlices++;
+		}
+		[event setObject:slicePath forKey:@"path"];
+		
+		// the slice isn't needed anymore, this keeps the spool as short as one slice
+		[stream->spool replaceBytesInRange:NSMakeRange(0, (NSUInteger)(endByte - stream->spoolByteOffset)) withBytes:NULL length:0];
+		stream->spoolByteOffset = endByte;
+	}
+	
+	stream->numSlices++;
+	stream->sliceStartByte = endByte;
+	stream->sliceStartTime = endTime;
+	printEvent(event);
+	
+	[pool release];
+}
+
+static void
+streamFoundSilence(void *context, double start, double end, double quietest)
+{
+	ToolStream	*stream = (ToolStream *)context;
+	
+	printEvent([NSDictionary dictionaryWithObjectsAndKeys:
+				@"silence", @"event",
+				[NSNumber numberWithDouble:start], @"start",
+				[NSNumber numberWithDouble:end], @"end",
+				nil]);
+	if (start <= 0.0) {
+		// nothing before it to cut off
+		return;
+	}
+	
+	// cut like -[AudioSlice getSplitStartTime:endTime:relativeSilenceSplitPoint:], at the frame playing then
+	double cutTime = (quietest >= 0.0) ? quietest : (start + (end - start) * stream->options->relativeSilenceSplitPoint);
+	ASEngineFrame frame;
+	ASEngineSessionFrameAtIndex(stream->session, ASEngineSessionFrameIndexForTime(stream->session, cutTime), &frame);
+	finishStreamSlice(stream, cutTime, frame.byteOffset);
+}
+
+static NSDictionary *
+processStream(NSString *path, const ToolOptions *options)
+{
+	NSMutableDictionary	*result = [NSMutableDictionary dictionaryWithObject:path forKey:@"file"];
+	BOOL				fromStdin = [path isEqualToString:@"-"];
+	double				startTime = wallClockSeconds();
+	double				lastGrowthTime = startTime;
+	double				lastProgressTime = startTime;
+	double				userStart, systemStart, user, system;
+	uint64_t			bytesRead = 0;
+	ToolStream			stream;
+	ASEngineSettings	settings;
+	ASEngineResult		status = ASEngineResultOK;
+	uint8_t				*buffer;
+	int					fd;
+	
+	processorSeconds(&userStart, &systemStart);
+	
+	fd = fromStdin ? STDIN_FILENO : open([path fileSystemRepresentation], O_RDONLY);
+	if (fd < 0) {
+		[result setObject:[NSString stringWithUTF8String:strerror(errno)] forKey:@"error"];
+		return result;
+	}
+	
+	ASEngineSettingsInitDefault(&settings);
+	settings.silenceDurationThreshold = options->silenceDurationThreshold;
+	settings.silenceVolumeThreshold = (long)(options->silenceVolumeThreshold * SAMPLE_MAX_VALUE);
+	settings.relativeSilenceSplitPoint = options->relativeSilenceSplitPoint;
+	switch ([MADDecoder silenceResolutionForName:[[NSUserDefaults standardUserDefaults] stringForKey:MADDecoderSilenceResolutionKey] fallback:MADSilenceResolutionFrame]) {
+		case MADSilenceResolutionGranule:	settings.silenceResolution = ASEngineSilenceResolutionGranule; break;
+		case MADSilenceResolutionBlock:		settings.silenceResolution = ASEngineSilenceResolutionBlock; break;
+		default:							settings.silenceResolution = ASEngineSilenceResolutionFrame; break;
+	}
+	
+	memset(&stream, 0, sizeof(stream));
+	stream.options = options;
+	stream.spool = (options->exportDirectory != nil) ? [NSMutableData data] : nil;
+	stream.session = ASEngineSessionCreate(&settings, streamFoundSilence, &stream);
+	buffer = (uint8_t *) malloc(ToolStreamChunkSize);
+	if (stream.session == NULL || buffer == NULL) {
+		status = ASEngineResultOutOfMemory;
+	}
+	
+	while (status == ASEngineResultOK) {
+		ssize_t length = read(fd, buffer, ToolStreamChunkSize);
+		
+		if (length > 0) {
+			NSAutoreleasePool *chunkPool = [[NSAutoreleasePool alloc] init];
+			// the spool has to hold the bytes before the callback cuts a slice out of them
+			[stream.spool appendBytes:buffer length:length];
+			bytesRead += length;
+			lastGrowthTime = wallClockSeconds();
+			status = ASEngineSessionFeed(stream.session, buffer, length);
+			
+			if (options->showProgress && lastGrowthTime - lastProgressTime >= 1.0) {
+				printEvent([NSDictionary dictionaryWithObjectsAndKeys:
+							@"progress", @"event",
+							[NSNumber numberWithUnsignedLongLong:bytesRead], @"bytes",
+							[NSNumber numberWithUnsignedLong:(unsigned long)ASEngineSessionNumberOfFrames(stream.session)], @"frames",
+							[NSNumber numberWithDouble:ASEngineSessionDuration(stream.session)], @"duration",
+							nil]);
+				lastProgressTime = lastGrowthTime;
+			}
+			[chunkPool release];
+		} else if (length < 0 && errno != EINTR) {
+			[result setObject:[NSString stringWithUTF8String:strerror(errno)] forKey:@"error"];
+			break;
+		} else if (length == 0) {
+			// end of the data written so far, a pipe is done but a file may still grow
+			if (fromStdin || wallClockSeconds() - lastGrowthTime >= options->streamIdleSeconds) {
+				status = ASEngineSessionFinish(stream.session);
+				break;
+			}
+			usleep(ToolStreamPollInterval);
+		}
+	}
+	
+	if (status == ASEngineResultOK && [result objectForKey:@"error"] == nil) {
+		// the rest after the last silence
+		size_t numFrames = ASEngineSessionNumberOfFrames(stream.session);
+		if (numFrames > 0) {
+			ASEngineFrame lastFrame;
+			ASEngineSessionFrameAtIndex(stream.session, numFrames - 1, &lastFrame);
+			finishStreamSlice(&stream, ASEngineSessionDuration(stream.session), lastFrame.byteOffset + lastFrame.length);
+		}
+	} else if (status == ASEngineResultTooManyErrors) {
+		[result setObject:@"too many decoding errors" forKey:@"error"];
+	} else if (status == ASEngineResultDecodeFailed) {
+		[result setObject:@"the stream could not be decoded" forKey:@"error"];
+	} else if (status != ASEngineResultOK) {
+		[result setObject:@"the stream could not be analyzed" forKey:@"error"];
+	}
+	if (stream.numFailedSlices > 0 && [result objectForKey:@"error"] == nil) {
+		[result setObject:@"not all slices could be written" forKey:@"error"];
+	}
+	
+	[result setObject:[NSNumber numberWithUnsignedLongLong:bytesRead] forKey:@"bytes"];
+	if (stream.session != NULL) {
+		[result setObject:[NSNumber numberWithDouble:ASEngineSessionDuration(stream.session)] forKey:@"duration"];
+		[result setObject:[NSNumber numberWithUnsignedLong:(unsigned long)ASEngineSessionNumberOfFrames(stream.session)] forKey:@"frames"];
+		[result setObject:[NSNumber numberWithUnsignedLong:ASEngineSessionBadFrameCount(stream.session)] forKey:@"badFrames"];
+	}
+	[result setObject:[NSNumber numberWithUnsignedInteger:stream.numSlices] forKey:@"slicesFound"];
+	
+	processorSeconds(&user, &system);
+	[result setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+						[NSNumber numberWithDouble:(wallClockSeconds() - startTime)], @"total",
+						[NSNumber numberWithDouble:(user - userStart)], @"user",
+						[NSNumber numberWithDouble:(system - systemStart)], @"system",
+						nil] forKey:@"timings"];
+	
+	ASEngineSessionDestroy(stream.session);
+	free(buffer);
+	if (!fromStdin) {
+		close(fd);
+	}
+	
+	return result;
+}
+
+int
+main(int argc, char *argv[])
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	NSMutableArray		*durations = [NSMutableArray array];
+	NSMutableArray		*volumes = [NSMutableArray array];
+	NSMutableArray		*silenceThresholds = [NSMutableArray array];
+	NSMutableArray		*rescans = [NSMutableArray array];
+	ToolOptions			options = { 1.1, 0.03, silenceThresholds, 0.66, 0.0, 0.15, nil, nil, @"[trackNumber] - [title]", 1, rescans, NO, NO, 0.0 };
+	BOOL				runKernelBenchmark = NO;
+	BOOL				streamed = NO;
+	NSMutableArray		*inputSources = [NSMutableArray array];
+	int					failures = 0;
+	int					c;
+	
+	static struct option longOptions[] = {
+		{ "silence-duration",	required_argument,	NULL, 'd' },
+		{ "silence-volume",		required_argument,	NULL, 'v' },
+		{ "split-point",		required_argument,	NULL, 's' },
+		{ "break-down",			required_argument,	NULL, 'b' },
+		{ "tolerance",			required_argument,	NULL, 't' },
+		{ "export",				required_argument,	NULL, 'e' },
+		{ "batch",				required_argument,	NULL, 'B' },
+		{ "format",				required_argument,	NULL, 'f' },
+		{ "repeat",				required_argument,	NULL, 'r' },
+		{ "rescan",				required_argument,	NULL, 'R' },
+		{ "benchmark-kernels",	no_argument,		NULL, 'k' },
+		{ "threads",			required_argument,	NULL, 'j' },
+		{ "progress",			no_argument,		NULL, 'p' },
+		{ "live",				required_argument,	NULL, 'l' },
+		{ "input",				required_argument,	NULL, 'i' },
+		{ "prefetch",			no_argument,		NULL, 'P' },
+		{ "callback-loop",		no_argument,		NULL, 'c' },
+		{ "side-info-prescan",	no_argument,		NULL, 'S' },
+		{ "resolution",			required_argument,	NULL, 'g' },
+		{ "help",				no_argument,		NULL, 'h' },
+		{ NULL,					0,					NULL, 0 }
+	};
+	
+	while ((c = getopt_long(argc, argv, "d:v:s:b:t:e:B:f:r:R:j:l:i:g:kPcSph", longOptions, NULL)) != -1) {
+		switch (c) {
+			case 'd': [durations addObject:[NSNumber numberWithDouble:atof(optarg)]]; break;
+			case 'v': [volumes addObject:[NSNumber numberWithDouble:(atof(optarg) / 100.0)]]; break;
+			case 's': options.relativeSilenceSplitPoint = atof(optarg) / 100.0; break;
+			case 'b': options.breakDownMinutes = atof(optarg); break;
+			case 't': options.breakDownTolerance = atof(optarg) / 100.0; break;
+			case 'e': options.exportDirectory = [[NSString stringWithUTF8String:optarg] stringByStandardizingPath]; break;
+			case 'B': options.batchDirectory = [[NSString stringWithUTF8String:optarg] stringByStandardizingPath]; break;
+			case 'f': options.filenameFormat = [NSString stringWithUTF8String:optarg]; break;
+			case 'r': options.repeat = MAX(atoi(optarg), 1); break;
+			case 'R': {
+				double rescanDuration, rescanVolume;
+				if (sscanf(optarg, "%lf,%lf", &rescanDuration, &rescanVolume) != 2) {
+					printUsage(argv[0]);
+					[pool release];
+					return 2;
+				}
+				[rescans addObject:[NSArray arrayWithObjects:[NSNumber numberWithDouble:rescanDuration],
+									[NSNumber numberWithDouble:(rescanVolume / 100.0)], nil]];
+				break;
+			}
+			case 'k': runKernelBenchmark = YES; break;
+			case 'j':
+				// the shared pool reads this when it is created, the registration domain isn't saved
+				[[NSUserDefaults standardUserDefaults] registerDefaults:[NSDictionary dictionaryWithObject:[NSNumber numberWithInt:atoi(optarg)]
+																									forKey:MADWorkStealingPoolThreadCountKey]];
+				break;
+			case 'p': options.showProgress = YES; break;
+			case 'l':
+				options.streaming = YES;
+				options.streamIdleSeconds = atof(optarg);
+				break;
+			case 'P':
+				[[NSUserDefaults standardUserDefaults] registerDefaults:[NSDictionary dictionaryWithObject:[NSNumber numberWithBool:YES]
+																									forKey:MADDecoderThreadedPrefetchKey]];
+				break;
+			case 'c': [MADDecoderProcessor setUsesCallbackDecodeLoop:YES]; break;
+			case 'S':
+				[[NSUserDefaults standardUserDefaults] registerDefaults:[NSDictionary dictionaryWithObject:[NSNumber numberWithBool:YES]
+																									forKey:MADDecoderSideInfoPrescanKey]];
+				break;
+			case 'g': {
+				NSString *name = [NSString stringWithUTF8String:optarg];
+				if ([MADDecoder silenceResolutionForName:name fallback:(MADSilenceResolution)-1] == (MADSilenceResolution)-1) {
+					printUsage(argv[0]);
+					[pool release];
+					return 2;
+				}
+				[[NSUserDefaults standardUserDefaults] registerDefaults:[NSDictionary dictionaryWithObject:name forKey:MADDecoderSilenceResolutionKey]];
+				break;
+			}
+			case 'i':
+				if (strcmp(optarg, "all") == 0) {
+					for (int type = 0; type < MP3InputSourceTypeCount; type++) {
+						if (MP3InputSourceTypeAvailable(type)) {
+							[inputSources addObject:[NSString stringWithUTF8String:MP3InputSourceTypeName(type)]];
+						}
+					}
+				} else {
+					[inputSources addObject:[NSString stringWithUTF8String:optarg]];
+				}
+				break;
+			default:
+				printUsage(argv[0]);
+				[pool release];
+				return (c == 'h') ? 0 : 2;
+		}
+	}
+	if (optind >= argc && !runKernelBenchmark) {
+		printUsage(argv[0]);
+		[pool release];
+		return 2;
+	}
+	
+	// the shorter of the two lists repeats its last value, an empty one the default
+	for (NSUInteger i = 0; i < MAX(MAX([durations count], [volumes count]), 1); i++) {
+		if ([durations count] > 0) {
+			options.silenceDurationThreshold = [[durations objectAtIndex:MIN(i, [durations count] - 1)] doubleValue];
+		}
+		if ([volumes count] > 0) {
+			options.silenceVolumeThreshold = [[volumes objectAtIndex:MIN(i, [volumes count] - 1)] doubleValue];
+		}
+		[silenceThresholds addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+										[NSNumber numberWithDouble:options.silenceDurationThreshold], AudioFileSilenceDurationKey,
+										[NSNumber numberWithDouble:options.silenceVolumeThreshold], AudioFileSilenceVolumeKey,
+										nil]];
+	}
+	// the streamed analysis and the summary go by the first pair
+	options.silenceDurationThreshold = [[[silenceThresholds objectAtIndex:0] objectForKey:AudioFileSilenceDurationKey] doubleValue];
+	options.silenceVolumeThreshold = [[[silenceThresholds objectAtIndex:0] objectForKey:AudioFileSilenceVolumeKey] doubleValue];
+	
+	if (options.exportDirectory != nil && ![[NSFileManager defaultManager] fileExistsAtPath:options.exportDirectory]) {
+		[[NSFileManager defaultManager] createDirectoryAtPath:options.exportDirectory attributes:nil];
+	}
+	
+	NSMutableDictionary *output = [NSMutableDictionary dictionary];
+	[output setObject:[NSNumber numberWithUnsignedInteger:[[MADWorkStealingPool sharedPool] numberOfWorkers]] forKey:@"threads"];
+	[output setObject:[NSString stringWithUTF8String:MADEnergyKernelName(MADEnergyBestKernel())] forKey:@"energyKernel"];
+	[output setObject:([MADDecoderProcessor usesCallbackDecodeLoop] ? @"callbacks" : @"inline") forKey:@"decodeLoop"];
+	[output setObject:[NSNumber numberWithBool:[[NSUserDefaults standardUserDefaults] boolForKey:MADDecoderSideInfoPrescanKey]] forKey:@"sideInfoPrescan"];
+	[output setObject:[MADDecoder nameOfSilenceResolution:[MADDecoder silenceResolutionForName:[[NSUserDefaults standardUserDefaults] stringForKey:MADDecoderSilenceResolutionKey]
+																					  fallback:MADSilenceResolutionFrame]] forKey:@"silenceResolution"];
+	[output setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+						[NSNumber numberWithDouble:options.silenceDurationThreshold], @"silenceDuration",
+						[NSNumber numberWithDouble:options.silenceVolumeThreshold], @"silenceVolume",
+						nil] forKey:@"thresholds"];
+	if ([silenceThresholds count] > 1) {
+		[output setObject:silenceThresholds forKey:@"thresholdPairs"];
+	}
+	if (runKernelBenchmark) {
+		[output setObject:benchmarkKernels() forKey:@"kernelNanosecondsPerFrame"];
+	}
+	
+	NSMutableArray *files = [NSMutableArray array];
+	if (options.batchDirectory != nil) {
+		NSMutableArray *paths = [NSMutableArray array];
+		for (int i = optind; i < argc; i++) {
+			[paths addObject:[[NSString stringWithUTF8String:argv[i]] stringByStandardizingPath]];
+		}
+		
+		BatchAnalyzer *analyzer = [[[BatchAnalyzer alloc] initWithFiles:paths outputDirectory:options.batchDirectory] autorelease];
+		[analyzer setSilenceDurationThreshold:options.silenceDurationThreshold volumeThreshold:options.silenceVolumeThreshold];
+		
+		double batchStartTime = wallClockSeconds();
+		ToolBatchObserver *observer = [[[ToolBatchObserver alloc] initShowingProgress:options.showProgress] autorelease];
+		[files addObjectsFromArray:[observer runBatchAnalyzer:analyzer]];
+		failures += (int)[analyzer numberOfFailedFiles];
+		
+		[output setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+							options.batchDirectory, @"directory",
+							[NSNumber numberWithUnsignedInteger:[analyzer maximumOpenFiles]], @"maximumOpenFiles",
+							[NSNumber numberWithUnsignedInteger:[analyzer numberOfFinishedFiles]], @"finished",
+							[NSNumber numberWithUnsignedInteger:[analyzer numberOfFailedFiles]], @"failed",
+							[NSNumber numberWithUnsignedInteger:([paths count] - [analyzer numberOfFinishedFiles] - [analyzer numberOfFailedFiles])], @"skipped",
+							[NSNumber numberWithDouble:(wallClockSeconds() - batchStartTime)], @"seconds",
+							nil] forKey:@"batch"];
+	}
+	for (int i = optind; i < argc && options.batchDirectory == nil; i++) {
+		NSAutoreleasePool	*filePool = [[NSAutoreleasePool alloc] init];
+		NSString			*path = [NSString stringWithUTF8String:argv[i]];
+		NSDictionary		*result;
+		if (options.streaming || [path isEqualToString:@"-"]) {
+			streamed = YES;
+			result = processStream(([path isEqualToString:@"-"] ? path : [path stringByStandardizingPath]), &options);
+			if ([result objectForKey:@"error"] != nil) {
+				failures++;
+			}
+			[files addObject:result];
+		} else {
+			// every input source in turn, to compare them on the same file
+			NSArray *sources = ([inputSources count] > 0) ? inputSources : [NSArray arrayWithObject:[NSNull null]];
+			NSEnumerator *enumerator = [sources objectEnumerator];
+			id source;
+			while (source = [enumerator nextObject]) {
+				if (source != [NSNull null]) {
+					[[NSUserDefaults standardUserDefaults] registerDefaults:[NSDictionary dictionaryWithObject:source forKey:AudioFileMP3InputSourceKey]];
+				}
+				result = processFile([path stringByStandardizingPath], &options);
+				if ([result objectForKey:@"error"] != nil) {
+					failures++;
+				}
+				[files addObject:result];
+			}
+		}
+		[filePool release];
+	}
+	[output setObject:files forKey:@"files"];
+	
+	// after streamed events the summary is one more JSON line
+	NSData *json = [NSJSONSerialization dataWithJSONObject:output options:(streamed ? 0 : NSJSONWritingPrettyPrinted) error:NULL];
+	fwrite([json bytes], 1, [json length], stdout);
+	fputc('\n', stdout);
+	
+	[pool release];
+	
+	return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+//
+//  BatchAnalyzer.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import <Foundation/Foundation.h>
+
+#import "AudioFile.h"
+
+// name of the file in the output directory that remembers which files are done, so that an
+// interrupted batch picks up where it left off when it is started again with the same directory
+#define BatchAnalyzerStateFileName		@"BatchAnalysis.plist"
+
+// analyzes many audio files and writes a document for each of them into one directory. several files
+// are analyzed at the same time, but never more than maximumOpenFiles, each of them keeps its file
+// mapped while it is analyzed. the decoding itself runs as background work on the shared analysis pool,
+// whose size caps the decode threads of the whole process. the delegate is informed on the main thread.
+@interface BatchAnalyzer : NSObject {
+	NSArray				*filePaths;
+	NSString			*outputDirectory;
+	NSMutableDictionary	*state;				// file path -> dictionary with status, archive path and file ID
+	NSMutableDictionary	*archivePaths;		// file path -> document path
+	
+	double				silenceDurationThreshold;
+	double				silenceVolumeThreshold;
+	double				playSilenceIntervalBefore;
+	double				playSilenceIntervalAfter;
+	NSUInteger			maximumOpenFiles;
+	
+	NSLock				*lock;
+	NSUInteger			nextFileIndex;
+	NSUInteger			numRunningThreads;
+	NSMutableArray		*activeAudioFiles;
+	NSUInteger			numFinishedFiles;
+	NSUInteger			numFailedFiles;
+	BOOL				cancelled;
+	
+	// our delegate (not retained)
+	id					delegate;
+}
+
+- (id)initWithFiles:(NSArray *)paths outputDirectory:(NSString *)directory;
+
+- (void)setDelegate:(id)obj;
+- (id)delegate;
+
+// the analysis settings, they default to the ones in the preferences
+- (void)setSilenceDurationThreshold:(double)time volumeThreshold:(double)volume;
+- (void)setMaximumOpenFiles:(NSUInteger)count;
+- (NSUInteger)maximumOpenFiles;
+
+- (NSArray *)filePaths;
+- (NSString *)archivePathForFile:(NSString *)path;
+- (BOOL)isFileDone:(NSString *)path;
+- (NSUInteger)numberOfFinishedFiles;
+- (NSUInteger)numberOfFailedFiles;
+
+// files that are already done from an earlier run are skipped
+- (void)start;
+- (void)cancel;
+- (BOOL)isRunning;
+
+@end
+
+
+@interface NSObject (BatchAnalyzerDelegate)
+
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didStartFile:(NSString *)path;
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didProgress:(double)fraction onFile:(NSString *)path;
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didFinishFile:(NSString *)path archive:(NSString *)archivePath;
+- (void)batchAnalyzer:(BatchAnalyzer *)analyzer didFailFile:(NSString *)path reason:(NSString *)reason;
+- (void)batchAnalyzerDidFinish:(BatchAnalyzer *)analyzer;
+
+@end
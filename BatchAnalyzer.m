@@ -0,0 +1,432 @@
+//
+//  BatchAnalyzer.m
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import "BatchAnalyzer.h"
+#import "SplitDocumentArchive.h"
+#import "MADWorkStealingPool.h"
+
+
+@interface BatchAnalyzer (Private)
+- (NSString *)statePath;
+- (void)assignArchivePaths;
+- (NSString *)takeNextFile;
+- (void)runnerThread:(id)obj;
+- (void)analyzeFile:(NSString *)path;
+- (void)recordFile:(NSString *)path status:(NSString *)status reason:(NSString *)reason;
+- (void)notifyDelegate:(NSDictionary *)event;
+- (void)audioFileProgressDidChange:(NSNotification *)notification;
+@end
+
+@implementation BatchAnalyzer
+
+- (id)initWithFiles:(NSArray *)paths outputDirectory:(NSString *)directory
+{
+	if (self = [super init]) {
+		NSUserDefaults  *defaults = [NSUserDefaults standardUserDefaults];
+		
+		filePaths = [paths copy];
+		outputDirectory = [directory copy];
+		
+		silenceDurationThreshold = [[defaults objectForKey:@"SilenceDurationThreshold"] doubleValue];
+		silenceVolumeThreshold = [[defaults objectForKey:@"SilenceVolumeThreshold"] doubleValue] / 100.0;
+		playSilenceIntervalBefore = [[defaults objectForKey:@"PlayBeforeSilenceDuration"] doubleValue];
+		playSilenceIntervalAfter = [[defaults objectForKey:@"PlayAfterSilenceDuration"] doubleValue];
+		maximumOpenFiles = [[MADWorkStealingPool sharedPool] numberOfWorkers];
+		
+		// pick up the state of an earlier run into the same directory
+		state = [[NSMutableDictionary alloc] initWithContentsOfFile:[self statePath]];
+		if (state == nil) {
+			state = [[NSMutableDictionary alloc] init];
+		}
+		archivePaths = [[NSMutableDictionary alloc] init];
+		[self assignArchivePaths];
+		
+		lock = [[NSLock alloc] init];
+		activeAudioFiles = [[NSMutableArray alloc] init];
+		numRunningThreads = 0;
+		delegate = nil;
+		
+		// the progress of the files being analyzed comes in on the main thread
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(audioFileProgressDidChange:)
+													 name:AudioFileProgressChangedNotification
+												   object:nil];
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	
+	[filePaths release];
+	[outputDirectory release];
+	[state release];
+	[archivePaths release];
+	[lock release];
+	[activeAudioFiles release];
+	
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (void)setDelegate:(id)obj
+{
+	delegate = obj;
+}
+
+- (id)delegate
+{
+	return delegate;
+}
+
+- (void)setSilenceDurationThreshold:(double)time volumeThreshold:(double)volume
+{
+	silenceDurationThreshold = time;
+	silenceVolumeThreshold = volume;
+}
+
+- (void)setMaximumOpenFiles:(NSUInteger)count
+{
+	maximumOpenFiles = MAX(count, 1);
+}
+
+- (NSUInteger)maximumOpenFiles
+{
+	return maximumOpenFiles;
+}
+
+- (NSArray *)filePaths
+{
+	return filePaths;
+}
+
+- (NSString *)archivePathForFile:(NSString *)path
+{
+	return [archivePaths objectForKey:path];
+}
+
+- (BOOL)isFileDone:(NSString *)path
+{
+	NSDictionary	*entry = [state objectForKey:path];
+	
+	// a file that was changed since it was analyzed has to be done again
+	return ([[entry objectForKey:@"status"] isEqualToString:@"done"] &&
+			[[entry objectForKey:@"uniqueFileID"] unsignedLongLongValue] == [AudioFile uniqueFileIDForFile:path] &&
+			[[NSFileManager defaultManager] fileExistsAtPath:[entry objectForKey:@"archive"]]);
+}
+
+- (NSUInteger)numberOfFinishedFiles
+{
+	[lock lock];
+	NSUInteger count = numFinishedFiles;
+	[lock unlock];
+	
+	return count;
+}
+
+- (NSUInteger)numberOfFailedFiles
+{
+	[lock lock];
+	NSUInteger count = numFailedFiles;
+	[lock unlock];
+	
+	return count;
+}
+
+#pragma mark -
+
+- (void)start
+{
+	if ([self isRunning]) {
+		return;
+	}
+	
+	BOOL isDirectory;
+	if (![[NSFileManager defaultManager] fileExistsAtPath:outputDirectory isDirectory:&isDirectory]) {
+		[[NSFileManager defaultManager] createDirectoryAtPath:outputDirectory attributes:nil];
+	}
+	
+	// every runner thread analyzes one file at a time, so their number caps the files mapped at once
+	NSUInteger numThreads = MIN(maximumOpenFiles, [filePaths count]);
+	if (numThreads == 0) {
+		[self notifyDelegate:[NSDictionary dictionaryWithObject:@"finish" forKey:@"event"]];
+		return;
+	}
+	
+	[lock lock];
+	cancelled = NO;
+	nextFileIndex = 0;
+	numFinishedFiles = 0;
+	numFailedFiles = 0;
+	numRunningThreads = numThreads;
+	[lock unlock];
+	
+	for (NSUInteger i = 0; i < numThreads; i++) {
+		[NSThread detachNewThreadSelector:@selector(runnerThread:) toTarget:self withObject:nil];
+	}
+}
+
+- (void)cancel
+{
+	[lock lock];
+	cancelled = YES;
+	NSEnumerator *enumerator = [activeAudioFiles objectEnumerator];
+	AudioFile *audioFile;
+	while (audioFile = [enumerator nextObject]) {
+		[audioFile abortAnalyzing];
+	}
+	[lock unlock];
+}
+
+- (BOOL)isRunning
+{
+	[lock lock];
+	BOOL running = (numRunningThreads > 0);
+	[lock unlock];
+	
+	return running;
+}
+
+@end
+
+#pragma mark -
+
+@implementation BatchAnalyzer (Private)
+
+- (NSString *)statePath
+{
+	return [outputDirectory stringByAppendingPathComponent:BatchAnalyzerStateFileName];
+}
+
+// every file gets its own document named after it, files of the same name get a number appended
+- (void)assignArchivePaths
+{
+	NSMutableSet	*usedPaths = [NSMutableSet set];
+	NSEnumerator	*enumerator;
+	NSString		*path;
+	
+	// documents of an earlier run keep their names
+	enumerator = [state keyEnumerator];
+	while (path = [enumerator nextObject]) {
+		NSString *archivePath = [[state objectForKey:path] objectForKey:@"archive"];
+		if (archivePath != nil && [filePaths containsObject:path]) {
+			[archivePaths setObject:archivePath forKey:path];
+			[usedPaths addObject:archivePath];
+		}
+	}
+	
+	enumerator = [filePaths objectEnumerator];
+	while (path = [enumerator nextObject]) {
+		if ([archivePaths objectForKey:path] != nil) {
+			continue;
+		}
+		
+		NSString	*baseName = [[path lastPathComponent] stringByDeletingPathExtension];
+		NSString	*archivePath = [[outputDirectory stringByAppendingPathComponent:baseName] stringByAppendingPathExtension:@"split"];
+		NSUInteger	number = 2;
+		while ([usedPaths containsObject:archivePath] || [[NSFileManager defaultManager] fileExistsAtPath:archivePath]) {
+			NSString *numberedName = [NSString stringWithFormat:@"%@ %lu", baseName, (unsigned long)number++];
+			archivePath = [[outputDirectory stringByAppendingPathComponent:numberedName] stringByAppendingPathExtension:@"split"];
+		}
+		[archivePaths setObject:archivePath forKey:path];
+		[usedPaths addObject:archivePath];
+	}
+}
+
+- (NSString *)takeNextFile
+{
+	NSString	*path = nil;
+	
+	[lock lock];
+	while (!cancelled && nextFileIndex < [filePaths count]) {
+		NSString *candidate = [filePaths objectAtIndex:nextFileIndex++];
+		if (![self isFileDone:candidate]) {
+			path = [[candidate retain] autorelease];
+			break;
+		}
+	}
+	[lock unlock];
+	
+	return path;
+}
+
+- (void)runnerThread:(id)obj
+{
+	NSAutoreleasePool   *pool = [[NSAutoreleasePool alloc] init];
+	NSString			*path;
+	
+	while ((path = [self takeNextFile]) != nil) {
+		NSAutoreleasePool   *filePool = [[NSAutoreleasePool alloc] init];
+		[self analyzeFile:path];
+		[filePool release];
+	}
+	
+	[lock lock];
+	numRunningThreads--;
+	BOOL lastThread = (numRunningThreads == 0);
+	[lock unlock];
+	
+	if (lastThread) {
+		[self performSelectorOnMainThread:@selector(notifyDelegate:)
+							   withObject:[NSDictionary dictionaryWithObject:@"finish" forKey:@"event"]
+							waitUntilDone:NO];
+	}
+	
+	[pool release];
+}
+
+- (void)analyzeFile:(NSString *)path
+{
+	AudioFile	*audioFile = nil;
+	NSString	*archivePath = [archivePaths objectForKey:path];
+	NSString	*failure = nil;
+	
+	[self performSelectorOnMainThread:@selector(notifyDelegate:)
+						   withObject:[NSDictionary dictionaryWithObjectsAndKeys:@"start", @"event", path, @"path", nil]
+						waitUntilDone:NO];
+	
+	@try {
+		audioFile = [[AudioFile audioFileWithPath:path] retain];
+	} @catch (NSException *exception) {
+		failure = [exception reason];
+	}
+	
+	if (audioFile != nil && [audioFile progressMaxValue] <= [audioFile progressMinValue]) {
+		failure = @"the file could not be opened";
+	} else if (audioFile != nil) {
+		[audioFile setBackgroundAnalysis:YES];
+		[lock lock];
+		[activeAudioFiles addObject:audioFile];
+		[lock unlock];
+		
+		if (![audioFile analyzeSilencesSynchronouslyLongerThan:silenceDurationThreshold quieterThan:silenceVolumeThreshold]) {
+			failure = @"the file could not be analyzed";
+		} else {
+			// written atomically, so that a document that exists is always complete
+			NSData *data = [SplitDocumentArchive dataRepresentationWithAudioFile:audioFile
+																audioSegmentTree:[audioFile audioSegmentTree]
+																	  documentID:0
+														silenceDurationThreshold:silenceDurationThreshold
+																 volumeThreshold:silenceVolumeThreshold
+													   playSilenceIntervalBefore:playSilenceIntervalBefore
+																   intervalAfter:playSilenceIntervalAfter];
+			if (![data writeToFile:archivePath atomically:YES]) {
+				failure = @"the document could not be written";
+			}
+		}
+		
+		[lock lock];
+		[activeAudioFiles removeObject:audioFile];
+		[lock unlock];
+	}
+	
+	// this closes the file again
+	[audioFile release];
+	
+	[lock lock];
+	BOOL wasCancelled = cancelled;
+	[lock unlock];
+	
+	if (wasCancelled) {
+		// nothing is recorded, so the file is done again when the batch is resumed
+		return;
+	} else if (failure != nil) {
+		NSLog(@"batch analysis of %@ failed: %@", path, failure);
+		[self recordFile:path status:@"failed" reason:failure];
+		[self performSelectorOnMainThread:@selector(notifyDelegate:)
+							   withObject:[NSDictionary dictionaryWithObjectsAndKeys:@"fail", @"event", path, @"path", failure, @"reason", nil]
+							waitUntilDone:NO];
+	} else {
+		[self recordFile:path status:@"done" reason:nil];
+		[self performSelectorOnMainThread:@selector(notifyDelegate:)
+							   withObject:[NSDictionary dictionaryWithObjectsAndKeys:@"done", @"event", path, @"path", archivePath, @"archive", nil]
+							waitUntilDone:NO];
+	}
+}
+
+- (void)recordFile:(NSString *)path status:(NSString *)status reason:(NSString *)reason
+{
+	NSMutableDictionary *entry = [NSMutableDictionary dictionary];
+	[entry setObject:status forKey:@"status"];
+	[entry setObject:[archivePaths objectForKey:path] forKey:@"archive"];
+	[entry setObject:[NSNumber numberWithUnsignedLongLong:[AudioFile uniqueFileIDForFile:path]] forKey:@"uniqueFileID"];
+	if (reason != nil) {
+		[entry setObject:reason forKey:@"reason"];
+	}
+	
+	[lock lock];
+	if ([status isEqualToString:@"done"]) {
+		numFinishedFiles++;
+	} else {
+		numFailedFiles++;
+	}
+	[state setObject:entry forKey:path];
+	if (![state writeToFile:[self statePath] atomically:YES]) {
+		NSLog(@"could not write batch analysis state to %@", [self statePath]);
+	}
+	[lock unlock];
+}
+
+- (void)notifyDelegate:(NSDictionary *)event
+{
+	NSString	*type = [event objectForKey:@"event"];
+	NSString	*path = [event objectForKey:@"path"];
+	
+	if ([type isEqualToString:@"start"]) {
+		if ([delegate respondsToSelector:@selector(batchAnalyzer:didStartFile:)]) {
+			[delegate batchAnalyzer:self didStartFile:path];
+		}
+	} else if ([type isEqualToString:@"done"]) {
+		if ([delegate respondsToSelector:@selector(batchAnalyzer:didFinishFile:archive:)]) {
+			[delegate batchAnalyzer:self didFinishFile:path archive:[event objectForKey:@"archive"]];
+		}
+	} else if ([type isEqualToString:@"fail"]) {
+		if ([delegate respondsToSelector:@selector(batchAnalyzer:didFailFile:reason:)]) {
+			[delegate batchAnalyzer:self didFailFile:path reason:[event objectForKey:@"reason"]];
+		}
+	} else if ([type isEqualToString:@"finish"]) {
+		if ([delegate respondsToSelector:@selector(batchAnalyzerDidFinish:)]) {
+			[delegate batchAnalyzerDidFinish:self];
+		}
+	}
+}
+
+- (void)audioFileProgressDidChange:(NSNotification *)notification
+{
+	AudioFile	*audioFile = [notification object];
+	
+	[lock lock];
+	BOOL isOurs = [activeAudioFiles containsObject:audioFile];
+	[lock unlock];
+	
+	if (isOurs && [delegate respondsToSelector:@selector(batchAnalyzer:didProgress:onFile:)]) {
+		double range = [audioFile progressMaxValue] - [audioFile progressMinValue];
+		double fraction = (range > 0.0) ? (([audioFile progressValue] - [audioFile progressMinValue]) / range) : 0.0;
+		[delegate batchAnalyzer:self didProgress:fraction onFile:[audioFile filePath]];
+	}
+}
+
+@end
@@ -0,0 +1,75 @@
+//
+//  LoudnessEnvelope.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import <Foundation/Foundation.h>
+
+// volume levels are stored logarithmically, with this many steps per doubling
+#define LoudnessEnvelopeStepsPerOctave		12
+
+// marks frames that could not be decoded, they are left out when the envelope is scanned
+#define LoudnessEnvelopeUnknownLevel		255
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// quantizes a frame volume to one byte and back
+uint8_t LoudnessEnvelopeLevelForVolume(unsigned long volume);
+unsigned long LoudnessEnvelopeVolumeForLevel(uint8_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+@interface LoudnessEnvelope : NSObject <NSCoding> {
+	NSMutableData	*levels;			// one byte per frame
+	int				samplesPerFrame;
+	int				samplerate;
+	
+	// frames louder than this were not decoded but only estimated, so the envelope
+	// can only tell silences apart with volume thresholds up to this one, and only
+	// silences at least as long as the runs of estimated frames are
+	int				maxVolumeThreshold;
+	double			minDurationThreshold;
+}
+
+- (id)initWithSamplesPerFrame:(int)samples samplerate:(int)rate;
+- (void)dealloc;
+
+- (id)initWithCoder:(NSCoder *)coder;
+- (void)encodeWithCoder:(NSCoder *)coder;
+
+- (void)appendLevel:(uint8_t)level samplesPerFrame:(int)samples samplerate:(int)rate;
+- (void)appendLevels:(const uint8_t *)newLevels count:(NSUInteger)count samplesPerFrame:(int)samples samplerate:(int)rate;
+- (void)setLastLevel:(uint8_t)level;
+- (void)appendEnvelope:(LoudnessEnvelope *)envelope;
+- (void)limitVolumeThreshold:(int)threshold;
+- (void)limitDurationThreshold:(double)duration;
+
+- (NSUInteger)numberOfFrames;
+- (const uint8_t *)levels;
+- (int)samplesPerFrame;
+- (int)samplerate;
+- (BOOL)canScanWithVolumeThreshold:(int)threshold durationThreshold:(double)duration;
+
+@end
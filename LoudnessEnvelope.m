@@ -0,0 +1,195 @@
+//
+//  LoudnessEnvelope.m
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import "LoudnessEnvelope.h"
+
+#include <math.h>
+
+
+uint8_t
+LoudnessEnvelopeLevelForVolume(unsigned long volume)
+{
+	if (volume == 0) {
+		return 0;
+	}
+	
+	long level = lround(log2((double)volume) * LoudnessEnvelopeStepsPerOctave) + 1;
+	if (level >= LoudnessEnvelopeUnknownLevel) {
+		level = LoudnessEnvelopeUnknownLevel - 1;
+	}
+	
+	return (uint8_t)level;
+}
+
+unsigned long
+LoudnessEnvelopeVolumeForLevel(uint8_t level)
+{
+	if (level == 0) {
+		return 0;
+	}
+	
+	return (unsigned long)lround(exp2((double)(level - 1) / LoudnessEnvelopeStepsPerOctave));
+}
+
+
+#pragma mark -
+
+
+@implementation LoudnessEnvelope
+
+- (id)initWithSamplesPerFrame:(int)samples samplerate:(int)rate
+{
+	if (self = [super init]) {
+		levels = [[NSMutableData alloc] init];
+		samplesPerFrame = samples;
+		samplerate = rate;
+		maxVolumeThreshold = INT_MAX;
+		minDurationThreshold = 0.0;
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	[levels release];
+	[super dealloc];
+}
+
+
+#pragma mark -
+
+
+- (id)initWithCoder:(NSCoder *)coder
+{
+	if ([coder allowsKeyedCoding]) {
+		if (self = [self initWithSamplesPerFrame:[coder decodeIntForKey:@"samplesPerFrame"]
+									  samplerate:[coder decodeIntForKey:@"samplerate"]]) {
+			NSUInteger length;
+			const uint8_t *bytes = [coder decodeBytesForKey:@"levels" returnedLength:&length];
+			[levels appendBytes:bytes length:length];
+			maxVolumeThreshold = [coder decodeIntForKey:@"maxVolumeThreshold"];
+			minDurationThreshold = [coder decodeDoubleForKey:@"minDurationThreshold"];
+		}
+		
+		return self;
+	} else {
+		[NSException raise:NSInvalidArchiveOperationException format:@"Only supports NSKeyedArchiver coders"];
+		return nil;
+	}
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder
+{
+    if ([coder allowsKeyedCoding]) {
+		[coder encodeInt:samplesPerFrame forKey:@"samplesPerFrame"];
+		[coder encodeInt:samplerate forKey:@"samplerate"];
+		[coder encodeInt:maxVolumeThreshold forKey:@"maxVolumeThreshold"];
+		[coder encodeDouble:minDurationThreshold forKey:@"minDurationThreshold"];
+		[coder encodeBytes:[levels bytes] length:[levels length] forKey:@"levels"];
+	} else {
+        [NSException raise:NSInvalidArchiveOperationException format:@"Only supports NSKeyedArchiver coders"];
+	}
+}
+
+
+#pragma mark -
+
+
+// all frames need to have the same duration, otherwise the envelope can't be scanned
+- (void)appendLevel:(uint8_t)level samplesPerFrame:(int)samples samplerate:(int)rate
+{
+	if (samples != samplesPerFrame || rate != samplerate) {
+		samplesPerFrame = 0;
+	}
+	
+	[levels appendBytes:&level length:1];
+}
+
+- (void)appendLevels:(const uint8_t *)newLevels count:(NSUInteger)count samplesPerFrame:(int)samples samplerate:(int)rate
+{
+	if (samples != samplesPerFrame || rate != samplerate) {
+		samplesPerFrame = 0;
+	}
+	
+	[levels appendBytes:newLevels length:count];
+}
+
+- (void)setLastLevel:(uint8_t)level
+{
+	if ([levels length] > 0) {
+		((uint8_t *)[levels mutableBytes])[[levels length] - 1] = level;
+	}
+}
+
+- (void)appendEnvelope:(LoudnessEnvelope *)envelope
+{
+	if ([envelope samplesPerFrame] != samplesPerFrame || [envelope samplerate] != samplerate) {
+		samplesPerFrame = 0;
+	}
+	
+	[levels appendData:envelope->levels];
+	[self limitVolumeThreshold:envelope->maxVolumeThreshold];
+	[self limitDurationThreshold:envelope->minDurationThreshold];
+}
+
+- (void)limitVolumeThreshold:(int)threshold
+{
+	if (threshold < maxVolumeThreshold) {
+		maxVolumeThreshold = threshold;
+	}
+}
+
+- (void)limitDurationThreshold:(double)duration
+{
+	if (duration > minDurationThreshold) {
+		minDurationThreshold = duration;
+	}
+}
+
+- (NSUInteger)numberOfFrames
+{
+	return [levels length];
+}
+
+- (const uint8_t *)levels
+{
+	return [levels bytes];
+}
+
+- (int)samplesPerFrame
+{
+	return samplesPerFrame;
+}
+
+- (int)samplerate
+{
+	return samplerate;
+}
+
+- (BOOL)canScanWithVolumeThreshold:(int)threshold durationThreshold:(double)duration
+{
+	return (samplesPerFrame > 0 && samplerate > 0 && threshold <= maxVolumeThreshold && duration >= minDurationThreshold);
+}
+
+@end
@@ -0,0 +1,165 @@
+//
+//  MADDecodeLoop.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MADDECODELOOP_H
+#define MADDECODELOOP_H
+
+#include <mad/mad.h>
+
+// the synchronous decode loop of mad_decoder_run, written against libmad's low level api. instead of
+// five callbacks through function pointers it calls the handlers of a policy class, which the compiler
+// can inline into the loop. a policy has these members:
+//
+//   static const bool synthesizes;		// whether frames the filter lets through are synthesized
+//   enum mad_flow input(struct mad_stream *stream);
+//   enum mad_flow header(struct mad_header const *header);
+//   enum mad_flow filter(struct mad_stream const *stream, struct mad_frame *frame);
+//   enum mad_flow output(struct mad_header const *header, struct mad_pcm *pcm);
+//   enum mad_flow error(struct mad_stream *stream, struct mad_frame *frame);
+//
+// the flows returned mean the same as they do for mad_decoder_run.
+
+template <class Policy>
+int
+MADDecodeLoopRun(Policy &policy, struct mad_stream *stream, struct mad_frame *frame, struct mad_synth *synth)
+{
+	int result = 0;
+	
+	mad_stream_init(stream);
+	mad_frame_init(frame);
+	mad_synth_init(synth);
+	
+	do {
+		switch (policy.input(stream)) {
+			case MAD_FLOW_STOP:		goto done;
+			case MAD_FLOW_BREAK:	goto fail;
+			case MAD_FLOW_IGNORE:	continue;
+			case MAD_FLOW_CONTINUE:	break;
+		}
+		
+		while (1) {
+			if (mad_header_decode(&frame->header, stream) == -1) {
+				if (!MAD_RECOVERABLE(stream->error)) {
+					break;
+				}
+				switch (policy.error(stream, frame)) {
+					case MAD_FLOW_STOP:		goto done;
+					case MAD_FLOW_BREAK:	goto fail;
+					default:				continue;
+				}
+			}
+			switch (policy.header(&frame->header)) {
+				case MAD_FLOW_STOP:		goto done;
+				case MAD_FLOW_BREAK:	goto fail;
+				case MAD_FLOW_IGNORE:	continue;
+				case MAD_FLOW_CONTINUE:	break;
+			}
+			
+			if (mad_frame_decode(frame, stream) == -1) {
+				if (!MAD_RECOVERABLE(stream->error)) {
+					break;
+				}
+				switch (policy.error(stream, frame)) {
+					case MAD_FLOW_STOP:		goto done;
+					case MAD_FLOW_BREAK:	goto fail;
+					case MAD_FLOW_IGNORE:	break;
+					default:				continue;
+				}
+			}
+			
+			switch (policy.filter(stream, frame)) {
+				case MAD_FLOW_STOP:		goto done;
+				case MAD_FLOW_BREAK:	goto fail;
+				case MAD_FLOW_IGNORE:	continue;
+				case MAD_FLOW_CONTINUE:	break;
+			}
+			
+			if (Policy::synthesizes) {
+				mad_synth_frame(synth, frame);
+				switch (policy.output(&frame->header, &synth->pcm)) {
+					case MAD_FLOW_STOP:		goto done;
+					case MAD_FLOW_BREAK:	goto fail;
+					default:				break;
+				}
+			}
+		}
+	} while (stream->error == MAD_ERROR_BUFLEN);
+	
+fail:
+	result = -1;
+	
+done:
+	mad_synth_finish(synth);
+	mad_frame_finish(frame);
+	mad_stream_finish(stream);
+	
+	return result;
+}
+
+
+// the same policy driven by mad_decoder_run, to compare the two loops
+template <class Policy>
+struct MADDecodeLoopCallbacks {
+	static enum mad_flow input(void *data, struct mad_stream *stream)
+	{
+		return ((Policy *) data)->input(stream);
+	}
+	
+	static enum mad_flow header(void *data, struct mad_header const *header)
+	{
+		return ((Policy *) data)->header(header);
+	}
+	
+	static enum mad_flow filter(void *data, struct mad_stream const *stream, struct mad_frame *frame)
+	{
+		return ((Policy *) data)->filter(stream, frame);
+	}
+	
+	static enum mad_flow output(void *data, struct mad_header const *header, struct mad_pcm *pcm)
+	{
+		return ((Policy *) data)->output(header, pcm);
+	}
+	
+	static enum mad_flow error(void *data, struct mad_stream *stream, struct mad_frame *frame)
+	{
+		return ((Policy *) data)->error(stream, frame);
+	}
+};
+
+template <class Policy>
+int
+MADDecodeLoopRunWithCallbacks(Policy &policy)
+{
+	struct mad_decoder decoder;
+	
+	mad_decoder_init(&decoder, &policy,
+					 MADDecodeLoopCallbacks<Policy>::input, MADDecodeLoopCallbacks<Policy>::header,
+					 MADDecodeLoopCallbacks<Policy>::filter, MADDecodeLoopCallbacks<Policy>::output,
+					 MADDecodeLoopCallbacks<Policy>::error, 0 /* message */);
+	int result = mad_decoder_run(&decoder, MAD_DECODER_MODE_SYNC);
+	mad_decoder_finish(&decoder);
+	
+	return result;
+}
+
+#endif
@@ -21,40 +21,95 @@
 //  along with AudioSlicer; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
 
-#import <Cocoa/Cocoa.h>
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+#include <mad/mad.h>
 
 #import "AudioFile.h"
+#import "MP3FrameIndex.h"
+#import "MP3InputSource.h"
+#import "MP3VBRHeader.h"
+#import "LoudnessEnvelope.h"
+#import "MADSilenceTracker.h"
+#import "MADDecoderProcessor.h"
+#import "MADWorkStealingPool.h"
+
+// progress notifications are sent at this rate while analyzing, no matter how often the progress changes
+#define MADDecoderProgressNotificationRate		20
+
+// user default to skip decoding the frames the layer III side info shows to be loud
+#define MADDecoderSideInfoPrescanKey			@"SideInfoPrescan"
+
+// user default with the name of the silence resolution: frame, granule or block
+#define MADDecoderSilenceResolutionKey			@"SilenceResolution"
 
 @interface MADDecoder : NSObject {
 	AudioFile				*audioFile;
 	NSData					*mp3Data;
+	const MP3InputSource	*inputSource;		// where mp3Data comes from, owned by the audio file
+	MP3InputPrefetcher		*inputPrefetcher;	// only while analyzing, and only if wanted
+	MP3FrameIndex			*frameIndex;
+	pthread_mutex_t			frameIndexMutex;
+	const MP3VBRHeader		*vbrHeader;			// approximate seek map until there is a frame index, owned by the audio file
 	
 	BOOL					decodingErrorOverflowFlag;
 	double					progressValue;
 	
+	// sends the progress notifications while analyzing
+	pthread_t				progressThread;
+	pthread_mutex_t			progressMutex;
+	pthread_cond_t			progressCondition;
+	BOOL					progressPublishing;
+	BOOL					usesSideInfoPrescan;
+	MADSilenceResolution	silenceResolution;
+	
 	// meta data gathered during processing
 	int						audioChannels;
 	int						audioSamplingFrequency;
 	double					audioDuration;
 }
 
++ (NSString *)nameOfSilenceResolution:(MADSilenceResolution)resolution;
++ (MADSilenceResolution)silenceResolutionForName:(NSString *)name fallback:(MADSilenceResolution)fallback;
+
 - (id)initWithAudioFile:(AudioFile *)anAudioFile;
 - (void)dealloc;
 
-- (int)analyzeSilencesWithVolumeThreshold:(int)volumeThreshold durationThreshold:(double)durationThreshold;
+- (int)analyzeSilencesWithThresholds:(const MADSilenceThresholds *)thresholds count:(NSUInteger)count silences:(NSArray **)silenceLists;
+- (int)scanSilencesInEnvelope:(LoudnessEnvelope *)envelope volumeThreshold:(int)volumeThreshold durationThreshold:(double)durationThreshold;
 - (int)splitDecodeToFile:(NSFileHandle *)file startTime:(double)start endTime:(double)end;
 - (int)playAudioStartTime:(double)start endTime:(double)end;
 
 - (void)setMP3Data:(NSData *)data;
 - (NSData *)mp3Data;
+- (void)setInputSource:(const MP3InputSource *)source;
+- (const MP3InputSource *)inputSource;
+- (MP3InputPrefetcher *)inputPrefetcher;
+- (void)setFrameIndex:(MP3FrameIndex *)index;
+- (MP3FrameIndex *)frameIndex;
+- (void)setVBRHeader:(const MP3VBRHeader *)header;
+- (const MP3VBRHeader *)vbrHeader;
+- (void)setUsesSideInfoPrescan:(BOOL)flag;
+- (BOOL)usesSideInfoPrescan;
+- (void)setSilenceResolution:(MADSilenceResolution)resolution;
+- (MADSilenceResolution)silenceResolution;
+- (void)setAnalysisPriority:(MADWorkPriority)priority;
+- (MADWorkPriority)analysisPriority;
 
 - (SeekIndex *)seekIndex;
 - (int)getNextOverlayedBeepSampleAtTime:(double)time;
 - (void)writePCMData:(void *)dataPtr length:(size_t)length;
 - (BOOL)canContinueDecoding;
 - (void)foundSilenceFrom:(double)start to:(double)end;
+- (void)foundSilences:(NSArray *)silences;
+- (NSArray *)collectResultsFromAnalyzers:(MADDecoderSilenceAnalyzer **)analyzers count:(NSUInteger)count
+							 thresholds:(const MADSilenceThresholds *)thresholds count:(NSUInteger)numThresholds;
 - (void)decodingErrorOverflow;
 
+- (void)startPublishingProgress;
+- (void)stopPublishingProgress;
+- (void)publishProgress;
 - (void)setProgressValue:(double)value;
 - (double)progressValue;
 - (double)audioDuration;
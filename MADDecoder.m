@@ -24,14 +24,46 @@
 #import "MADDecoder.h"
 #import "MADDecoderProcessor.h"
 
+#include <errno.h>
+#include <sys/time.h>
+
+static void collectSilenceCallback(void *silenceList, double start, double end, double quietest);
+static void *progressThreadEntry(void *decoder);
 
 @implementation MADDecoder
 
++ (NSString *)nameOfSilenceResolution:(MADSilenceResolution)resolution
+{
+	switch (resolution) {
+		case MADSilenceResolutionGranule:	return @"granule";
+		case MADSilenceResolutionBlock:		return @"block";
+		default:							return @"frame";
+	}
+}
+
++ (MADSilenceResolution)silenceResolutionForName:(NSString *)name fallback:(MADSilenceResolution)fallback
+{
+	for (int resolution = MADSilenceResolutionFrame; resolution <= MADSilenceResolutionBlock; resolution++) {
+		if ([name isEqualToString:[self nameOfSilenceResolution:(MADSilenceResolution)resolution]]) {
+			return (MADSilenceResolution)resolution;
+		}
+	}
+	
+	return fallback;
+}
 
 - (id)initWithAudioFile:(AudioFile *)anAudioFile
 {
 	if (self = [super init]) {
 		audioFile = anAudioFile;
+		usesSideInfoPrescan = [[NSUserDefaults standardUserDefaults] boolForKey:MADDecoderSideInfoPrescanKey];
+		silenceResolution = [MADDecoder silenceResolutionForName:[[NSUserDefaults standardUserDefaults] stringForKey:MADDecoderSilenceResolutionKey]
+														fallback:MADSilenceResolutionFrame];
+		
+		pthread_mutex_init(&progressMutex, NULL);
+		pthread_cond_init(&progressCondition, NULL);
+		progressPublishing = NO;
+		pthread_mutex_init(&frameIndexMutex, NULL);
 	}
 	
 	return self;
@@ -39,7 +71,13 @@
 
 - (void)dealloc
 {
+	[self stopPublishingProgress];
+	pthread_cond_destroy(&progressCondition);
+	pthread_mutex_destroy(&progressMutex);
+	pthread_mutex_destroy(&frameIndexMutex);
+	
 	[mp3Data release];
+	[frameIndex release];
 	[super dealloc];
 }
 
@@ -47,17 +85,25 @@
 #pragma mark -
 
 
-- (int)analyzeSilencesWithVolumeThreshold:(int)volumeThreshold durationThreshold:(double)durationThreshold
+// analyzes the file once for several pairs of thresholds. silenceLists gets one array of silences per pair,
+// each silence is a dictionary with its start, end and quietest time in seconds.
+- (int)analyzeSilencesWithThresholds:(const MADSilenceThresholds *)thresholds count:(NSUInteger)count silences:(NSArray **)silenceLists
 {
 	progressValue = 0.0;
 	decodingErrorOverflowFlag = NO;
 	MADDecoderProcessor *processor = [[MADDecoderSilenceAnalyzer alloc] initWithDecoder:self startTime:0.0 endTime:AudioFileEndTime];
-	[(MADDecoderSilenceAnalyzer *)processor setSilenceVolumeThreshold:volumeThreshold];
-	[(MADDecoderSilenceAnalyzer *)processor setSilenceDurationThreshold:durationThreshold];
+	[(MADDecoderSilenceAnalyzer *)processor setSilenceThresholds:thresholds count:count];
+	[(MADDecoderSilenceAnalyzer *)processor setUsesSideInfoPrescan:usesSideInfoPrescan];
+	[(MADDecoderSilenceAnalyzer *)processor setSilenceResolution:silenceResolution];
 	
+	[self startPublishingProgress];
 	int result = [processor runDecoder];
+	[self stopPublishingProgress];
 	
-	audioDuration = [processor currentTime];
+	NSArray *lists = [self collectResultsFromAnalyzers:(MADDecoderSilenceAnalyzer **)&processor count:1 thresholds:thresholds count:count];
+	if (silenceLists != NULL) {
+		*silenceLists = lists;
+	}
 	
 	[processor release];
 	processor = nil;
@@ -65,6 +111,39 @@
 	return result;
 }
 
+// finds the silences again from the levels recorded by an earlier analysis, without decoding anything
+- (int)scanSilencesInEnvelope:(LoudnessEnvelope *)envelope volumeThreshold:(int)volumeThreshold durationThreshold:(double)durationThreshold
+{
+	if (![envelope canScanWithVolumeThreshold:volumeThreshold durationThreshold:durationThreshold]) {
+		return -1;
+	}
+	
+	MADSilenceTracker tracker;
+	MADSilenceStitcher stitcher;
+	mad_timer_t time = mad_timer_zero;
+	mad_timer_t frameDuration;
+	mad_timer_set(&frameDuration, 0, [envelope samplesPerFrame], [envelope samplerate]);
+	
+	MADSilenceTrackerInit(&tracker, volumeThreshold);
+	const uint8_t *levels = [envelope levels];
+	for (NSUInteger i = 0; i < [envelope numberOfFrames]; i++) {
+		if (levels[i] != LoudnessEnvelopeUnknownLevel) {
+			MADSilenceTrackerAddFrame(&tracker, LoudnessEnvelopeVolumeForLevel(levels[i]), time);
+		}
+		mad_timer_add(&time, frameDuration);
+	}
+	
+	NSMutableArray *silences = [NSMutableArray array];
+	MADSilenceStitcherInit(&stitcher, durationThreshold, collectSilenceCallback, silences);
+	MADSilenceStitcherAddSection(&stitcher, &tracker, mad_timer_zero);
+	MADSilenceTrackerFinish(&tracker);
+	[self foundSilences:silences];
+	
+	audioDuration = [MADDecoderProcessor timerToSeconds:time];
+	
+	return 0;
+}
+
 - (int)splitDecodeToFile:(NSFileHandle *)file startTime:(double)start endTime:(double)end
 {
 	progressValue = 0.0;
@@ -102,6 +181,81 @@
 	return mp3Data;
 }
 
+- (void)setInputSource:(const MP3InputSource *)source
+{
+	inputSource = source;
+}
+
+- (const MP3InputSource *)inputSource
+{
+	return inputSource;
+}
+
+- (MP3InputPrefetcher *)inputPrefetcher
+{
+	return inputPrefetcher;
+}
+
+// the analysis sets the index while playback may be using the old one
+- (void)setFrameIndex:(MP3FrameIndex *)index
+{
+	pthread_mutex_lock(&frameIndexMutex);
+	MP3FrameIndex *oldIndex = frameIndex;
+	frameIndex = [index retain];
+	pthread_mutex_unlock(&frameIndexMutex);
+	[oldIndex autorelease];
+}
+
+- (MP3FrameIndex *)frameIndex
+{
+	pthread_mutex_lock(&frameIndexMutex);
+	MP3FrameIndex *index = [[frameIndex retain] autorelease];
+	pthread_mutex_unlock(&frameIndexMutex);
+	return index;
+}
+
+- (void)setVBRHeader:(const MP3VBRHeader *)header
+{
+	vbrHeader = header;
+}
+
+- (const MP3VBRHeader *)vbrHeader
+{
+	return vbrHeader;
+}
+
+// when on, the silence analysis skips decoding frames that are loud judging from their side info
+- (void)setUsesSideInfoPrescan:(BOOL)flag
+{
+	usesSideInfoPrescan = flag;
+}
+
+- (BOOL)usesSideInfoPrescan
+{
+	return usesSideInfoPrescan;
+}
+
+// finer resolutions also find the quietest point of each silence to cut at
+- (void)setSilenceResolution:(MADSilenceResolution)resolution
+{
+	silenceResolution = resolution;
+}
+
+- (MADSilenceResolution)silenceResolution
+{
+	return silenceResolution;
+}
+
+// the plain decoder analyzes on the calling thread, only the threaded one schedules pool tasks
+- (void)setAnalysisPriority:(MADWorkPriority)priority
+{
+}
+
+- (MADWorkPriority)analysisPriority
+{
+	return MADWorkPriorityNormal;
+}
+
 
 #pragma mark -
 
@@ -131,13 +285,94 @@
 	[audioFile foundSilenceFrom:start to:end];
 }
 
+// hands all silences of an analysis to the audio file at once, so that it can build its tree in one go
+- (void)foundSilences:(NSArray *)silences
+{
+	// at frame resolution the quietest point is too coarse to be better than the preferences
+	if (silenceResolution == MADSilenceResolutionFrame) {
+		NSMutableArray *coarseSilences = [NSMutableArray arrayWithCapacity:[silences count]];
+		NSEnumerator *enumerator = [silences objectEnumerator];
+		NSDictionary *silence;
+		while (silence = [enumerator nextObject]) {
+			NSMutableDictionary *coarseSilence = [NSMutableDictionary dictionaryWithDictionary:silence];
+			[coarseSilence removeObjectForKey:@"quietest"];
+			[coarseSilences addObject:coarseSilence];
+		}
+		silences = coarseSilences;
+	}
+	
+	[audioFile foundSilences:silences];
+}
+
+// moves the seek points the analyzers of consecutive sections found to the audio file and returns their
+// silences, one list per pair of thresholds. the analyzers only know times relative to their own section,
+// so their silences are stitched together across the section boundaries here and checked against the
+// duration threshold once they are complete.
+- (NSArray *)collectResultsFromAnalyzers:(MADDecoderSilenceAnalyzer **)analyzers count:(NSUInteger)count
+							 thresholds:(const MADSilenceThresholds *)thresholds count:(NSUInteger)numThresholds
+{
+	mad_timer_t sectionStartTime = mad_timer_zero;
+	NSMutableArray *silenceLists = [NSMutableArray arrayWithCapacity:numThresholds];
+	
+	if (count == 0) {
+		return silenceLists;
+	}
+	
+	MADSilenceStitcher *stitchers = (MADSilenceStitcher *) malloc(numThresholds * sizeof(MADSilenceStitcher));
+	for (NSUInteger k = 0; k < numThresholds; k++) {
+		NSMutableArray *silenceList = [NSMutableArray array];
+		[silenceLists addObject:silenceList];
+		MADSilenceStitcherInit(&stitchers[k], thresholds[k].durationThreshold, collectSilenceCallback, silenceList);
+	}
+	
+	LoudnessEnvelope *envelope = [[LoudnessEnvelope alloc] initWithSamplesPerFrame:[[analyzers[0] loudnessEnvelope] samplesPerFrame]
+																		samplerate:[[analyzers[0] loudnessEnvelope] samplerate]];
+	
+	// the seek points of all sections go into the seek index in one batch
+	NSUInteger numSeekEntries = 0;
+	for (NSUInteger i = 0; i < count; i++) {
+		numSeekEntries += [analyzers[i] numberOfSeekPoints];
+	}
+	SeekIndexEntry *seekEntries = (SeekIndexEntry *) malloc(MAX(numSeekEntries, 1) * sizeof(SeekIndexEntry));
+	numSeekEntries = 0;
+	
+	for (NSUInteger i = 0; i < count; i++) {
+		if ([analyzers[i] loudnessEnvelope] != nil) {
+			[envelope appendEnvelope:[analyzers[i] loudnessEnvelope]];
+		}
+
+		for (NSUInteger k = 0; k < numThresholds; k++) {
+			MADSilenceStitcherAddSection(&stitchers[k], [analyzers[i] silenceTrackerAtIndex:k], sectionStartTime);
+		}
+		
+		const MADDecoderSeekPoint *seekPoints = [analyzers[i] seekPoints];
+		for (NSUInteger j = 0; j < [analyzers[i] numberOfSeekPoints]; j++) {
+			mad_timer_t time = sectionStartTime;
+			mad_timer_add(&time, seekPoints[j].time);
+			seekEntries[numSeekEntries].time = [MADDecoderProcessor timerToSeconds:time];
+			seekEntries[numSeekEntries].byteOffset = seekPoints[j].byteOffset;
+			numSeekEntries++;
+		}
+		
+		mad_timer_add(&sectionStartTime, [analyzers[i] decodedDuration]);
+	}
+	[[audioFile analysisSeekIndex] addEntries:seekEntries count:numSeekEntries];
+	free(seekEntries);
+	
+	audioDuration = [MADDecoderProcessor timerToSeconds:sectionStartTime];
+	
+	[audioFile setLoudnessEnvelope:envelope];
+	[envelope release];
+	free(stitchers);
+	
+	return silenceLists;
+}
+
 - (void)decodingErrorOverflow
 {
 	if (decodingErrorOverflowFlag == NO) {
 		NSLog(@"Too many decoding errors. Stopping now.");
-		NSRunAlertPanel(@"Too many decoding errors",
-						@"There were too many errors while decoding this file. Maybe it's corrupted or not an MP3 file at all.",
-						@"OK", nil, nil);
+		[audioFile performSelectorOnMainThread:@selector(sendDecodingFailedNotification) withObject:nil waitUntilDone:NO];
 		decodingErrorOverflowFlag = YES;
 	}
 }
@@ -146,10 +381,60 @@
 #pragma mark -
 
 
+// the decoding threads only store their progress, a thread of its own tells the main thread about it
+// at a fixed rate, so that the per frame work doesn't have to care about notifications
+- (void)startPublishingProgress
+{
+	pthread_mutex_lock(&progressMutex);
+	if (!progressPublishing) {
+		progressPublishing = YES;
+		if (pthread_create(&progressThread, NULL, progressThreadEntry, self) != 0) {
+			progressPublishing = NO;
+		}
+	}
+	pthread_mutex_unlock(&progressMutex);
+}
+
+- (void)stopPublishingProgress
+{
+	pthread_mutex_lock(&progressMutex);
+	if (!progressPublishing) {
+		pthread_mutex_unlock(&progressMutex);
+		return;
+	}
+	progressPublishing = NO;
+	pthread_cond_signal(&progressCondition);
+	pthread_mutex_unlock(&progressMutex);
+	
+	pthread_join(progressThread, NULL);
+	
+	// the final state
+	[audioFile performSelectorOnMainThread:@selector(sendProgressChangedNotification) withObject:nil waitUntilDone:NO];
+}
+
+- (void)publishProgress
+{
+	pthread_mutex_lock(&progressMutex);
+	while (progressPublishing) {
+		struct timeval now;
+		struct timespec deadline;
+		gettimeofday(&now, NULL);
+		long nsec = now.tv_usec * 1000 + 1000000000 / MADDecoderProgressNotificationRate;
+		deadline.tv_sec = now.tv_sec + nsec / 1000000000;
+		deadline.tv_nsec = nsec % 1000000000;
+		
+		if (pthread_cond_timedwait(&progressCondition, &progressMutex, &deadline) == ETIMEDOUT && progressPublishing) {
+			pthread_mutex_unlock(&progressMutex);
+			[audioFile performSelectorOnMainThread:@selector(sendProgressChangedNotification) withObject:nil waitUntilDone:NO];
+			pthread_mutex_lock(&progressMutex);
+		}
+	}
+	pthread_mutex_unlock(&progressMutex);
+}
+
 - (void)setProgressValue:(double)value
 {
 	progressValue = value;
-	[audioFile performSelectorOnMainThread:@selector(sendProgressChangedNotification) withObject:nil waitUntilDone:NO];
 }
 
 - (double)progressValue
@@ -185,3 +470,26 @@
 
 @end
 
+
+#pragma mark -
+
+
+static void *
+progressThreadEntry(void *decoder)
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	[(MADDecoder *)decoder publishProgress];
+	[pool release];
+	
+	return NULL;
+}
+
+static void
+collectSilenceCallback(void *silenceList, double start, double end, double quietest)
+{
+	[(NSMutableArray *)silenceList addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+		[NSNumber numberWithDouble:start], @"start",
+		[NSNumber numberWithDouble:end], @"end",
+		[NSNumber numberWithDouble:quietest], @"quietest",
+		nil]];
+}
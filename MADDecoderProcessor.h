@@ -21,17 +21,47 @@
 //  along with AudioSlicer; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
 
-#import <Cocoa/Cocoa.h>
+#import <Foundation/Foundation.h>
 
 #include <mad/mad.h>
 
+#import "MADSilenceTracker.h"
+#import "LoudnessEnvelope.h"
+#import "MP3InputSource.h"
+
 @class MADDecoder;
 
+// the silence analyzer has the kernel read this far ahead of it in a mapped file, and gives back
+// the pages behind it, each time it has moved on by a step
+#define MADDecoderReadaheadDistance		(4 * 1024 * 1024)
+#define MADDecoderReadaheadStep			(1024 * 1024)
+
+// how many frames before the start time playing begins when there is no frame index to find the
+// frames the bit reservoir of the first frame reaches back to
+#define MADDecoderSeekPrerollFrames		4
+
+// the decode loops tell the decoder about their progress, and ask it whether to go on, this many frames apart
+#define MADDecoderProcessorCheckInterval	16
+
+// how finely the silence analyzer looks at the decoded frames
+typedef enum {
+	MADSilenceResolutionFrame,		// one volume per frame
+	MADSilenceResolutionGranule,	// one volume per granule of 576 samples
+	MADSilenceResolutionBlock		// one volume per subband sample block of 32 samples
+} MADSilenceResolution;
+
+// seek points are recorded relative to the start of the decoded section
+typedef struct {
+	mad_timer_t		time;
+	NSUInteger		byteOffset;
+} MADDecoderSeekPoint;
+
+// the ivars are visible to the decode loop policies in MADDecoderProcessor.mm, which do the work
+// of the processors for every frame without sending messages
 @interface MADDecoderProcessor : NSObject {
+@package
 	MADDecoder				*decoder;
 	
-	struct mad_decoder		decoderStruct;
-	
 	// decoding will always happen between these time points only
 	mad_timer_t				decodeStartTime;
 	mad_timer_t				decodeStopTime;
@@ -57,12 +87,11 @@
 - (NSUInteger)currentBufferPosition;
 - (double)currentTime;
 
+// decoding runs through MADDecodeLoopRun, or through mad_decoder_run and its callbacks to compare the two
++ (void)setUsesCallbackDecodeLoop:(BOOL)flag;
++ (BOOL)usesCallbackDecodeLoop;
+
 - (int)runDecoder;
-- (enum mad_flow)madInputForStream:(struct mad_stream *)stream;
-- (enum mad_flow)madHeader:(struct mad_header const *)header;
-- (enum mad_flow)madFilterForStream:(struct mad_stream const *)stream atFrame:(struct mad_frame *)frame;
-- (enum mad_flow)madOutputWithHeader:(struct mad_header const *)header pcm:(struct mad_pcm *)pcm;
-- (enum mad_flow)madErrorForStream:(struct mad_stream *)stream atFrame:(struct mad_frame *)frame;
 
 @end
 
@@ -70,6 +99,7 @@
 @end
 
 @interface MADDecoderFileSplitter : MADDecoderProcessor {
+@package
 	NSFileHandle	*splitFile;
 }
 - (void)setSplitFile:(NSFileHandle *)file;
@@ -79,22 +109,53 @@
 @end
 
 @interface MADDecoderSilenceAnalyzer : MADDecoderProcessor {
+@package
 	// alternatively decoding start/end points can be specified as byte offsets
 	BOOL			useDecodeStartStopByteOffsets;
 	NSUInteger		decodeStartByteOffset;
 	NSUInteger		decodeStopByteOffset;
+	NSUInteger		prerollByteOffset;
+	BOOL			prerolling;
+	
+	// one silence state machine per pair of thresholds, all fed from the same decoded frames
+	MADSilenceThresholds	*silenceThresholds;
+	MADSilenceTracker		*silenceTrackers;
+	NSUInteger				numSilenceTrackers;
+	long					silenceVolumeThreshold;		// the largest volume threshold of all pairs
+	double					minDurationThreshold;		// the shortest duration threshold of all pairs
+	MADSilenceResolution	silenceResolution;
 	
-	double			silenceDurationThreshold;   // min secs a silence has to last to be recorded
-	int				silenceVolumeThreshold;		// max volume level in pcm scale
+	// frames the layer III side info shows to be loud are not decoded, unless a decoded frame after them doesn't confirm them
+	BOOL			usesSideInfoPrescan;
+	BOOL			estimatedLoud;
+	double			estimatedVolume;
 	
-	double			silenceStartTime;
-	BOOL			inSilence;
+	// one quantized volume level per frame, for scanning with other thresholds later
+	LoudnessEnvelope	*loudnessEnvelope;
 	
 	long			seekIndexLastSecond;
+	
+	// readahead and release of the pages of a mapped file
+	NSUInteger		nextAdviceOffset;
+	NSUInteger		releasedOffset;
+	long			prefetchReader;
+	
+	// results, collected by the decoder once we are finished
+	MADDecoderSeekPoint	*seekPoints;
+	NSUInteger			numSeekPoints;
+	NSUInteger			allocedSeekPoints;
 }
 - (id)initWithDecoder:(MADDecoder *)aDecoder startByteOffset:(NSUInteger)start endByteOffset:(NSUInteger)end;
-- (void)setSilenceVolumeThreshold:(int)threshold;
-- (void)setSilenceDurationThreshold:(double)threshold;
+- (void)setSilenceThresholds:(const MADSilenceThresholds *)thresholds count:(NSUInteger)count;
+- (void)setSilenceResolution:(MADSilenceResolution)resolution;
+- (void)setUsesSideInfoPrescan:(BOOL)flag;
 - (NSUInteger)decodeStartByteOffset;
+
+- (mad_timer_t)decodedDuration;
+- (NSUInteger)numberOfSilenceTrackers;
+- (const MADSilenceTracker *)silenceTrackerAtIndex:(NSUInteger)index;
+- (LoudnessEnvelope *)loudnessEnvelope;
+- (NSUInteger)numberOfSeekPoints;
+- (const MADDecoderSeekPoint *)seekPoints;
 @end
 
@@ -0,0 +1,1333 @@
+//
+//  MADDecoderProcessor.mm
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 01.10.06.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import "MADDecoderProcessor.h"
+#import "MADDecoder.h"
+#import "MP3FrameHeader.h"
+#import "MP3SideInfo.h"
+#import "MADEnergyKernel.h"
+
+#include <errno.h>
+#include "MADDecodeLoop.h"
+
+// how many levels the silence analyzer collects before it hands them to the loudness envelope
+#define MADSilenceAnalyzerLevelBatchSize	64
+
+// the most frames the silence analyzer keeps pending before it decodes them anyway
+#define MADSilenceAnalyzerMaxPendingFrames	256
+
+static BOOL usesCallbackDecodeLoop = NO;
+
+@interface MADDecoderSilenceAnalyzer (Private)
+- (void)addSeekPointAtOffset:(NSUInteger)offset time:(mad_timer_t)time;
+- (NSUInteger)inputAdviceEndOffset;
+- (void)startInputAdvice;
+- (void)adviseInputAtOffset:(NSUInteger)offset;
+- (void)finishInputAdvice;
+@end
+
+template <class Policy> static int MADProcessorRunPolicy(Policy &policy);
+static NSUInteger MADPrerollFrameForFrame(MP3FrameIndex *frameIndex, const uint8_t *bytes, NSUInteger length, NSUInteger frame);
+
+
+#pragma mark -
+
+
+// the work every processor does for a frame, the policies of the processors build on it. the loop is
+// instantiated for the policy of each processor, so none of these calls go through a function pointer
+// or a message send. the bytes of the mp3 data are looked up once per run, and the decoder only hears
+// about the progress every few frames, and about the audio format when it changes.
+template <class Processor>
+struct MADProcessorPolicy {
+	static const bool	synthesizes = false;
+	
+	Processor			*processor;
+	MADDecoder			*decoder;
+	const uint8_t		*bytes;
+	NSUInteger			length;
+	struct mad_stream	*stream;
+	const uint8_t		*buffer;		// what the stream was given last, and where it starts in the file
+	NSUInteger			bufferOffset;
+	
+	int					framesUntilCheck;
+	bool				checkDue;		// set by header for the frames that should look at the decoder
+	int					channels;
+	unsigned int		samplerate;
+	
+	MADProcessorPolicy(Processor *aProcessor)
+	{
+		processor = aProcessor;
+		decoder = aProcessor->decoder;
+		bytes = (const uint8_t *)[[decoder mp3Data] bytes];
+		length = [[decoder mp3Data] length];
+		stream = NULL;
+		buffer = bytes;
+		bufferOffset = 0;
+		framesUntilCheck = 1;
+		checkDue = false;
+		channels = -1;
+		samplerate = 0;
+	}
+	
+	void setBuffer(struct mad_stream *aStream, NSUInteger offset)
+	{
+		stream = aStream;
+		buffer = bytes + offset;
+		bufferOffset = offset;
+		mad_stream_buffer(stream, buffer, length - offset);
+	}
+	
+	NSUInteger byteOffsetOf(const unsigned char *ptr)
+	{
+		return bufferOffset + (ptr - buffer);
+	}
+	
+	enum mad_flow input(struct mad_stream *aStream)
+	{
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow header(struct mad_header const *header)
+	{
+		processor->currentBufferPosition = byteOffsetOf(stream->this_frame);
+		checkDue = (--framesUntilCheck == 0);
+		if (checkDue) {
+			framesUntilCheck = MADDecoderProcessorCheckInterval;
+			[decoder setProgressValue:(double)processor->currentBufferPosition];
+		}
+		
+		processor->currentTime = processor->nextCurrentTime;
+		mad_timer_add(&processor->nextCurrentTime, header->duration);
+		
+		if (MAD_NCHANNELS(header) != channels || header->samplerate != samplerate) {
+			channels = MAD_NCHANNELS(header);
+			samplerate = header->samplerate;
+			[decoder setAudioChannels:channels];
+			[decoder setAudioSamplingFrequency:samplerate];
+		}
+		
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow filter(struct mad_stream const *aStream, struct mad_frame *frame)
+	{
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow output(struct mad_header const *header, struct mad_pcm *pcm)
+	{
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow error(struct mad_stream *aStream, struct mad_frame *frame)
+	{
+		if (processor->badFrameCount > processor->maxBadFrameCount) {
+			[decoder decodingErrorOverflow];
+			return MAD_FLOW_BREAK;
+		}
+		
+		size_t tagLength;
+		switch (aStream->error) {
+			case MAD_ERROR_LOSTSYNC:
+				if ((tagLength = MP3TagLength(aStream->this_frame, aStream->bufend - aStream->this_frame)) > 0) {
+					NSLog(@"skipping ID3 tag of size %lu", (unsigned long) tagLength);
+					mad_stream_skip(aStream, tagLength);
+					return MAD_FLOW_CONTINUE;   // continue decoding normally
+				} else {
+					processor->badFrameCount++;
+					return MAD_FLOW_IGNORE;		// skip the rest of the current frame
+				}
+				
+			case MAD_ERROR_BADCRC:
+				NSLog(@"bad crc error 0x%04x (%s) at byte offset %ld",
+					  aStream->error, mad_stream_errorstr(aStream), (long)byteOffsetOf(aStream->this_frame));
+				processor->badFrameCount++;
+				return MAD_FLOW_IGNORE;      // skip the rest of the current frame
+				
+			case MAD_ERROR_BADDATAPTR:
+				if (!processor->frameResyncing) {
+					NSLog(@"frame resyncing error 0x%04x (%s) at byte offset %ld",
+						  aStream->error, mad_stream_errorstr(aStream), (long)byteOffsetOf(aStream->this_frame));
+					processor->badFrameCount++;
+				}
+				return MAD_FLOW_CONTINUE;    // continue decoding normally
+				
+			default:
+				NSLog(@"decoding error 0x%04x (%s) at byte offset %ld",
+					  aStream->error, mad_stream_errorstr(aStream), (long)byteOffsetOf(aStream->this_frame));
+				processor->badFrameCount++;
+				return MAD_FLOW_CONTINUE;    // continue decoding normally
+		}
+	}
+};
+
+
+struct MADFileAnalyzerPolicy : MADProcessorPolicy<MADDecoderFileAnalyzer> {
+	MADFileAnalyzerPolicy(MADDecoderFileAnalyzer *aProcessor) : MADProcessorPolicy<MADDecoderFileAnalyzer>(aProcessor) {}
+	
+	enum mad_flow input(struct mad_stream *aStream)
+	{
+		if (processor->currentBufferPosition > 0) {
+			return MAD_FLOW_STOP;
+		}
+		
+		setBuffer(aStream, 0);
+		mad_stream_options(aStream, MAD_OPTION_HALFSAMPLERATE);
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow header(struct mad_header const *header)
+	{
+		enum mad_flow result = MADProcessorPolicy<MADDecoderFileAnalyzer>::header(header);
+		if (result != MAD_FLOW_CONTINUE) {
+			return result;
+		}
+		
+		return MAD_FLOW_IGNORE;
+	}
+};
+
+
+template <class Processor>
+struct MADFileSplitterPolicyBase : MADProcessorPolicy<Processor> {
+	typedef MADProcessorPolicy<Processor> Base;
+	
+	MADFileSplitterPolicyBase(Processor *aProcessor) : Base(aProcessor) {}
+	
+	enum mad_flow input(struct mad_stream *aStream)
+	{
+		Processor *p = this->processor;
+		if (p->currentBufferPosition > 0) {
+			return MAD_FLOW_STOP;
+		}
+		
+		SeekIndexEntry entry;
+		MP3FrameIndex *frameIndex = [this->decoder frameIndex];
+		if ([frameIndex numberOfFrames] > 0) {
+			// the frame index takes us right to the frame containing the start time
+			NSUInteger frame = [frameIndex frameIndexForTime:[MADDecoderProcessor timerToSeconds:p->decodeStartTime]];
+			MP3FrameIndexEntry frameEntry = [frameIndex entryAtIndex:frame];
+			entry.byteOffset = (NSUInteger)frameEntry.byteOffset;
+			mad_timer_set(&p->nextCurrentTime, 0, (unsigned long)frameEntry.sampleOffset, [frameIndex samplerate]);
+		} else if ([this->decoder vbrHeader] != NULL) {
+			// the seek map of the vbr header gets us close, the frame we sync to is taken to be at the start time
+			const MP3VBRHeader *vbrHeader = [this->decoder vbrHeader];
+			size_t offset = MP3VBRHeaderByteOffsetForTime(vbrHeader, [MADDecoderProcessor timerToSeconds:p->decodeStartTime]);
+			entry.byteOffset = MP3FrameSync(this->bytes, this->length, MIN(offset, this->length));
+			p->nextCurrentTime = p->decodeStartTime;
+			if (entry.byteOffset >= this->length) {
+				entry.byteOffset = vbrHeader->frameOffset;
+				p->nextCurrentTime = mad_timer_zero;
+			}
+		} else {
+			entry = [[this->decoder seekIndex] entryForTimeIndex:[MADDecoderProcessor timerToSeconds:p->decodeStartTime]];
+			p->nextCurrentTime = [MADDecoderProcessor secondsToTimer:entry.time];
+		}
+		
+		this->setBuffer(aStream, entry.byteOffset);
+		p->currentBufferPosition = entry.byteOffset;
+		
+		p->frameResyncing = YES;
+		
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow header(struct mad_header const *header)
+	{
+		enum mad_flow result = Base::header(header);
+		if (result != MAD_FLOW_CONTINUE) {
+			return result;
+		}
+		
+		Processor *p = this->processor;
+		if (mad_timer_compare(p->currentTime, p->decodeStartTime) < 0) {
+			// we are before start time
+			return MAD_FLOW_IGNORE;
+		} else {
+			// we are after start time
+			if (mad_timer_compare(p->currentTime, p->decodeStopTime) <= 0) {
+				// we are in play section
+				return MAD_FLOW_CONTINUE;
+			} else {
+				// we are after play section
+				NSLog(@"stopping at %.2f", [MADDecoderProcessor timerToSeconds:p->currentTime]);
+				return MAD_FLOW_STOP;
+			}
+		}
+	}
+	
+	enum mad_flow filter(struct mad_stream const *aStream, struct mad_frame *frame)
+	{
+		this->processor->frameResyncing = NO;
+		
+		const uint8_t *end = (aStream->next_frame != NULL) ? aStream->next_frame : aStream->bufend;
+		[this->processor->splitFile writeData:[NSData dataWithBytes:aStream->this_frame length:(end - aStream->this_frame)]];
+		
+		return MAD_FLOW_IGNORE;
+	}
+};
+
+typedef MADFileSplitterPolicyBase<MADDecoderFileSplitter> MADFileSplitterPolicy;
+
+
+// converts the decoded frames to 16 bit big endian samples, in a buffer that is used for all of them.
+// playing starts a few frames early, so the bit reservoir and the synthesis filters are filled at the
+// start time, and the samples of these frames are dropped up to the exact start sample.
+struct MADAudioPlayerPolicy : MADFileSplitterPolicyBase<MADDecoderAudioPlayer> {
+	static const bool	synthesizes = true;
+	
+	unsigned char		pcmBuf[1152 * 2 * SAMPLE_SIZE];
+	mad_timer_t			prerollStartTime;
+	bool				hasPrerollStartTime;
+	
+	MADAudioPlayerPolicy(MADDecoderAudioPlayer *aProcessor) : MADFileSplitterPolicyBase<MADDecoderAudioPlayer>(aProcessor)
+	{
+		prerollStartTime = mad_timer_zero;
+		hasPrerollStartTime = false;
+	}
+	
+	enum mad_flow input(struct mad_stream *aStream)
+	{
+		MP3FrameIndex *frameIndex = [decoder frameIndex];
+		if (processor->currentBufferPosition > 0 || [frameIndex numberOfFrames] == 0) {
+			// without a frame index the pre-roll is guessed from the frame duration in header
+			return MADFileSplitterPolicyBase<MADDecoderAudioPlayer>::input(aStream);
+		}
+		
+		NSUInteger frame = [frameIndex frameIndexForTime:[MADDecoderProcessor timerToSeconds:processor->decodeStartTime]];
+		MP3FrameIndexEntry entry = [frameIndex entryAtIndex:MADPrerollFrameForFrame(frameIndex, bytes, length, frame)];
+		mad_timer_set(&processor->nextCurrentTime, 0, (unsigned long)entry.sampleOffset, [frameIndex samplerate]);
+		prerollStartTime = processor->nextCurrentTime;
+		hasPrerollStartTime = true;
+		
+		setBuffer(aStream, (NSUInteger)entry.byteOffset);
+		processor->currentBufferPosition = (NSUInteger)entry.byteOffset;
+		processor->frameResyncing = YES;
+		
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow header(struct mad_header const *header)
+	{
+		enum mad_flow result = Base::header(header);
+		if (result != MAD_FLOW_CONTINUE) {
+			return result;
+		}
+		
+		if (!hasPrerollStartTime) {
+			mad_timer_t preroll = header->duration;
+			mad_timer_multiply(&preroll, MADDecoderSeekPrerollFrames);
+			mad_timer_negate(&preroll);
+			prerollStartTime = processor->decodeStartTime;
+			mad_timer_add(&prerollStartTime, preroll);
+			if (mad_timer_sign(prerollStartTime) < 0) {
+				prerollStartTime = mad_timer_zero;
+			}
+			hasPrerollStartTime = true;
+		}
+		
+		if (mad_timer_compare(processor->currentTime, prerollStartTime) < 0) {
+			// we are before the pre-roll
+			return MAD_FLOW_IGNORE;
+		} else if (mad_timer_compare(processor->currentTime, processor->decodeStopTime) <= 0) {
+			// we are in the pre-roll or in play section, output drops what is before start time
+			return MAD_FLOW_CONTINUE;
+		} else {
+			// we are after play section
+			NSLog(@"stopping at %.2f", [MADDecoderProcessor timerToSeconds:processor->currentTime]);
+			return MAD_FLOW_STOP;
+		}
+	}
+	
+	enum mad_flow filter(struct mad_stream const *aStream, struct mad_frame *frame)
+	{
+		processor->frameResyncing = NO;
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow output(struct mad_header const *header, struct mad_pcm *pcm)
+	{
+		unsigned int		nsamples = pcm->length;
+		unsigned int		skipSamples = 0;
+		
+		if (mad_timer_compare(processor->currentTime, processor->decodeStartTime) < 0) {
+			// pre-roll frame, only the samples from the start time on are played
+			mad_timer_t before = processor->currentTime;
+			mad_timer_t untilStart = processor->decodeStartTime;
+			mad_timer_negate(&before);
+			mad_timer_add(&untilStart, before);
+			unsigned long samplesUntilStart = (unsigned long)mad_timer_count(untilStart, (enum mad_units)pcm->samplerate);
+			if (samplesUntilStart >= nsamples) {
+				return MAD_FLOW_CONTINUE;
+			}
+			skipSamples = (unsigned int)samplesUntilStart;
+			nsamples -= skipSamples;
+		}
+		
+		mad_fixed_t const   *left_ch = pcm->samples[0] + skipSamples;
+		mad_fixed_t const   *right_ch = pcm->samples[1] + skipSamples;
+		size_t				pcmBufLength = nsamples * MAD_NCHANNELS(header) * SAMPLE_SIZE;
+		unsigned char		*bufPtr = pcmBuf;
+		double				time = [MADDecoderProcessor timerToSeconds:processor->currentTime];
+		int					sample;
+		
+		while (nsamples--) {
+			int		overlayBeepSample = [decoder getNextOverlayedBeepSampleAtTime:time];
+			sample = ((*left_ch++) >> (MAD_F_FRACBITS + 1 - 16)) + overlayBeepSample;
+			*bufPtr++ = (sample >> 8) & 0xff;
+			*bufPtr++ = sample & 0xff;
+			if (MAD_NCHANNELS(header) == 2) {
+				sample = ((*right_ch++) >> (MAD_F_FRACBITS + 1 - 16)) + overlayBeepSample;
+				*bufPtr++ = (sample >> 8) & 0xff;
+				*bufPtr++ = sample & 0xff;
+			}
+		}
+		[decoder writePCMData:pcmBuf length:pcmBufLength];
+		
+		// playing has to stop right away, so this is checked for every frame
+		if ([decoder canContinueDecoding] == NO) {
+			NSLog(@"aborting in deocderthread");
+			return MAD_FLOW_STOP;
+		}
+		
+		return MAD_FLOW_CONTINUE;
+	}
+};
+
+
+// the levels of the frames are collected here and appended to the loudness envelope in batches.
+//
+// with the side info prescan, frames estimated to be loud are not decoded. the estimate is only a guess,
+// so the skipped frames stay pending until a decoded frame confirms them: a run of pending frames is kept
+// if the frame before it and the frame after it were decoded loud for all thresholds, and if it isn't
+// longer than the shortest duration threshold. no silence that is long enough to be reported can lie in
+// such a run, whatever its frames really sound like. a run that isn't confirmed is decoded after all, so
+// the silences come out the same as if every frame had been decoded.
+struct MADSilenceAnalyzerPolicy : MADProcessorPolicy<MADDecoderSilenceAnalyzer> {
+	uint8_t		levels[MADSilenceAnalyzerLevelBatchSize];
+	NSUInteger	numLevels;
+	int			levelsSamplesPerFrame;
+	int			levelsSamplerate;
+	bool		limitedEnvelope;
+	
+	// whether the frames were decoded, and whether their last block was loud for all thresholds
+	bool		previousDecoded;
+	bool		previousLoud;
+	bool		currentDecoded;
+	bool		currentLoud;
+	
+	// the frames that wait for a loud frame to confirm them, with their levels
+	uint8_t		pendingLevels[MADSilenceAnalyzerMaxPendingFrames];
+	NSUInteger	numPending;
+	NSUInteger	pendingStartOffset;
+	mad_timer_t	pendingStartTime;
+	
+	// after going back to a pending run, the frames before it only fill the bit reservoir again,
+	// and no frame is skipped up to the one we went back from
+	NSUInteger	rewindOffset;
+	mad_timer_t	rewindTime;
+	NSUInteger	verifyEndOffset;
+	
+	// with the read and uring sources the section is read in chunks instead of decoded from the mapping.
+	// as in the engine, what libmad hasn't consumed yet stays at the front of the window and the next
+	// chunk is appended to it, together with the bytes a pending run may have to be decoded from again.
+	MP3InputReader	*reader;
+	uint8_t		*window;
+	NSUInteger	windowOffset;		// where the window starts in the file
+	NSUInteger	windowLength;
+	NSUInteger	windowCapacity;
+	
+	MADSilenceAnalyzerPolicy(MADDecoderSilenceAnalyzer *aProcessor) : MADProcessorPolicy<MADDecoderSilenceAnalyzer>(aProcessor)
+	{
+		numLevels = 0;
+		levelsSamplesPerFrame = 0;
+		levelsSamplerate = 0;
+		limitedEnvelope = false;
+		previousDecoded = false;
+		previousLoud = false;
+		currentDecoded = false;
+		currentLoud = false;
+		numPending = 0;
+		pendingStartOffset = 0;
+		pendingStartTime = mad_timer_zero;
+		rewindOffset = 0;
+		rewindTime = mad_timer_zero;
+		verifyEndOffset = 0;
+		reader = NULL;
+		window = NULL;
+		windowOffset = 0;
+		windowLength = 0;
+		windowCapacity = 0;
+	}
+	
+	~MADSilenceAnalyzerPolicy()
+	{
+		MP3InputReaderDestroy(reader);
+		free(window);
+	}
+	
+	// the bytes at offset that are in memory, up to the end of the mapping or of the window
+	const uint8_t *bytesAtOffset(NSUInteger offset, NSUInteger *available)
+	{
+		if (reader == NULL) {
+			*available = (offset < length) ? (length - offset) : 0;
+			return bytes + offset;
+		}
+		if (offset < windowOffset || offset >= windowOffset + windowLength) {
+			*available = 0;
+			return NULL;
+		}
+		*available = windowOffset + windowLength - offset;
+		return window + (offset - windowOffset);
+	}
+	
+	// where to start decoding to have the bit reservoir filled at offset
+	NSUInteger prerollOffsetFor(NSUInteger offset)
+	{
+		if (reader == NULL) {
+			return MP3FramePrerollOffset(bytes, length, offset, MP3FramePrerollBytes);
+		}
+		if (offset < windowOffset || offset > windowOffset + windowLength) {
+			return offset;
+		}
+		return windowOffset + MP3FramePrerollOffset(window, windowLength, offset - windowOffset, MP3FramePrerollBytes);
+	}
+	
+	void setBufferAtOffset(struct mad_stream *aStream, NSUInteger offset)
+	{
+		if (reader == NULL) {
+			setBuffer(aStream, offset);
+			return;
+		}
+		
+		// a section that is empty or too short leaves nothing to decode
+		offset = MIN(MAX(offset, windowOffset), windowOffset + windowLength);
+		stream = aStream;
+		buffer = window + (offset - windowOffset);
+		bufferOffset = offset;
+		mad_stream_buffer(stream, buffer, windowOffset + windowLength - offset);
+	}
+	
+	// keeps what libmad hasn't consumed and the bytes a pending run may go back to, and appends the next
+	// chunk of the reader. returns the length of the chunk, 0 at the end of the section, or -1 with errno set.
+	long refillWindow(struct mad_stream *aStream)
+	{
+		NSUInteger resumeOffset = (aStream->next_frame != NULL) ? byteOffsetOf(aStream->next_frame) : windowOffset;
+		NSUInteger keepOffset = resumeOffset;
+		if (numPending > 0 && pendingStartOffset < keepOffset + MP3FramePrerollBytes) {
+			keepOffset = (pendingStartOffset > MP3FramePrerollBytes) ? (pendingStartOffset - MP3FramePrerollBytes) : 0;
+		}
+		keepOffset = MIN(MAX(keepOffset, windowOffset), windowOffset + windowLength);
+		
+		windowLength = windowOffset + windowLength - keepOffset;
+		memmove(window, window + (keepOffset - windowOffset), windowLength);
+		windowOffset = keepOffset;
+		
+		long chunkLength = 0;
+		if (windowLength + MP3InputReaderChunkSize > windowCapacity) {
+			uint8_t *newWindow = (uint8_t *) realloc(window, windowLength + MP3InputReaderChunkSize);
+			if (newWindow == NULL) {
+				errno = ENOMEM;
+				chunkLength = -1;
+			} else {
+				window = newWindow;
+				windowCapacity = windowLength + MP3InputReaderChunkSize;
+			}
+		}
+		if (chunkLength == 0) {
+			chunkLength = MP3InputReaderRead(reader, window + windowLength);
+		}
+		if (chunkLength > 0) {
+			windowLength += chunkLength;
+		}
+		
+		// the stream goes on where it stopped, libmad keeps its bit reservoir over the new buffer
+		setBufferAtOffset(aStream, resumeOffset);
+		return chunkLength;
+	}
+	
+	void flushLevels()
+	{
+		if (numLevels > 0) {
+			[processor->loudnessEnvelope appendLevels:levels count:numLevels samplesPerFrame:levelsSamplesPerFrame samplerate:levelsSamplerate];
+			numLevels = 0;
+		}
+	}
+	
+	void appendLevel(uint8_t level, int samplesPerFrame, int rate)
+	{
+		if (numLevels == MADSilenceAnalyzerLevelBatchSize || samplesPerFrame != levelsSamplesPerFrame || rate != levelsSamplerate) {
+			flushLevels();
+			levelsSamplesPerFrame = samplesPerFrame;
+			levelsSamplerate = rate;
+		}
+		levels[numLevels++] = level;
+	}
+	
+	// the level of the frame we are at, which is the last one appended or the last pending one
+	void setLastLevel(uint8_t level)
+	{
+		if (numPending > 0) {
+			pendingLevels[numPending - 1] = level;
+		} else if (numLevels > 0) {
+			levels[numLevels - 1] = level;
+		}
+	}
+	
+	void addPendingFrame(uint8_t level)
+	{
+		if (numPending == 0) {
+			pendingStartOffset = processor->currentBufferPosition;
+			pendingStartTime = processor->currentTime;
+		}
+		pendingLevels[numPending++] = level;
+	}
+	
+	// the pending frames stay as they are, the levels of the skipped ones are only estimates
+	void confirmPendingFrames(struct mad_header const *header)
+	{
+		for (NSUInteger i = 0; i < numPending; i++) {
+			appendLevel(pendingLevels[i], 32 * MAD_NSBSAMPLES(header), header->samplerate);
+		}
+		numPending = 0;
+	}
+	
+	// decodes the pending frames after all, starting far enough before them to fill the bit reservoir
+	enum mad_flow rewindPendingFrames()
+	{
+		verifyEndOffset = processor->currentBufferPosition;
+		rewindOffset = pendingStartOffset;
+		rewindTime = pendingStartTime;
+		numPending = 0;
+		currentDecoded = false;
+		currentLoud = false;
+		
+		processor->nextCurrentTime = pendingStartTime;
+		setBufferAtOffset(stream, prerollOffsetFor(pendingStartOffset));
+		stream->md_len = 0;
+		
+		return MAD_FLOW_IGNORE;
+	}
+	
+	void recordSeekPoint()
+	{
+		// one pointer into the buffer every 30 seconds
+		mad_timer_t currentTime = processor->currentTime;
+		if ((currentTime.seconds - processor->seekIndexLastSecond) > 30 && processor->seekIndexLastSecond < currentTime.seconds) {
+			[processor addSeekPointAtOffset:processor->currentBufferPosition time:currentTime];
+			processor->seekIndexLastSecond = currentTime.seconds;
+		}
+	}
+	
+	// the estimated volume of the frame at offset if its side info can be read, -1 otherwise
+	double estimatedVolumeOfFrameAtOffset(NSUInteger offset, MP3FrameHeader *frameHeader, MP3SideInfo *sideInfo)
+	{
+		NSUInteger available;
+		const uint8_t *frameBytes = bytesAtOffset(offset, &available);
+		if (available == 0 ||
+			!MP3FrameHeaderParse(frameBytes, available, frameHeader) ||
+			!MP3SideInfoParse(frameBytes, available, frameHeader, sideInfo)) {
+			return -1.0;
+		}
+		
+		return MP3SideInfoEstimateVolume(frameHeader, sideInfo);
+	}
+	
+	// a frame can be skipped if it is certainly loud and none of the undecided frames after it takes
+	// main data from it or from the frame right after it. skipping a frame leaves the bit reservoir
+	// stale, so it is thrown away and the frames before an undecided one are decoded to refill it.
+	bool canSkipCurrentFrame()
+	{
+		MP3FrameHeader frameHeader;
+		MP3SideInfo sideInfo;
+		double loudVolume = processor->silenceVolumeThreshold * MP3SideInfoLoudnessMargin;
+		
+		processor->estimatedVolume = estimatedVolumeOfFrameAtOffset(processor->currentBufferPosition, &frameHeader, &sideInfo);
+		processor->estimatedLoud = (processor->estimatedVolume > loudVolume);
+		if (!processor->estimatedLoud) {
+			return false;
+		}
+		
+		// the run has to stay within the shortest duration threshold, together with the frames that refill
+		// the bit reservoir after it and the first one of them that decodes
+		unsigned int capacity = MP3SideInfoMainDataCapacity(&frameHeader);
+		NSUInteger runFrames = numPending + 1 + ((capacity > 0) ? (MP3SideInfoMaxMainDataBegin + capacity - 1) / capacity : 1) + 1;
+		double frameSeconds = (double)frameHeader.samplesPerFrame / frameHeader.samplerate;
+		if (runFrames >= MADSilenceAnalyzerMaxPendingFrames || runFrames * frameSeconds > processor->minDurationThreshold) {
+			return false;
+		}
+		
+		NSUInteger offset = processor->currentBufferPosition + frameHeader.frameLength;
+		NSUInteger mainDataBetween = 0;
+		for (int i = 0; mainDataBetween < MP3SideInfoMaxMainDataBegin; i++) {
+			MP3FrameHeader nextHeader;
+			MP3SideInfo nextSideInfo;
+			double volume = estimatedVolumeOfFrameAtOffset(offset, &nextHeader, &nextSideInfo);
+			if (volume < 0.0) {
+				// end of data, beyond the window, or something we can't read, libmad will sort it out
+				return (offset >= length);
+			}
+			if (volume <= loudVolume && (i == 0 || nextSideInfo.mainDataBegin > mainDataBetween)) {
+				return false;
+			}
+			if (i > 0) {
+				mainDataBetween += nextSideInfo.mainDataSize;
+			}
+			offset += nextHeader.frameLength;
+		}
+		
+		return true;
+	}
+	
+	enum mad_flow skipCurrentFrame()
+	{
+		addPendingFrame(LoudnessEnvelopeLevelForVolume((unsigned long)processor->estimatedVolume));
+		
+		// the envelope only knows the skipped frames are loud enough for our thresholds, and that
+		// they don't hide silences as long as the shortest duration threshold
+		if (!limitedEnvelope) {
+			[processor->loudnessEnvelope limitVolumeThreshold:(int)processor->silenceVolumeThreshold];
+			[processor->loudnessEnvelope limitDurationThreshold:processor->minDurationThreshold];
+			limitedEnvelope = true;
+		}
+		
+		stream->md_len = 0;
+		return MAD_FLOW_IGNORE;
+	}
+	
+	enum mad_flow playSectionFrame(struct mad_header const *header)
+	{
+		int samplesPerFrame = 32 * MAD_NSBSAMPLES(header);
+		if (processor->loudnessEnvelope == nil) {
+			processor->loudnessEnvelope = [[LoudnessEnvelope alloc] initWithSamplesPerFrame:samplesPerFrame samplerate:header->samplerate];
+		}
+		recordSeekPoint();
+		
+		previousDecoded = currentDecoded;
+		previousLoud = currentLoud;
+		currentDecoded = false;
+		currentLoud = false;
+		
+		if (numPending == MADSilenceAnalyzerMaxPendingFrames) {
+			return rewindPendingFrames();
+		}
+		
+		processor->estimatedLoud = NO;
+		if (processor->usesSideInfoPrescan && processor->currentBufferPosition > verifyEndOffset &&
+			(numPending > 0 || previousLoud) && canSkipCurrentFrame()) {
+			return skipCurrentFrame();
+		}
+		
+		if (numPending > 0) {
+			addPendingFrame(LoudnessEnvelopeUnknownLevel);
+		} else {
+			appendLevel(LoudnessEnvelopeUnknownLevel, samplesPerFrame, header->samplerate);
+		}
+		
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	// subband sample slots per block of the silence resolution, 0 for one volume per frame
+	int slotsPerBlock()
+	{
+		switch (processor->silenceResolution) {
+			case MADSilenceResolutionGranule:
+				return 18;
+			case MADSilenceResolutionBlock:
+				return 1;
+			default:
+				return 0;
+		}
+	}
+	
+	void trackBlocksOfFrame(struct mad_frame *frame, const unsigned long *blockVolumes, int numBlocks)
+	{
+		for (NSUInteger i = 0; i < processor->numSilenceTrackers; i++) {
+			MADSilenceTrackerAddBlocks(&processor->silenceTrackers[i], blockVolumes, numBlocks,
+									   slotsPerBlock() * 32, frame->header.samplerate, processor->currentTime);
+		}
+	}
+	
+	enum mad_flow input(struct mad_stream *aStream)
+	{
+		if (reader != NULL || processor->currentBufferPosition > 0) {
+			long chunkLength = (reader != NULL) ? refillWindow(aStream) : 0;
+			if (chunkLength < 0) {
+				NSLog(@"could not read the section at byte offset %lu: %s", (unsigned long) (windowOffset + windowLength), strerror(errno));
+				return MAD_FLOW_BREAK;
+			}
+			if (chunkLength > 0) {
+				return MAD_FLOW_CONTINUE;
+			}
+			if (numPending > 0) {
+				// the frames at the end of the data have nothing after them to confirm them
+				rewindPendingFrames();
+				verifyEndOffset = NSUIntegerMax;
+				return MAD_FLOW_CONTINUE;
+			}
+			return MAD_FLOW_STOP;
+		}
+		
+		// start at our own byte offset instead of walking all headers from the beginning of the file,
+		// decoding a few frames before it to fill the bit reservoir
+		processor->prerollByteOffset = 0;
+		bool seeksStart = (processor->useDecodeStartStopByteOffsets && processor->decodeStartByteOffset > 0);
+		const MP3InputSource *source = [decoder inputSource];
+		if (source != NULL && source->type != MP3InputSourceMapped) {
+			NSUInteger readStart = (seeksStart && processor->decodeStartByteOffset > MP3FramePrerollBytes) ? (processor->decodeStartByteOffset - MP3FramePrerollBytes) : 0;
+			reader = MP3InputReaderCreate(source, readStart, [processor inputAdviceEndOffset]);
+			if (reader == NULL) {
+				NSLog(@"could not read the section, decoding it from the mapping: %s", strerror(errno));
+			} else {
+				windowOffset = readStart;
+				if (refillWindow(aStream) < 0) {
+					NSLog(@"could not read the section at byte offset %lu: %s", (unsigned long) readStart, strerror(errno));
+					return MAD_FLOW_BREAK;
+				}
+			}
+		}
+		if (seeksStart) {
+			processor->prerollByteOffset = prerollOffsetFor(processor->decodeStartByteOffset);
+		}
+		
+		setBufferAtOffset(aStream, processor->prerollByteOffset);
+		mad_stream_options(aStream, MAD_OPTION_HALFSAMPLERATE);
+		processor->currentBufferPosition = processor->prerollByteOffset;
+		[processor startInputAdvice];
+		
+		return MAD_FLOW_CONTINUE;
+	}
+	
+	enum mad_flow header(struct mad_header const *header)
+	{
+		enum mad_flow result = MADProcessorPolicy<MADDecoderSilenceAnalyzer>::header(header);
+		if (result != MAD_FLOW_CONTINUE) {
+			return result;
+		}
+		if (checkDue && [decoder canContinueDecoding] == NO) {
+			return MAD_FLOW_BREAK;
+		}
+		if (processor->currentBufferPosition >= processor->nextAdviceOffset) {
+			[processor adviseInputAtOffset:processor->currentBufferPosition];
+		}
+		
+		if (processor->currentBufferPosition < rewindOffset) {
+			// refilling the bit reservoir for a pending run, its time is known already
+			processor->prerolling = YES;
+			processor->nextCurrentTime = rewindTime;
+			return MAD_FLOW_CONTINUE;
+		}
+		processor->prerolling = NO;
+		
+		if (processor->useDecodeStartStopByteOffsets) {
+			if (processor->currentBufferPosition < processor->decodeStartByteOffset) {
+				// pre-roll frame: decode it for the bit reservoir, but our time only starts at the first real frame
+				processor->prerolling = YES;
+				processor->nextCurrentTime = mad_timer_zero;
+				return MAD_FLOW_CONTINUE;
+			}
+			
+			if (processor->currentBufferPosition < processor->decodeStopByteOffset) {
+				// we are in play section
+				return playSectionFrame(header);
+			} else if (numPending > 0) {
+				// the next section can't confirm our pending frames
+				return rewindPendingFrames();
+			} else {
+				// we are after play section, this frame already belongs to the next section
+				processor->nextCurrentTime = processor->currentTime;
+				return MAD_FLOW_STOP;
+			}
+		}
+		
+		if (mad_timer_compare(processor->currentTime, processor->decodeStartTime) < 0) {
+			// we are before start time
+			return MAD_FLOW_IGNORE;
+		} else {
+			// we are after start time
+			if (mad_timer_compare(processor->currentTime, processor->decodeStopTime) <= 0) {
+				// we are in play section
+				return playSectionFrame(header);
+			} else if (numPending > 0) {
+				return rewindPendingFrames();
+			} else {
+				// we are after play section
+				return MAD_FLOW_STOP;
+			}
+		}
+	}
+	
+	enum mad_flow filter(struct mad_stream const *aStream, struct mad_frame *frame)
+	{
+		if (processor->prerolling) {
+			return MAD_FLOW_IGNORE;
+		}
+		
+		unsigned long blockVolumes[MADEnergyMaxBlocksPerFrame];
+		unsigned long avg;
+		int numBlocks = MADEnergyFrameVolumes(frame, slotsPerBlock(), blockVolumes, &avg);
+		setLastLevel(LoudnessEnvelopeLevelForVolume(avg));
+		currentDecoded = true;
+		
+		if (numPending > 0) {
+			if (!previousDecoded) {
+				// the overlap from the frame before is missing, so this frame can't confirm anything yet
+				return MAD_FLOW_IGNORE;
+			}
+			
+			double pendingSeconds = [MADDecoderProcessor timerToSeconds:processor->currentTime] - [MADDecoderProcessor timerToSeconds:pendingStartTime];
+			if (blockVolumes[0] > (unsigned long)processor->silenceVolumeThreshold && pendingSeconds <= processor->minDurationThreshold) {
+				confirmPendingFrames(&frame->header);
+			} else {
+				return rewindPendingFrames();
+			}
+		}
+		
+		// check silence hints, the decoder stitches the sections together and checks the durations
+		trackBlocksOfFrame(frame, blockVolumes, numBlocks);
+		currentLoud = (blockVolumes[numBlocks - 1] > (unsigned long)processor->silenceVolumeThreshold);
+		
+		return MAD_FLOW_IGNORE;
+	}
+	
+	enum mad_flow error(struct mad_stream *aStream, struct mad_frame *frame)
+	{
+		switch (aStream->error) {
+			case MAD_ERROR_BADDATAPTR:
+			case MAD_ERROR_BADHUFFDATA:
+				// this type of error can happen often, because we are skimming the file
+				return MAD_FLOW_CONTINUE;
+				
+			default:
+				return MADProcessorPolicy<MADDecoderSilenceAnalyzer>::error(aStream, frame);
+		}
+	}
+};
+
+
+#pragma mark -
+
+
+@implementation MADDecoderProcessor
+
++ (double)timerToSeconds:(mad_timer_t)timer
+{
+	return mad_timer_count(timer, MAD_UNITS_MILLISECONDS) / 1000.0;
+}
+
++ (mad_timer_t)secondsToTimer:(double)secs
+{
+	// microseconds, so a start time can be found to the sample
+	mad_timer_t		timer;
+	unsigned long   s = (unsigned long)secs;
+	unsigned long   us = (unsigned long)((secs - s) * 1000000.0);
+	mad_timer_set(&timer, s, us, 1000000);
+	return timer;
+}
+
++ (void)setUsesCallbackDecodeLoop:(BOOL)flag
+{
+	usesCallbackDecodeLoop = flag;
+}
+
++ (BOOL)usesCallbackDecodeLoop
+{
+	return usesCallbackDecodeLoop;
+}
+
+
+#pragma mark -
+
+
+- (id)initWithDecoder:(MADDecoder *)aDecoder startTime:(double)start endTime:(double)end;
+{
+	if (self = [super init]) {
+		decoder = [aDecoder retain];
+		
+		decodeStartTime = [MADDecoderProcessor secondsToTimer:start];
+		decodeStopTime = [MADDecoderProcessor secondsToTimer:end];
+		
+		[self reset];
+	}
+	
+	return self;
+}
+
+- (void)reset
+{
+	currentBufferPosition = 0;
+	
+	currentTime = mad_timer_zero;
+	nextCurrentTime = mad_timer_zero;
+	
+	badFrameCount = 0;
+	maxBadFrameCount = 500;
+	frameResyncing = NO;
+}
+
+- (void)dealloc
+{
+	[decoder release];
+	[super dealloc];
+}
+
+- (NSUInteger)currentBufferPosition
+{
+	return currentBufferPosition;
+}
+
+- (double)currentTime
+{
+	return [MADDecoderProcessor timerToSeconds:currentTime];
+}
+
+- (int)runDecoder
+{
+	MADProcessorPolicy<MADDecoderProcessor> policy(self);
+	return MADProcessorRunPolicy(policy);
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MADDecoderFileAnalyzer
+
+- (int)runDecoder
+{
+	MADFileAnalyzerPolicy policy(self);
+	return MADProcessorRunPolicy(policy);
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MADDecoderFileSplitter
+
+- (void)reset
+{
+	[super reset];
+	splitFile = nil;
+}
+
+- (void)dealloc
+{
+	[splitFile release];
+	[super dealloc];
+}
+
+- (void)setSplitFile:(NSFileHandle *)file
+{
+	splitFile = [file retain];
+}
+
+- (int)runDecoder
+{
+	MADFileSplitterPolicy policy(self);
+	return MADProcessorRunPolicy(policy);
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MADDecoderAudioPlayer
+
+- (int)runDecoder
+{
+	MADAudioPlayerPolicy policy(self);
+	return MADProcessorRunPolicy(policy);
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MADDecoderSilenceAnalyzer
+
+- (id)initWithDecoder:(MADDecoder *)aDecoder startByteOffset:(NSUInteger)start endByteOffset:(NSUInteger)end
+{
+	if (self = [super initWithDecoder:aDecoder startTime:0.0 endTime:0.0]) {
+		useDecodeStartStopByteOffsets = YES;
+		decodeStartByteOffset = start;
+		decodeStopByteOffset = end;
+		
+		[self reset];
+	}
+	
+	return self;
+}
+
+- (void)reset
+{
+	[super reset];
+	
+	for (NSUInteger i = 0; i < numSilenceTrackers; i++) {
+		MADSilenceTrackerReset(&silenceTrackers[i]);
+	}
+	[loudnessEnvelope release];
+	loudnessEnvelope = nil;
+	prerolling = NO;
+	estimatedLoud = NO;
+	seekIndexLastSecond = -1;
+	prefetchReader = -1;
+	
+	numSeekPoints = 0;
+}
+
+- (void)dealloc
+{
+	for (NSUInteger i = 0; i < numSilenceTrackers; i++) {
+		MADSilenceTrackerFinish(&silenceTrackers[i]);
+	}
+	if (silenceTrackers != NULL) {
+		free(silenceTrackers);
+		silenceTrackers = NULL;
+	}
+	if (silenceThresholds != NULL) {
+		free(silenceThresholds);
+		silenceThresholds = NULL;
+	}
+	[loudnessEnvelope release];
+	if (seekPoints != NULL) {
+		free(seekPoints);
+		seekPoints = NULL;
+	}
+	
+	[super dealloc];
+}
+
+- (int)runDecoder
+{
+	MADSilenceAnalyzerPolicy policy(self);
+	int result = MADProcessorRunPolicy(policy);
+	policy.flushLevels();
+	[self finishInputAdvice];
+	return result;
+}
+
+- (void)setSilenceThresholds:(const MADSilenceThresholds *)thresholds count:(NSUInteger)count
+{
+	for (NSUInteger i = 0; i < numSilenceTrackers; i++) {
+		MADSilenceTrackerFinish(&silenceTrackers[i]);
+	}
+	
+	numSilenceTrackers = count;
+	silenceThresholds = (MADSilenceThresholds *) realloc(silenceThresholds, count * sizeof(MADSilenceThresholds));
+	silenceTrackers = (MADSilenceTracker *) realloc(silenceTrackers, count * sizeof(MADSilenceTracker));
+	memcpy(silenceThresholds, thresholds, count * sizeof(MADSilenceThresholds));
+	
+	silenceVolumeThreshold = 0;
+	minDurationThreshold = (count > 0) ? thresholds[0].durationThreshold : 0.0;
+	for (NSUInteger i = 0; i < count; i++) {
+		MADSilenceTrackerInit(&silenceTrackers[i], thresholds[i].volumeThreshold);
+		silenceVolumeThreshold = MAX(silenceVolumeThreshold, thresholds[i].volumeThreshold);
+		minDurationThreshold = MIN(minDurationThreshold, thresholds[i].durationThreshold);
+	}
+}
+
+- (void)setSilenceResolution:(MADSilenceResolution)resolution
+{
+	silenceResolution = resolution;
+}
+
+- (void)setUsesSideInfoPrescan:(BOOL)flag
+{
+	usesSideInfoPrescan = flag;
+}
+
+- (NSUInteger)decodeStartByteOffset
+{
+	return decodeStartByteOffset;
+}
+
+- (mad_timer_t)decodedDuration
+{
+	return nextCurrentTime;
+}
+
+- (NSUInteger)numberOfSilenceTrackers
+{
+	return numSilenceTrackers;
+}
+
+- (const MADSilenceTracker *)silenceTrackerAtIndex:(NSUInteger)index
+{
+	return &silenceTrackers[index];
+}
+
+- (LoudnessEnvelope *)loudnessEnvelope
+{
+	return loudnessEnvelope;
+}
+
+- (NSUInteger)numberOfSeekPoints
+{
+	return numSeekPoints;
+}
+
+- (const MADDecoderSeekPoint *)seekPoints
+{
+	return seekPoints;
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MADDecoderSilenceAnalyzer (Private)
+
+- (void)addSeekPointAtOffset:(NSUInteger)offset time:(mad_timer_t)time
+{
+	if (numSeekPoints + 1 >= allocedSeekPoints) {
+		allocedSeekPoints = (allocedSeekPoints > 0) ? (allocedSeekPoints * 2) : 64;
+		seekPoints = (MADDecoderSeekPoint *) realloc(seekPoints, allocedSeekPoints * sizeof(MADDecoderSeekPoint));
+	}
+	
+	seekPoints[numSeekPoints].time = time;
+	seekPoints[numSeekPoints].byteOffset = offset;
+	numSeekPoints++;
+}
+
+- (NSUInteger)inputAdviceEndOffset
+{
+	NSUInteger end = [[decoder mp3Data] length];
+	if (useDecodeStartStopByteOffsets && decodeStopByteOffset + MADDecoderReadaheadStep < end) {
+		// the frame crossing the stop offset is still read
+		end = decodeStopByteOffset + MADDecoderReadaheadStep;
+	}
+	return end;
+}
+
+- (void)startInputAdvice
+{
+	const MP3InputSource *source = [decoder inputSource];
+	NSUInteger end = [self inputAdviceEndOffset];
+	
+	nextAdviceOffset = currentBufferPosition;
+	releasedOffset = currentBufferPosition;
+	prefetchReader = -1;
+	if (source == NULL || source->type != MP3InputSourceMapped) {
+		// keeps the decode loop from asking again, the readers of the other sources don't touch the mapping
+		nextAdviceOffset = NSUIntegerMax;
+		return;
+	}
+	
+	MP3InputSourceAdvise(source, currentBufferPosition, end - currentBufferPosition, MP3InputSourceAdviceSequential);
+	prefetchReader = MP3InputPrefetcherAddReader([decoder inputPrefetcher], currentBufferPosition, end);
+}
+
+// called by the decode loop once it has reached nextAdviceOffset
+- (void)adviseInputAtOffset:(NSUInteger)offset
+{
+	const MP3InputSource *source = [decoder inputSource];
+	
+	if (source == NULL || offset < nextAdviceOffset) {
+		return;
+	}
+	nextAdviceOffset = offset + MADDecoderReadaheadStep;
+	
+	NSUInteger end = [self inputAdviceEndOffset];
+	if (offset < end) {
+		MP3InputSourceAdvise(source, offset, MIN(MADDecoderReadaheadDistance, end - offset), MP3InputSourceAdviceWillNeed);
+	}
+	MP3InputPrefetcherUpdateReader([decoder inputPrefetcher], prefetchReader, offset);
+	
+	// a step behind us is safely past the bit reservoir and the frames the side info prescan looked at
+	if (offset > releasedOffset + 2 * MADDecoderReadaheadStep) {
+		MP3InputSourceAdvise(source, releasedOffset, offset - MADDecoderReadaheadStep - releasedOffset, MP3InputSourceAdviceDontNeed);
+		releasedOffset = offset - MADDecoderReadaheadStep;
+	}
+}
+
+- (void)finishInputAdvice
+{
+	MP3InputPrefetcherRemoveReader([decoder inputPrefetcher], prefetchReader);
+	prefetchReader = -1;
+}
+
+@end
+
+
+#pragma mark -
+
+
+template <class Policy>
+static int
+MADProcessorRunPolicy(Policy &policy)
+{
+	if (usesCallbackDecodeLoop) {
+		return MADDecodeLoopRunWithCallbacks(policy);
+	}
+	
+	struct mad_stream	stream;
+	struct mad_frame	frame;
+	struct mad_synth	synth;
+	return MADDecodeLoopRun(policy, &stream, &frame, &synth);
+}
+
+
+// the frame to start decoding at for the given frame. the frame before it has to be decoded completely,
+// so the overlap of its second granule is there, and for that all the main data it reaches back to
+// with main_data_begin has to be in the bit reservoir. a frame that reaches back further than we
+// can see is only stepped over, as libmad does it after resyncing.
+static NSUInteger
+MADPrerollFrameForFrame(MP3FrameIndex *frameIndex, const uint8_t *bytes, NSUInteger length, NSUInteger frame)
+{
+	if (frame == 0) {
+		return 0;
+	}
+	
+	NSUInteger first = frame - 1;
+	NSUInteger offset = (NSUInteger)[frameIndex entryAtIndex:first].byteOffset;
+	MP3FrameHeader header;
+	MP3SideInfo sideInfo;
+	if (offset >= length || !MP3FrameHeaderParse(bytes + offset, length - offset, &header) ||
+		!MP3SideInfoParse(bytes + offset, length - offset, &header, &sideInfo)) {
+		return first;
+	}
+	
+	unsigned int needed = sideInfo.mainDataBegin;
+	while (needed > 0 && first > 0) {
+		first--;
+		offset = (NSUInteger)[frameIndex entryAtIndex:first].byteOffset;
+		if (offset >= length || !MP3FrameHeaderParse(bytes + offset, length - offset, &header)) {
+			break;
+		}
+		unsigned int capacity = MP3SideInfoMainDataCapacity(&header);
+		needed = (capacity < needed) ? (needed - capacity) : 0;
+	}
+	
+	return first;
+}
@@ -21,17 +21,35 @@
 //  along with AudioSlicer; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
 
-#import <Cocoa/Cocoa.h>
+#import <Foundation/Foundation.h>
 #import <pthread.h>
 
 #import "MADDecoder.h"
 #import "MADDecoderProcessor.h"
+#import "MADWorkStealingPool.h"
+
+// the file is analyzed in chunks of about this size, which are scheduled on a work stealing pool
+#define MADDecoderThreadedChunkSize		(4 * 1024 * 1024)
+
+// each processor stores its progress in a slot of its own cache line, so that the processors
+// running on different cores don't keep stealing the line from each other
+#define MADDecoderThreadedCacheLineSize	64
+
+// user default to run a thread that faults the pages of a mapped file in ahead of the analyzers
+#define MADDecoderThreadedPrefetchKey		@"InputPrefetch"
+
+typedef struct {
+	uint64_t	bytesDecoded;
+	uint8_t		padding[MADDecoderThreadedCacheLineSize - sizeof(uint64_t)];
+} MADDecoderProgressSlot;
 
 @interface MADDecoderThreaded : MADDecoder {
 	NSUInteger					numProcessors;
 	MADDecoderSilenceAnalyzer	**processors;
-	pthread_t					*processorThreads;
-	double						*progressValues;
+	MADDecoderProgressSlot		*progressSlots;
+	NSUInteger					numProgressSlots;		// only set while the slots are in use
+	pthread_key_t				processorIndexKey;
+	MADWorkPriority				analysisPriority;
 	
 	NSLock						*syncLock;
 }
@@ -22,11 +22,13 @@
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
 
 #import "MADDecoderThreaded.h"
+#import "MP3FrameHeader.h"
 
-#include <sys/types.h>
-#include <sys/sysctl.h>
+static int runProcessorTask(void *decoder, NSUInteger processorIndex);
 
-static void *runProcessorThreaded(void *processor);
+@interface MADDecoderThreaded (Private)
+- (int)runProcessorAtIndex:(NSUInteger)index;
+@end
 
 @implementation MADDecoderThreaded
 
@@ -35,8 +37,10 @@ static void *runProcessorThreaded(void *processor);
 	if (self = [super initWithAudioFile:anAudioFile]) {
 		numProcessors = 0;
 		processors = NULL;
-		processorThreads = NULL;
-		progressValues = NULL;
+		progressSlots = NULL;
+		numProgressSlots = 0;
+		pthread_key_create(&processorIndexKey, NULL);
+		analysisPriority = MADWorkPriorityNormal;
 		
 		syncLock = [[NSLock alloc] init];
 	}
@@ -50,14 +54,11 @@ static void *runProcessorThreaded(void *processor);
 		free(processors);
 		processors = NULL;
 	}
-	if (processorThreads != NULL) {
-		free(processorThreads);
-		processorThreads = NULL;
-	}
-	if (progressValues != NULL) {
-		free(progressValues);
-		progressValues = NULL;
+	if (progressSlots != NULL) {
+		free(progressSlots);
+		progressSlots = NULL;
 	}
+	pthread_key_delete(processorIndexKey);
 	
 	[syncLock release];
 	
@@ -68,61 +69,84 @@ static void *runProcessorThreaded(void *processor);
 #pragma mark -
 
 
-- (int)analyzeSilencesWithVolumeThreshold:(int)volumeThreshold durationThreshold:(double)durationThreshold
+- (int)analyzeSilencesWithThresholds:(const MADSilenceThresholds *)thresholds count:(NSUInteger)count silences:(NSArray **)silenceLists
 {
-	// set up the processors
-	numProcessors = [self numProcessorCores];
-	processors = (MADDecoderSilenceAnalyzer **) malloc(sizeof(MADDecoderSilenceAnalyzer *) * numProcessors);
-	processorThreads = (pthread_t *) malloc(sizeof(pthread_t) * numProcessors);
-	progressValues = (double *) malloc(sizeof(double) * numProcessors);
+	MADWorkStealingPool *pool = [MADWorkStealingPool sharedPool];
 	
-	// split up the work among the processors
-	for (NSUInteger i = 0; i < numProcessors; i++) {
-		NSUInteger start = (([mp3Data length] / numProcessors) * i);
-		NSUInteger end = start + ([mp3Data length] / numProcessors);
-		processors[i] = [[MADDecoderSilenceAnalyzer alloc] initWithDecoder:self startByteOffset:start endByteOffset:end];
-		[processors[i] setSilenceVolumeThreshold:volumeThreshold];
-		[processors[i] setSilenceDurationThreshold:durationThreshold];
-		progressValues[i] = 0.0;
+	// split the file into many small chunks, so that workers which run through cheap parts of the file
+	// can help out with the expensive ones. each chunk starts on a frame header, so that every processor
+	// can start decoding right at its own offset.
+	const uint8_t *bytes = [mp3Data bytes];
+	NSUInteger length = [mp3Data length];
+	numProcessors = MAX(length / MADDecoderThreadedChunkSize, [pool numberOfWorkers]);
+	NSUInteger *boundaries = (NSUInteger *) malloc(sizeof(NSUInteger) * (numProcessors + 1));
+	boundaries[0] = 0;
+	boundaries[numProcessors] = length;
+	for (NSUInteger i = 1; i < numProcessors; i++) {
+		if ([frameIndex numberOfFrames] > 0) {
+			// exact partition points from the frame index
+			NSUInteger frame = [frameIndex frameIndexForSample:(([frameIndex numberOfSamples] * i) / numProcessors)];
+			boundaries[i] = [frameIndex byteOffsetOfFrameAtIndex:frame];
+		} else {
+			boundaries[i] = MP3FrameSync(bytes, length, (NSUInteger)(((unsigned long long)length * i) / numProcessors));
+		}
+		if (boundaries[i] < boundaries[i - 1]) {
+			boundaries[i] = boundaries[i - 1];
+		}
 	}
 	
-	// run all processors
+	processors = (MADDecoderSilenceAnalyzer **) malloc(sizeof(MADDecoderSilenceAnalyzer *) * numProcessors);
+	if (progressSlots != NULL) {
+		free(progressSlots);
+	}
+	if (posix_memalign((void **)&progressSlots, MADDecoderThreadedCacheLineSize, sizeof(MADDecoderProgressSlot) * numProcessors) != 0) {
+		progressSlots = NULL;
+	}
 	for (NSUInteger i = 0; i < numProcessors; i++) {
-		int err = pthread_create(&(processorThreads[i]), NULL, runProcessorThreaded, processors[i]);
-		if (err < 0) {
-			NSLog(@"failed to create thread %ld for silence processor", (long)i);
+		processors[i] = [[MADDecoderSilenceAnalyzer alloc] initWithDecoder:self startByteOffset:boundaries[i] endByteOffset:boundaries[i + 1]];
+		[processors[i] setSilenceThresholds:thresholds count:count];
+		[processors[i] setUsesSideInfoPrescan:usesSideInfoPrescan];
+		[processors[i] setSilenceResolution:silenceResolution];
+		if (progressSlots != NULL) {
+			progressSlots[i].bytesDecoded = 0;
 		}
 	}
 	
-	// wait for all processors to finish
-	int result = 0;
-	for (NSUInteger i = 0; i < numProcessors; i++) {
-		void *exitCode;
-		int err = pthread_join(processorThreads[i], &exitCode);
-		if (err < 0) {
-			NSLog(@"failed to wait for thread %ld with silence processor", i);
-		}
-		
-		if (result == 0) {
-			if (exitCode != NULL) {
-				result = (int)exitCode;
-			}
-		}
+	if (progressSlots != NULL) {
+		numProgressSlots = numProcessors;
+	}
+	
+	// on a cold cache the analyzers would each wait for their own page faults, the prefetcher
+	// takes those waits off them
+	if (inputSource != NULL && inputSource->type == MP3InputSourceMapped &&
+		[[NSUserDefaults standardUserDefaults] boolForKey:MADDecoderThreadedPrefetchKey]) {
+		inputPrefetcher = MP3InputPrefetcherCreate(inputSource, MADDecoderReadaheadDistance);
 	}
 	
-	// gather total file duration from last processor
-	audioDuration = [processors[numProcessors - 1] currentTime];
+	// run all processors and wait for them to finish
+	[self startPublishingProgress];
+	int result = [pool runTasks:numProcessors function:runProcessorTask context:self priority:analysisPriority];
+	[self stopPublishingProgress];
+	
+	MP3InputPrefetcherDestroy(inputPrefetcher);
+	inputPrefetcher = NULL;
+	
+	// the processors only know times relative to their own section, so collect their results in order
+	NSArray *lists = [self collectResultsFromAnalyzers:processors count:numProcessors thresholds:thresholds count:count];
+	if (silenceLists != NULL) {
+		*silenceLists = lists;
+	}
 	
-	// clean up
+	// clean up, the slots stay around until the next run in case the main thread still reads them
+	progressValue = [self progressValue];
+	numProgressSlots = 0;
+	free(boundaries);
 	for (NSUInteger i = 0; i < numProcessors; i++) {
 		[processors[i] release];
 	}
 	free(processors);
 	processors = NULL;
-	free(processorThreads);
-	processorThreads = NULL;
-	free(progressValues);
-	progressValues = NULL;
+	numProcessors = 0;
 	
 	return result;
 }
@@ -144,59 +168,69 @@ static void *runProcessorThreaded(void *processor);
 
 - (void)setProgressValue:(double)value
 {
-	// store the progress value depending on what thread submits it
-	if (processorThreads != NULL) {
-		for (NSUInteger i = 0; i < numProcessors; i++) {
-			if (pthread_equal(pthread_self(), processorThreads[i]) != 0) {
-				value -= [processors[i] decodeStartByteOffset];
-				progressValues[i] = value;
-				break;
-			}
-		}
+	// store the progress value depending on what processor submits it, the notifications
+	// are sent by the progress thread
+	NSUInteger index = (NSUInteger)pthread_getspecific(processorIndexKey);
+	if (numProgressSlots > 0 && index > 0) {
+		// pre-roll frames lie before our start offset
+		value -= [processors[index - 1] decodeStartByteOffset];
+		__atomic_store_n(&progressSlots[index - 1].bytesDecoded, (uint64_t)MAX(value, 0.0), __ATOMIC_RELAXED);
 	} else {
 		// we are not running threaded, so fall back to simple progress
 		progressValue = value;
 	}
-	
-	// we must make sure to not send progress too often, so we only send it statistically every 100th time
-	if (((double)rand() / RAND_MAX) < 0.01) {
-		[audioFile performSelectorOnMainThread:@selector(sendProgressChangedNotification) withObject:nil waitUntilDone:NO];
-	}
 }
 
 - (double)progressValue
 {
-	if (processorThreads != NULL) {
-		double p = 0.0;
-		for (NSUInteger i = 0; i < numProcessors; i++) {
-			p += progressValues[i];
+	if (numProgressSlots > 0) {
+		uint64_t p = 0;
+		for (NSUInteger i = 0; i < numProgressSlots; i++) {
+			p += __atomic_load_n(&progressSlots[i].bytesDecoded, __ATOMIC_RELAXED);
 		}
 		
-		return p;
+		return (double)p;
 	} else {
 		// we are not running threaded, so fall back to simple progress
 		return progressValue;
 	}
 }
 
-- (void)foundSilenceFrom:(double)start to:(double)end
+- (NSUInteger)numProcessorCores
 {
-	[syncLock lock];
-	[super foundSilenceFrom:start to:end];
-	[syncLock unlock];
+	return [[MADWorkStealingPool sharedPool] numberOfWorkers];
 }
 
-- (NSUInteger)numProcessorCores
+- (void)setAnalysisPriority:(MADWorkPriority)priority
 {
-	NSUInteger count = 1;
-	size_t len = sizeof(count);
-	if (sysctlbyname("hw.ncpu", &count, &len, NULL, 0) != 0) {
-		return 1;
-	} else {
-		return count;
-	}
+	analysisPriority = priority;
 }
 
+- (MADWorkPriority)analysisPriority
+{
+	return analysisPriority;
+}
+
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MADDecoderThreaded (Private)
+
+- (int)runProcessorAtIndex:(NSUInteger)index
+{
+	int result;
+	
+	// the progress reports of the processor come in on this thread
+	pthread_setspecific(processorIndexKey, (void *)(index + 1));
+	result = [processors[index] runDecoder];
+	pthread_setspecific(processorIndexKey, NULL);
+	
+	return result;
+}
 
 @end
 
@@ -204,14 +238,14 @@ static void *runProcessorThreaded(void *processor);
 #pragma mark -
 
 
-void *runProcessorThreaded(void *processor)
+static int
+runProcessorTask(void *decoder, NSUInteger processorIndex)
 {
-	NSInteger result;
+	int result;
 	
 	@autoreleasepool {
-		result = [(MADDecoderProcessor *)processor runDecoder];
+		result = [(MADDecoderThreaded *)decoder runProcessorAtIndex:processorIndex];
 	}
 	
-	return (void *)result;
+	return result;
 }
-
@@ -0,0 +1,347 @@
+//
+//  MADEnergyKernel.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#include "MADEnergyKernel.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define MAD_ENERGY_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MAD_ENERGY_NEON 1
+#include <arm_neon.h>
+#endif
+
+// converts mad's fixed point samples to the 16 bit pcm scale, the same way the output does
+#define MADEnergyShift		(MAD_F_FRACBITS + 1 - 16)
+
+// the absolute values are below 2^19, so this many of them fit into a 32 bit lane before it has to be flushed
+#define MADEnergyFlushInterval		4096
+
+typedef struct {
+	uint64_t	sumAbs;
+	uint64_t	sumSquares;
+	uint32_t	peak;
+} MADEnergySums;
+
+typedef void (*MADEnergyFunction)(const mad_fixed_t *samples, int count, MADEnergySums *sums);
+
+static MADEnergyKernel bestKernel = MADEnergyKernelScalar;
+static pthread_once_t bestKernelOnce = PTHREAD_ONCE_INIT;
+
+
+static void
+energyScalar(const mad_fixed_t *samples, int count, MADEnergySums *sums)
+{
+	for (int i = 0; i < count; i++) {
+		uint32_t value = (uint32_t)abs((int)(samples[i] >> MADEnergyShift));
+		sums->sumAbs += value;
+		sums->sumSquares += (uint64_t)value * value;
+		if (value > sums->peak) {
+			sums->peak = value;
+		}
+	}
+}
+
+#ifdef MAD_ENERGY_X86
+
+static void
+energySSE2(const mad_fixed_t *samples, int count, MADEnergySums *sums)
+{
+	int vectors = count / 4;
+	__m128i squares = _mm_setzero_si128();
+	__m128i peak = _mm_setzero_si128();
+	
+	for (int start = 0; start < vectors; start += MADEnergyFlushInterval) {
+		int end = (vectors - start < MADEnergyFlushInterval) ? vectors : start + MADEnergyFlushInterval;
+		__m128i sum = _mm_setzero_si128();
+		
+		for (int i = start; i < end; i++) {
+			__m128i value = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(samples + 4 * i)), MADEnergyShift);
+			__m128i sign = _mm_srai_epi32(value, 31);
+			value = _mm_sub_epi32(_mm_xor_si128(value, sign), sign);
+			
+			sum = _mm_add_epi32(sum, value);
+			squares = _mm_add_epi64(squares, _mm_mul_epu32(value, value));
+			__m128i odd = _mm_srli_epi64(value, 32);
+			squares = _mm_add_epi64(squares, _mm_mul_epu32(odd, odd));
+			
+			// no unsigned max before sse4.1, but the values are all positive
+			__m128i greater = _mm_cmpgt_epi32(value, peak);
+			peak = _mm_or_si128(_mm_and_si128(greater, value), _mm_andnot_si128(greater, peak));
+		}
+		
+		uint32_t lanes[4];
+		_mm_storeu_si128((__m128i *)lanes, sum);
+		sums->sumAbs += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	
+	uint64_t squareLanes[2];
+	_mm_storeu_si128((__m128i *)squareLanes, squares);
+	sums->sumSquares += squareLanes[0] + squareLanes[1];
+	
+	uint32_t peakLanes[4];
+	_mm_storeu_si128((__m128i *)peakLanes, peak);
+	for (int i = 0; i < 4; i++) {
+		if (peakLanes[i] > sums->peak) {
+			sums->peak = peakLanes[i];
+		}
+	}
+	
+	energyScalar(samples + 4 * vectors, count - 4 * vectors, sums);
+}
+
+__attribute__((target("avx2")))
+static void
+energyAVX2(const mad_fixed_t *samples, int count, MADEnergySums *sums)
+{
+	int vectors = count / 8;
+	__m256i squares = _mm256_setzero_si256();
+	__m256i peak = _mm256_setzero_si256();
+	
+	for (int start = 0; start < vectors; start += MADEnergyFlushInterval) {
+		int end = (vectors - start < MADEnergyFlushInterval) ? vectors : start + MADEnergyFlushInterval;
+		__m256i sum = _mm256_setzero_si256();
+		
+		for (int i = start; i < end; i++) {
+			__m256i value = _mm256_abs_epi32(_mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(samples + 8 * i)), MADEnergyShift));
+			
+			sum = _mm256_add_epi32(sum, value);
+			squares = _mm256_add_epi64(squares, _mm256_mul_epu32(value, value));
+			__m256i odd = _mm256_srli_epi64(value, 32);
+			squares = _mm256_add_epi64(squares, _mm256_mul_epu32(odd, odd));
+			peak = _mm256_max_epu32(peak, value);
+		}
+		
+		uint32_t lanes[8];
+		_mm256_storeu_si256((__m256i *)lanes, sum);
+		for (int i = 0; i < 8; i++) {
+			sums->sumAbs += lanes[i];
+		}
+	}
+	
+	uint64_t squareLanes[4];
+	_mm256_storeu_si256((__m256i *)squareLanes, squares);
+	sums->sumSquares += squareLanes[0] + squareLanes[1] + squareLanes[2] + squareLanes[3];
+	
+	uint32_t peakLanes[8];
+	_mm256_storeu_si256((__m256i *)peakLanes, peak);
+	for (int i = 0; i < 8; i++) {
+		if (peakLanes[i] > sums->peak) {
+			sums->peak = peakLanes[i];
+		}
+	}
+	
+	energyScalar(samples + 8 * vectors, count - 8 * vectors, sums);
+}
+
+#endif
+
+#ifdef MAD_ENERGY_NEON
+
+static void
+energyNEON(const mad_fixed_t *samples, int count, MADEnergySums *sums)
+{
+	int vectors = count / 4;
+	uint64x2_t sum = vdupq_n_u64(0);
+	uint64x2_t squares = vdupq_n_u64(0);
+	uint32x4_t peak = vdupq_n_u32(0);
+	
+	for (int i = 0; i < vectors; i++) {
+		uint32x4_t value = vreinterpretq_u32_s32(vabsq_s32(vshrq_n_s32(vld1q_s32(samples + 4 * i), MADEnergyShift)));
+		
+		sum = vpadalq_u32(sum, value);
+		squares = vmlal_u32(squares, vget_low_u32(value), vget_low_u32(value));
+		squares = vmlal_u32(squares, vget_high_u32(value), vget_high_u32(value));
+		peak = vmaxq_u32(peak, value);
+	}
+	
+	sums->sumAbs += vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+	sums->sumSquares += vgetq_lane_u64(squares, 0) + vgetq_lane_u64(squares, 1);
+	
+	uint32_t peakLanes[4];
+	vst1q_u32(peakLanes, peak);
+	for (int i = 0; i < 4; i++) {
+		if (peakLanes[i] > sums->peak) {
+			sums->peak = peakLanes[i];
+		}
+	}
+	
+	energyScalar(samples + 4 * vectors, count - 4 * vectors, sums);
+}
+
+#endif
+
+static MADEnergyFunction
+energyFunction(MADEnergyKernel kernel)
+{
+	switch (kernel) {
+#ifdef MAD_ENERGY_X86
+		case MADEnergyKernelSSE2:
+			return energySSE2;
+		case MADEnergyKernelAVX2:
+			return energyAVX2;
+#endif
+#ifdef MAD_ENERGY_NEON
+		case MADEnergyKernelNEON:
+			return energyNEON;
+#endif
+		default:
+			return energyScalar;
+	}
+}
+
+static void
+findBestKernel(void)
+{
+	bestKernel = MADEnergyKernelScalar;
+	for (int kernel = MADEnergyKernelScalar; kernel < MADEnergyKernelCount; kernel++) {
+		if (MADEnergyKernelAvailable((MADEnergyKernel)kernel)) {
+			bestKernel = (MADEnergyKernel)kernel;
+		}
+	}
+}
+
+
+#pragma mark -
+
+
+void
+MADEnergyComputeWithKernel(MADEnergyKernel kernel, const mad_fixed_t *samples, int count, int divisor, MADFrameEnergy *energy)
+{
+	MADEnergySums sums = { 0, 0, 0 };
+	energyFunction(kernel)(samples, count, &sums);
+	
+	energy->meanAbs = (divisor > 0) ? (unsigned long)(sums.sumAbs / divisor) : 0;
+	energy->rms = (count > 0) ? (unsigned long)sqrt((double)sums.sumSquares / count) : 0;
+	energy->peak = sums.peak;
+}
+
+void
+MADEnergyCompute(const mad_fixed_t *samples, int count, int divisor, MADFrameEnergy *energy)
+{
+	MADEnergyComputeWithKernel(MADEnergyBestKernel(), samples, count, divisor, energy);
+}
+
+int
+MADEnergyFrameVolumes(const struct mad_frame *frame, int slotsPerBlock, unsigned long *blockVolumes, unsigned long *frameVolume)
+{
+	int nchannels = MAD_NCHANNELS(&frame->header);
+	int nslots = MAD_NSBSAMPLES(&frame->header);
+	
+	if (slotsPerBlock <= 0) {
+		MADFrameEnergy energy;
+		int nsamples = nchannels * nslots * 32;
+		MADEnergyCompute((const mad_fixed_t *)(frame->sbsample), nsamples, nsamples / 32, &energy);
+		blockVolumes[0] = energy.meanAbs;
+		*frameVolume = energy.meanAbs;
+		return 1;
+	}
+	
+	unsigned long frameSum = 0;
+	int numBlocks = 0;
+	for (int slot = 0; slot < nslots; slot += slotsPerBlock) {
+		unsigned long blockSum = 0;
+		for (int ch = 0; ch < nchannels; ch++) {
+			MADFrameEnergy energy;
+			MADEnergyCompute(frame->sbsample[ch][slot], slotsPerBlock * 32, 1, &energy);
+			blockSum += energy.meanAbs;
+		}
+		frameSum += blockSum;
+		blockVolumes[numBlocks++] = blockSum / (nchannels * slotsPerBlock);
+	}
+	
+	// same as the per frame average
+	*frameVolume = frameSum / (nchannels * nslots);
+	return numBlocks;
+}
+
+MADEnergyKernel
+MADEnergyBestKernel(void)
+{
+	pthread_once(&bestKernelOnce, findBestKernel);
+	return bestKernel;
+}
+
+int
+MADEnergyKernelAvailable(MADEnergyKernel kernel)
+{
+	switch (kernel) {
+		case MADEnergyKernelScalar:
+			return 1;
+#ifdef MAD_ENERGY_X86
+		case MADEnergyKernelSSE2:
+			return 1;
+		case MADEnergyKernelAVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+#ifdef MAD_ENERGY_NEON
+		case MADEnergyKernelNEON:
+			return 1;
+#endif
+		default:
+			return 0;
+	}
+}
+
+const char *
+MADEnergyKernelName(MADEnergyKernel kernel)
+{
+	static const char *names[MADEnergyKernelCount] = { "scalar", "sse2", "avx2", "neon" };
+	return (kernel < MADEnergyKernelCount) ? names[kernel] : "unknown";
+}
+
+double
+MADEnergyBenchmark(MADEnergyKernel kernel, int iterations)
+{
+	// one stereo layer III frame worth of subband samples
+	int count = 2 * 36 * 32;
+	mad_fixed_t *samples = (mad_fixed_t *) malloc(count * sizeof(mad_fixed_t));
+	unsigned int seed = 1;
+	for (int i = 0; i < count; i++) {
+		seed = seed * 1103515245 + 12345;
+		samples[i] = (mad_fixed_t)(seed >> 2) - (1 << 29);
+	}
+	
+	MADFrameEnergy energy;
+	volatile unsigned long checksum = 0;
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	for (int i = 0; i < iterations; i++) {
+		MADEnergyComputeWithKernel(kernel, samples, count, count / 32, &energy);
+		checksum += energy.meanAbs;
+	}
+	gettimeofday(&end, NULL);
+	free(samples);
+	
+	double elapsed = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_usec - start.tv_usec) * 1e3;
+	return (iterations > 0) ? elapsed / iterations : 0.0;
+}
@@ -0,0 +1,73 @@
+//
+//  MADEnergyKernel.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MADENERGYKERNEL_H
+#define MADENERGYKERNEL_H
+
+#include <mad/mad.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// all values are on the 16 bit pcm scale the samples are converted to
+typedef struct {
+	unsigned long	meanAbs;		// sum of absolute values divided by the divisor given
+	unsigned long	rms;			// root mean square over all samples
+	unsigned long	peak;			// largest absolute value
+} MADFrameEnergy;
+
+typedef enum {
+	MADEnergyKernelScalar,
+	MADEnergyKernelSSE2,
+	MADEnergyKernelAVX2,
+	MADEnergyKernelNEON,
+	MADEnergyKernelCount
+} MADEnergyKernel;
+
+// most blocks MADEnergyFrameVolumes splits a frame into, one per subband sample slot
+#define MADEnergyMaxBlocksPerFrame	36
+
+// computes the energy of count fixed point samples in one pass, with the fastest kernel the cpu supports
+void MADEnergyCompute(const mad_fixed_t *samples, int count, int divisor, MADFrameEnergy *energy);
+
+// the same with a specific kernel, which has to be available
+void MADEnergyComputeWithKernel(MADEnergyKernel kernel, const mad_fixed_t *samples, int count, int divisor, MADFrameEnergy *energy);
+
+// the volume of every block of slotsPerBlock subband sample slots of the frame, so that silences start and end
+// at the block they really start and end at, or of the whole frame if slotsPerBlock is 0. blockVolumes needs
+// room for MADEnergyMaxBlocksPerFrame values. returns the number of blocks, frameVolume gets their average.
+int MADEnergyFrameVolumes(const struct mad_frame *frame, int slotsPerBlock, unsigned long *blockVolumes, unsigned long *frameVolume);
+
+MADEnergyKernel MADEnergyBestKernel(void);
+int MADEnergyKernelAvailable(MADEnergyKernel kernel);
+const char *MADEnergyKernelName(MADEnergyKernel kernel);
+
+// runs the kernel over iterations synthetic stereo frames and returns the nanoseconds it took per frame
+double MADEnergyBenchmark(MADEnergyKernel kernel, int iterations);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+//
+//  MADProcessorCount.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		// for sched_getaffinity
+#endif
+
+#include "MADProcessorCount.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#if defined(__linux__)
+
+// reads the CPU quota of the cgroup as a (possibly fractional) number of CPUs, 0.0 if there is none
+static double
+cgroupCPULimit(void)
+{
+	FILE	*file;
+	double	limit = 0.0;
+	
+	// cgroup v2: "<quota> <period>" or "max <period>"
+	if ((file = fopen("/sys/fs/cgroup/cpu.max", "r")) != NULL) {
+		char	quota[32];
+		long	period;
+		if (fscanf(file, "%31s %ld", quota, &period) == 2 && strcmp(quota, "max") != 0 && period > 0) {
+			limit = (double)atol(quota) / (double)period;
+		}
+		fclose(file);
+		return limit;
+	}
+	
+	// cgroup v1: quota and period in separate files, a quota of -1 means unlimited
+	long quota = -1, period = 0;
+	if ((file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r")) != NULL) {
+		if (fscanf(file, "%ld", &quota) != 1) {
+			quota = -1;
+		}
+		fclose(file);
+	}
+	if ((file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r")) != NULL) {
+		if (fscanf(file, "%ld", &period) != 1) {
+			period = 0;
+		}
+		fclose(file);
+	}
+	if (quota > 0 && period > 0) {
+		limit = (double)quota / (double)period;
+	}
+	
+	return limit;
+}
+
+#endif
+
+size_t
+MADAvailableProcessorCount(void)
+{
+	long count = 0;
+	
+#if defined(__APPLE__)
+	// hw.activecpu leaves out processors that are switched off, it is an int and not a size_t
+	int		activeCount = 0;
+	size_t	len = sizeof(activeCount);
+	if (sysctlbyname("hw.activecpu", &activeCount, &len, NULL, 0) == 0) {
+		count = activeCount;
+	}
+#elif defined(__linux__)
+	cpu_set_t mask;
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+		count = CPU_COUNT(&mask);
+	}
+	
+	double limit = cgroupCPULimit();
+	if (limit > 0.0 && (count <= 0 || limit < count)) {
+		// a quota of 1.5 CPUs still keeps two threads busy half of the time
+		count = (limit < 1.0) ? 1 : (long)(limit + 0.5);
+	}
+#endif
+	
+	if (count <= 0) {
+		count = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	
+	return (count > 0) ? (size_t)count : 1;
+}
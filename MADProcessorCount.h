@@ -0,0 +1,35 @@
+//
+//  MADProcessorCount.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MADPROCESSORCOUNT_H
+#define MADPROCESSORCOUNT_H
+
+#include <stddef.h>
+
+// number of processors this process may actually run on at the same time. this honours the
+// affinity mask and, on Linux, a CPU quota of the cgroup the process runs in, so that a process
+// in a container limited to two CPUs doesn't start a thread for every core of the host.
+// never returns less than 1.
+size_t MADAvailableProcessorCount(void);
+
+#endif
@@ -0,0 +1,247 @@
+//
+//  MADSilenceTracker.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#include "MADSilenceTracker.h"
+
+#include <stdlib.h>
+
+
+static double
+timerToSeconds(mad_timer_t timer)
+{
+	// same resolution as +[MADDecoderProcessor timerToSeconds:]
+	return mad_timer_count(timer, MAD_UNITS_MILLISECONDS) / 1000.0;
+}
+
+static void
+addSilence(MADSilenceTracker *tracker, mad_timer_t start, mad_timer_t end, mad_timer_t quietestTime, long quietestVolume)
+{
+	if (tracker->numSilences + 1 >= tracker->allocedSilences) {
+		tracker->allocedSilences = (tracker->allocedSilences > 0) ? (tracker->allocedSilences * 2) : 64;
+		tracker->silences = (MADSilence *) realloc(tracker->silences, tracker->allocedSilences * sizeof(MADSilence));
+	}
+	
+	tracker->silences[tracker->numSilences].startTime = start;
+	tracker->silences[tracker->numSilences].endTime = end;
+	tracker->silences[tracker->numSilences].quietestTime = quietestTime;
+	tracker->silences[tracker->numSilences].quietestVolume = quietestVolume;
+	tracker->numSilences++;
+}
+
+
+#pragma mark -
+
+
+void
+MADSilenceTrackerInit(MADSilenceTracker *tracker, long volumeThreshold)
+{
+	tracker->volumeThreshold = volumeThreshold;
+	tracker->silences = NULL;
+	tracker->allocedSilences = 0;
+	MADSilenceTrackerReset(tracker);
+}
+
+void
+MADSilenceTrackerReset(MADSilenceTracker *tracker)
+{
+	tracker->leadingState = MADSilenceStateUnknown;
+	tracker->leadingTime = mad_timer_zero;
+	tracker->hasLeadingSilenceEnd = 0;
+	tracker->leadingSilenceEndTime = mad_timer_zero;
+	tracker->leadingQuietestTime = mad_timer_zero;
+	tracker->leadingQuietestVolume = 0;
+	tracker->state = MADSilenceStateUnknown;
+	tracker->silenceStartTime = mad_timer_zero;
+	tracker->silenceIsLeading = 0;
+	tracker->quietestTime = mad_timer_zero;
+	tracker->quietestVolume = 0;
+	tracker->numSilences = 0;
+}
+
+void
+MADSilenceTrackerFinish(MADSilenceTracker *tracker)
+{
+	if (tracker->silences != NULL) {
+		free(tracker->silences);
+		tracker->silences = NULL;
+	}
+	tracker->numSilences = 0;
+	tracker->allocedSilences = 0;
+}
+
+void
+MADSilenceTrackerAddFrame(MADSilenceTracker *tracker, long volume, mad_timer_t time)
+{
+	MADSilenceState frameState;
+	if (volume > tracker->volumeThreshold) {
+		frameState = MADSilenceStateLoud;
+	} else if (volume < tracker->volumeThreshold) {
+		frameState = MADSilenceStateSilent;
+	} else {
+		// exactly at the threshold keeps whatever state we are in
+		return;
+	}
+	
+	if (tracker->state == MADSilenceStateUnknown) {
+		// first deciding frame of this section
+		tracker->leadingState = frameState;
+		tracker->leadingTime = time;
+		if (frameState == MADSilenceStateSilent) {
+			tracker->silenceStartTime = time;
+			tracker->silenceIsLeading = 1;
+		}
+	} else if (tracker->state == MADSilenceStateSilent && frameState == MADSilenceStateLoud) {
+		// silence ended
+		if (tracker->silenceIsLeading) {
+			tracker->hasLeadingSilenceEnd = 1;
+			tracker->leadingSilenceEndTime = time;
+			tracker->leadingQuietestTime = tracker->quietestTime;
+			tracker->leadingQuietestVolume = tracker->quietestVolume;
+			tracker->silenceIsLeading = 0;
+		} else {
+			addSilence(tracker, tracker->silenceStartTime, time, tracker->quietestTime, tracker->quietestVolume);
+		}
+	} else if (tracker->state == MADSilenceStateLoud && frameState == MADSilenceStateSilent) {
+		// silence started
+		tracker->silenceStartTime = time;
+		tracker->silenceIsLeading = 0;
+	}
+	
+	// remember the quietest point of the current silence
+	if (frameState == MADSilenceStateSilent &&
+		(tracker->state != MADSilenceStateSilent || volume < tracker->quietestVolume)) {
+		tracker->quietestTime = time;
+		tracker->quietestVolume = volume;
+	}
+	
+	tracker->state = frameState;
+}
+
+void
+MADSilenceTrackerAddBlocks(MADSilenceTracker *tracker, const unsigned long *volumes, int numBlocks,
+						   int samplesPerBlock, unsigned int samplerate, mad_timer_t time)
+{
+	for (int block = 0; block < numBlocks; block++) {
+		mad_timer_t blockTime = time;
+		if (block > 0) {
+			mad_timer_t offset;
+			mad_timer_set(&offset, 0, block * samplesPerBlock, samplerate);
+			mad_timer_add(&blockTime, offset);
+		}
+		MADSilenceTrackerAddFrame(tracker, (long) volumes[block], blockTime);
+	}
+}
+
+int
+MADSilenceTrackerHasTrailingSilence(const MADSilenceTracker *tracker)
+{
+	return (tracker->state == MADSilenceStateSilent && !tracker->silenceIsLeading);
+}
+
+
+#pragma mark -
+
+
+// the quietest point of a silence that spans several sections is the quietest of their parts
+static void
+stitcherAddQuietest(MADSilenceStitcher *stitcher, mad_timer_t sectionStartTime, mad_timer_t time, long volume, int first)
+{
+	if (first || volume < stitcher->quietestVolume) {
+		stitcher->quietestTime = sectionStartTime;
+		mad_timer_add(&stitcher->quietestTime, time);
+		stitcher->quietestVolume = volume;
+	}
+}
+
+static void
+stitcherEndSilence(MADSilenceStitcher *stitcher, mad_timer_t endTime)
+{
+	double start = timerToSeconds(stitcher->silenceStartTime);
+	double end = timerToSeconds(endTime);
+	if (end - start > stitcher->durationThreshold) {
+		stitcher->foundSilence(stitcher->context, start, end, timerToSeconds(stitcher->quietestTime));
+	}
+	stitcher->inSilence = 0;
+}
+
+void
+MADSilenceStitcherInit(MADSilenceStitcher *stitcher, double durationThreshold,
+					   void (*foundSilence)(void *context, double start, double end, double quietest), void *context)
+{
+	stitcher->durationThreshold = durationThreshold;
+	stitcher->inSilence = 0;
+	stitcher->silenceStartTime = mad_timer_zero;
+	stitcher->quietestTime = mad_timer_zero;
+	stitcher->quietestVolume = 0;
+	stitcher->foundSilence = foundSilence;
+	stitcher->context = context;
+}
+
+void
+MADSilenceStitcherAddSection(MADSilenceStitcher *stitcher, const MADSilenceTracker *tracker, mad_timer_t sectionStartTime)
+{
+	mad_timer_t time;
+	
+	// the leading edge either continues or ends the silence the previous sections ended in
+	if (tracker->leadingState == MADSilenceStateSilent) {
+		int first = !stitcher->inSilence;
+		if (!stitcher->inSilence) {
+			stitcher->silenceStartTime = sectionStartTime;
+			mad_timer_add(&stitcher->silenceStartTime, tracker->leadingTime);
+			stitcher->inSilence = 1;
+		}
+		if (tracker->hasLeadingSilenceEnd) {
+			stitcherAddQuietest(stitcher, sectionStartTime, tracker->leadingQuietestTime, tracker->leadingQuietestVolume, first);
+			time = sectionStartTime;
+			mad_timer_add(&time, tracker->leadingSilenceEndTime);
+			stitcherEndSilence(stitcher, time);
+		} else {
+			// the whole section is silent
+			stitcherAddQuietest(stitcher, sectionStartTime, tracker->quietestTime, tracker->quietestVolume, first);
+		}
+	} else if (tracker->leadingState == MADSilenceStateLoud) {
+		if (stitcher->inSilence) {
+			time = sectionStartTime;
+			mad_timer_add(&time, tracker->leadingTime);
+			stitcherEndSilence(stitcher, time);
+		}
+	}
+	
+	// silences completely inside the section
+	for (size_t i = 0; i < tracker->numSilences; i++) {
+		stitcher->silenceStartTime = sectionStartTime;
+		mad_timer_add(&stitcher->silenceStartTime, tracker->silences[i].startTime);
+		stitcherAddQuietest(stitcher, sectionStartTime, tracker->silences[i].quietestTime, tracker->silences[i].quietestVolume, 1);
+		time = sectionStartTime;
+		mad_timer_add(&time, tracker->silences[i].endTime);
+		stitcherEndSilence(stitcher, time);
+	}
+	
+	// the trailing silence is continued by the next sections
+	if (MADSilenceTrackerHasTrailingSilence(tracker)) {
+		stitcher->silenceStartTime = sectionStartTime;
+		mad_timer_add(&stitcher->silenceStartTime, tracker->silenceStartTime);
+		stitcherAddQuietest(stitcher, sectionStartTime, tracker->quietestTime, tracker->quietestVolume, 1);
+		stitcher->inSilence = 1;
+	}
+}
@@ -0,0 +1,120 @@
+//
+//  MADSilenceTracker.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MADSILENCETRACKER_H
+#define MADSILENCETRACKER_H
+
+#include <stddef.h>
+#include <mad/mad.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// silences are recorded relative to the start of the analyzed section
+typedef struct {
+	mad_timer_t		startTime;
+	mad_timer_t		endTime;
+	mad_timer_t		quietestTime;	// where the volume was lowest, the best place to cut
+	long			quietestVolume;
+} MADSilence;
+
+typedef enum {
+	MADSilenceStateUnknown,		// only frames exactly at the threshold so far, they don't change the state
+	MADSilenceStateLoud,
+	MADSilenceStateSilent
+} MADSilenceState;
+
+// one pair of thresholds a file can be analyzed with
+typedef struct {
+	long			volumeThreshold;	// max volume level in pcm scale
+	double			durationThreshold;	// min secs a silence has to last to be recorded
+} MADSilenceThresholds;
+
+// the silence state machine for one section of a file. because a section doesn't know how the
+// previous one ended, it reports its leading and trailing partial silences separately, so that
+// the sections can be stitched together afterwards (see MADSilenceStitcher)
+typedef struct {
+	long			volumeThreshold;
+	
+	// the first frame that decided the state of this section
+	MADSilenceState	leadingState;
+	mad_timer_t		leadingTime;
+	
+	// if the section started silent: where that silence ended (if it ended inside the section)
+	int				hasLeadingSilenceEnd;
+	mad_timer_t		leadingSilenceEndTime;
+	mad_timer_t		leadingQuietestTime;
+	long			leadingQuietestVolume;
+	
+	// current state, at the end of the section this describes the trailing silence
+	MADSilenceState	state;
+	mad_timer_t		silenceStartTime;
+	int				silenceIsLeading;
+	mad_timer_t		quietestTime;
+	long			quietestVolume;
+	
+	// complete silences inside the section
+	MADSilence		*silences;
+	size_t			numSilences;
+	size_t			allocedSilences;
+} MADSilenceTracker;
+
+void MADSilenceTrackerInit(MADSilenceTracker *tracker, long volumeThreshold);
+void MADSilenceTrackerReset(MADSilenceTracker *tracker);
+void MADSilenceTrackerFinish(MADSilenceTracker *tracker);
+
+// feeds the volume of the frame starting at time into the state machine
+void MADSilenceTrackerAddFrame(MADSilenceTracker *tracker, long volume, mad_timer_t time);
+
+// adds numBlocks volumes of samplesPerBlock samples each, the first one starting at time
+void MADSilenceTrackerAddBlocks(MADSilenceTracker *tracker, const unsigned long *volumes, int numBlocks,
+								int samplesPerBlock, unsigned int samplerate, mad_timer_t time);
+
+// does the section end inside a silence that started within it (and not at its leading edge)
+int MADSilenceTrackerHasTrailingSilence(const MADSilenceTracker *tracker);
+
+
+// joins the trackers of consecutive sections into absolute silences
+typedef struct {
+	double			durationThreshold;	// min secs a silence has to last to be reported
+	int				inSilence;
+	mad_timer_t		silenceStartTime;
+	mad_timer_t		quietestTime;
+	long			quietestVolume;
+	
+	void			(*foundSilence)(void *context, double start, double end, double quietest);
+	void			*context;
+} MADSilenceStitcher;
+
+void MADSilenceStitcherInit(MADSilenceStitcher *stitcher, double durationThreshold,
+							void (*foundSilence)(void *context, double start, double end, double quietest), void *context);
+
+// adds the results of the next section, which starts at sectionStartTime
+void MADSilenceStitcherAddSection(MADSilenceStitcher *stitcher, const MADSilenceTracker *tracker, mad_timer_t sectionStartTime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
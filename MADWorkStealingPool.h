@@ -0,0 +1,98 @@
+//
+//  MADWorkStealingPool.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+// a task is a plain function, it gets called with the context and its task index
+typedef int (*MADWorkFunction)(void *context, NSUInteger taskIndex);
+
+// all tasks submitted by one call of runTasks:function:context:priority:
+typedef struct MADWorkJob MADWorkJob;
+
+// queued tasks of a higher class are always started first, a running task is never interrupted though
+typedef enum {
+	MADWorkPriorityInteractive = 0,		// the user is waiting for it right now, e.g. feeding playback
+	MADWorkPriorityNormal,				// analysis of an open document
+	MADWorkPriorityBackground,			// batch work nobody is looking at
+	MADWorkPriorityCount
+} MADWorkPriority;
+
+typedef struct {
+	MADWorkFunction		function;
+	void				*context;
+	NSUInteger			taskIndex;
+	MADWorkJob			*job;
+} MADWorkItem;
+
+// double ended queue of one worker, the owner takes from the front, other workers steal from the back
+typedef struct {
+	pthread_mutex_t		lock;
+	MADWorkItem			*items;
+	NSUInteger			capacity;
+	NSUInteger			head;
+	NSUInteger			count;
+} MADWorkDeque;
+
+// the user can override the number of workers of the shared pool with this default, 0 means automatic
+#define MADWorkStealingPoolThreadCountKey	@"AnalysisThreadCount"
+
+@interface MADWorkStealingPool : NSObject {
+	NSUInteger			numWorkers;
+	MADWorkDeque		*deques[MADWorkPriorityCount];
+	pthread_t			*workerThreads;
+	BOOL				*workerStarted;
+	NSUInteger			nextDeque;			// where the next job starts handing out its tasks
+	
+	// the workers stay around between jobs and sleep on the condition while nothing can be started
+	pthread_mutex_t		poolLock;
+	pthread_cond_t		poolCondition;
+	NSUInteger			numQueuedItems[MADWorkPriorityCount];
+	NSUInteger			numRunningItems[MADWorkPriorityCount];
+	NSUInteger			numInteractiveThreads;
+	BOOL				terminating;
+}
+
+// the process wide pool that all decoders share, so that several documents analyzing at the
+// same time don't start more threads than there are processors to run them
++ (MADWorkStealingPool *)sharedPool;
+
+- (id)initWithNumberOfWorkers:(NSUInteger)count;
+- (void)dealloc;
+
+- (NSUInteger)numberOfWorkers;
+
+// runs function for all task indices 0..count-1 and waits until all of them are done. the tasks are
+// handed out in contiguous blocks, so that every worker walks through neighbouring tasks in order as
+// long as it doesn't run out of work. the calling thread helps out while it waits. several threads
+// may run tasks on the same pool at the same time. returns the first non-zero task result.
+- (int)runTasks:(NSUInteger)count function:(MADWorkFunction)function context:(void *)context priority:(MADWorkPriority)priority;
+- (int)runTasks:(NSUInteger)count function:(MADWorkFunction)function context:(void *)context;
+
+// threads outside the pool doing interactive work, like the playback decoder, register themselves
+// for as long as they run. the pool then keeps a processor free for each of them by running fewer
+// tasks of the normal and background classes at once.
+- (void)beginInteractiveWork;
+- (void)endInteractiveWork;
+
+@end
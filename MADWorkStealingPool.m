@@ -0,0 +1,390 @@
+//
+//  MADWorkStealingPool.m
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import "MADWorkStealingPool.h"
+#import "MADProcessorCount.h"
+
+struct MADWorkJob {
+	NSUInteger			numPendingItems;
+	int					result;
+	MADWorkPriority		priority;
+};
+
+// thread priorities the tasks of each class run at
+static const double MADWorkThreadPriority[MADWorkPriorityCount] = { 1.0, 0.5, 0.0 };
+
+typedef struct {
+	MADWorkStealingPool	*pool;
+	NSUInteger			workerIndex;
+} MADWorkerInfo;
+
+static MADWorkStealingPool	*sharedPool = nil;
+static pthread_once_t		sharedPoolOnce = PTHREAD_ONCE_INIT;
+
+static void createSharedPool(void);
+static void *runWorkerThread(void *info);
+
+
+@interface MADWorkStealingPool (Private)
+- (BOOL)mayStartItemOfPriority:(MADWorkPriority)priority;
+- (BOOL)mayStartItemUpToPriority:(MADWorkPriority)lowestPriority;
+- (BOOL)takeItem:(MADWorkItem *)item forWorker:(NSUInteger)workerIndex upToPriority:(MADWorkPriority)lowestPriority;
+- (void)runItem:(MADWorkItem *)item;
+- (void)runWorker:(NSUInteger)workerIndex;
+@end
+
+static void
+dequePushBack(MADWorkDeque *deque, MADWorkItem item)
+{
+	pthread_mutex_lock(&deque->lock);
+	if (deque->count == deque->capacity) {
+		NSUInteger newCapacity = (deque->capacity > 0) ? (deque->capacity * 2) : 16;
+		MADWorkItem *newItems = (MADWorkItem *) malloc(newCapacity * sizeof(MADWorkItem));
+		for (NSUInteger i = 0; i < deque->count; i++) {
+			newItems[i] = deque->items[(deque->head + i) % deque->capacity];
+		}
+		free(deque->items);
+		deque->items = newItems;
+		deque->capacity = newCapacity;
+		deque->head = 0;
+	}
+	deque->items[(deque->head + deque->count) % deque->capacity] = item;
+	deque->count++;
+	pthread_mutex_unlock(&deque->lock);
+}
+
+static BOOL
+dequePopFront(MADWorkDeque *deque, MADWorkItem *item)
+{
+	BOOL found = NO;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->count > 0) {
+		*item = deque->items[deque->head];
+		deque->head = (deque->head + 1) % deque->capacity;
+		deque->count--;
+		found = YES;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+static BOOL
+dequePopBack(MADWorkDeque *deque, MADWorkItem *item)
+{
+	BOOL found = NO;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->count > 0) {
+		deque->count--;
+		*item = deque->items[(deque->head + deque->count) % deque->capacity];
+		found = YES;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+
+#pragma mark -
+
+
+@implementation MADWorkStealingPool
+
++ (MADWorkStealingPool *)sharedPool
+{
+	pthread_once(&sharedPoolOnce, createSharedPool);
+	
+	return sharedPool;
+}
+
+- (id)initWithNumberOfWorkers:(NSUInteger)count
+{
+	if (self = [super init]) {
+		numWorkers = MAX(count, 1);
+		for (NSUInteger p = 0; p < MADWorkPriorityCount; p++) {
+			deques[p] = (MADWorkDeque *) calloc(numWorkers, sizeof(MADWorkDeque));
+			for (NSUInteger i = 0; i < numWorkers; i++) {
+				pthread_mutex_init(&deques[p][i].lock, NULL);
+			}
+			numQueuedItems[p] = 0;
+			numRunningItems[p] = 0;
+		}
+		nextDeque = 0;
+		numInteractiveThreads = 0;
+		pthread_mutex_init(&poolLock, NULL);
+		pthread_cond_init(&poolCondition, NULL);
+		terminating = NO;
+		
+		// the tasks of workers that could not be started are stolen by the others or run by the
+		// calling thread, so a pool without any threads still gets its work done
+		workerThreads = (pthread_t *) malloc(numWorkers * sizeof(pthread_t));
+		workerStarted = (BOOL *) malloc(numWorkers * sizeof(BOOL));
+		for (NSUInteger i = 0; i < numWorkers; i++) {
+			MADWorkerInfo *info = (MADWorkerInfo *) malloc(sizeof(MADWorkerInfo));
+			info->pool = self;
+			info->workerIndex = i;
+			workerStarted[i] = (pthread_create(&workerThreads[i], NULL, runWorkerThread, info) == 0);
+			if (!workerStarted[i]) {
+				NSLog(@"failed to create worker thread %lu", (unsigned long)i);
+				free(info);
+			}
+		}
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_lock(&poolLock);
+	terminating = YES;
+	pthread_cond_broadcast(&poolCondition);
+	pthread_mutex_unlock(&poolLock);
+	for (NSUInteger i = 0; i < numWorkers; i++) {
+		if (workerStarted[i]) {
+			pthread_join(workerThreads[i], NULL);
+		}
+	}
+	
+	for (NSUInteger p = 0; p < MADWorkPriorityCount; p++) {
+		for (NSUInteger i = 0; i < numWorkers; i++) {
+			pthread_mutex_destroy(&deques[p][i].lock);
+			free(deques[p][i].items);
+		}
+		free(deques[p]);
+	}
+	free(workerThreads);
+	free(workerStarted);
+	pthread_cond_destroy(&poolCondition);
+	pthread_mutex_destroy(&poolLock);
+	
+	[super dealloc];
+}
+
+- (NSUInteger)numberOfWorkers
+{
+	return numWorkers;
+}
+
+- (int)runTasks:(NSUInteger)count function:(MADWorkFunction)function context:(void *)context
+{
+	return [self runTasks:count function:function context:context priority:MADWorkPriorityNormal];
+}
+
+- (int)runTasks:(NSUInteger)count function:(MADWorkFunction)function context:(void *)context priority:(MADWorkPriority)priority
+{
+	MADWorkJob	job = { count, 0, priority };
+	MADWorkItem	item;
+	double		callerPriority = [NSThread threadPriority];
+	
+	if (count == 0) {
+		return 0;
+	}
+	
+	// hand out the tasks in contiguous blocks. every job starts at another worker, so that
+	// small jobs running side by side don't all queue up on the first one.
+	pthread_mutex_lock(&poolLock);
+	NSUInteger firstDeque = nextDeque;
+	nextDeque = (nextDeque + 1) % numWorkers;
+	for (NSUInteger i = 0; i < count; i++) {
+		MADWorkItem newItem = { function, context, i, &job };
+		dequePushBack(&deques[priority][(firstDeque + (i * numWorkers) / count) % numWorkers], newItem);
+	}
+	numQueuedItems[priority] += count;
+	pthread_cond_broadcast(&poolCondition);
+	
+	// help out instead of just waiting, this also keeps a job going if no worker could be started.
+	// we don't pick up anything less urgent than our own job though.
+	while (job.numPendingItems > 0) {
+		if ([self mayStartItemUpToPriority:priority]) {
+			pthread_mutex_unlock(&poolLock);
+			if ([self takeItem:&item forWorker:numWorkers upToPriority:priority]) {
+				[self runItem:&item];
+			}
+			pthread_mutex_lock(&poolLock);
+		} else {
+			pthread_cond_wait(&poolCondition, &poolLock);
+		}
+	}
+	pthread_mutex_unlock(&poolLock);
+	[NSThread setThreadPriority:callerPriority];
+	
+	return job.result;
+}
+
+- (void)beginInteractiveWork
+{
+	pthread_mutex_lock(&poolLock);
+	numInteractiveThreads++;
+	pthread_mutex_unlock(&poolLock);
+}
+
+- (void)endInteractiveWork
+{
+	pthread_mutex_lock(&poolLock);
+	if (numInteractiveThreads > 0) {
+		numInteractiveThreads--;
+	}
+	pthread_cond_broadcast(&poolCondition);
+	pthread_mutex_unlock(&poolLock);
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MADWorkStealingPool (Private)
+
+// must be called with the pool lock held
+- (BOOL)mayStartItemOfPriority:(MADWorkPriority)priority
+{
+	if (numQueuedItems[priority] == 0) {
+		return NO;
+	}
+	if (priority == MADWorkPriorityInteractive) {
+		return YES;
+	}
+	
+	// threads waiting for their job help out, but even with them there are never more tasks running
+	// than the pool has workers. a processor is left to every interactive thread, but at least one
+	// task always makes progress.
+	NSUInteger limit = (numWorkers > numInteractiveThreads) ? (numWorkers - numInteractiveThreads) : 1;
+	NSUInteger running = numRunningItems[MADWorkPriorityNormal] + numRunningItems[MADWorkPriorityBackground];
+	
+	return (running < limit);
+}
+
+// must be called with the pool lock held
+- (BOOL)mayStartItemUpToPriority:(MADWorkPriority)lowestPriority
+{
+	for (NSUInteger p = 0; p <= lowestPriority; p++) {
+		if ([self mayStartItemOfPriority:p]) {
+			return YES;
+		}
+	}
+	
+	return NO;
+}
+
+// a worker index of numWorkers is a thread from outside the pool, which has no deques of its own
+- (BOOL)takeItem:(MADWorkItem *)item forWorker:(NSUInteger)workerIndex upToPriority:(MADWorkPriority)lowestPriority
+{
+	BOOL found = NO;
+	
+	pthread_mutex_lock(&poolLock);
+	for (NSUInteger p = 0; !found && p <= lowestPriority; p++) {
+		if (![self mayStartItemOfPriority:p]) {
+			continue;
+		}
+		
+		// own work first, in order
+		if (workerIndex < numWorkers) {
+			found = dequePopFront(&deques[p][workerIndex], item);
+		}
+		
+		// steal from the far end of another worker's block
+		for (NSUInteger i = 1; !found && i <= numWorkers; i++) {
+			found = dequePopBack(&deques[p][(workerIndex + i) % numWorkers], item);
+		}
+		
+		if (found) {
+			numQueuedItems[p]--;
+			numRunningItems[p]++;
+		}
+	}
+	pthread_mutex_unlock(&poolLock);
+	
+	return found;
+}
+
+- (void)runItem:(MADWorkItem *)item
+{
+	MADWorkJob	*job = item->job;
+	int			itemResult;
+	
+	@autoreleasepool {
+		[NSThread setThreadPriority:MADWorkThreadPriority[job->priority]];
+		itemResult = item->function(item->context, item->taskIndex);
+	}
+	
+	// the job lives on the stack of the thread that submitted it, so it must not be touched once
+	// its last item is done and the lock is released
+	pthread_mutex_lock(&poolLock);
+	numRunningItems[job->priority]--;
+	if (itemResult != 0 && job->result == 0) {
+		job->result = itemResult;
+	}
+	job->numPendingItems--;
+	pthread_cond_broadcast(&poolCondition);
+	pthread_mutex_unlock(&poolLock);
+}
+
+- (void)runWorker:(NSUInteger)workerIndex
+{
+	MADWorkItem item;
+	
+	pthread_mutex_lock(&poolLock);
+	while (!terminating) {
+		if (![self mayStartItemUpToPriority:MADWorkPriorityBackground]) {
+			pthread_cond_wait(&poolCondition, &poolLock);
+			continue;
+		}
+		
+		pthread_mutex_unlock(&poolLock);
+		if ([self takeItem:&item forWorker:workerIndex upToPriority:MADWorkPriorityBackground]) {
+			[self runItem:&item];
+		}
+		pthread_mutex_lock(&poolLock);
+	}
+	pthread_mutex_unlock(&poolLock);
+}
+
+@end
+
+
+#pragma mark -
+
+
+static void
+createSharedPool(void)
+{
+	@autoreleasepool {
+		NSInteger count = [[NSUserDefaults standardUserDefaults] integerForKey:MADWorkStealingPoolThreadCountKey];
+		if (count <= 0) {
+			count = MADAvailableProcessorCount();
+		}
+		sharedPool = [[MADWorkStealingPool alloc] initWithNumberOfWorkers:count];
+	}
+}
+
+static void *
+runWorkerThread(void *info)
+{
+	MADWorkStealingPool	*pool = ((MADWorkerInfo *)info)->pool;
+	NSUInteger			workerIndex = ((MADWorkerInfo *)info)->workerIndex;
+	
+	free(info);
+	[pool runWorker:workerIndex];
+	
+	return NULL;
+}
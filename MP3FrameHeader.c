@@ -0,0 +1,201 @@
+//
+//  MP3FrameHeader.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#include "MP3FrameHeader.h"
+
+#include <string.h>
+
+
+static const int bitrateTable[5][16] = {
+	{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },	// MPEG 1, layer I
+	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },		// MPEG 1, layer II
+	{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },		// MPEG 1, layer III
+	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },		// MPEG 2/2.5, layer I
+	{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }			// MPEG 2/2.5, layer II & III
+};
+
+static const int samplerateTable[3] = { 44100, 48000, 32000 };
+
+
+int
+MP3FrameHeaderParse(const uint8_t *ptr, size_t available, MP3FrameHeader *header)
+{
+	if (available < MP3FrameHeaderSize) {
+		return 0;
+	}
+	
+	// 11 sync bits
+	if (ptr[0] != 0xff || (ptr[1] & 0xe0) != 0xe0) {
+		return 0;
+	}
+	
+	int versionBits = (ptr[1] >> 3) & 0x03;
+	int layerBits = (ptr[1] >> 1) & 0x03;
+	int bitrateIndex = (ptr[2] >> 4) & 0x0f;
+	int samplerateIndex = (ptr[2] >> 2) & 0x03;
+	int padding = (ptr[2] >> 1) & 0x01;
+	
+	if (versionBits == 0x01 || layerBits == 0x00 || bitrateIndex == 0x00 || bitrateIndex == 0x0f ||
+		samplerateIndex == 0x03 || (ptr[3] & 0x03) == 0x02) {
+		// reserved values, free format or reserved emphasis
+		return 0;
+	}
+	
+	switch (versionBits) {
+		case 0x03: header->version = MP3FrameVersion1; break;
+		case 0x02: header->version = MP3FrameVersion2; break;
+		default: header->version = MP3FrameVersion25; break;
+	}
+	header->layer = 4 - layerBits;
+	
+	int table;
+	if (header->version == MP3FrameVersion1) {
+		table = header->layer - 1;
+	} else {
+		table = (header->layer == 1) ? 3 : 4;
+	}
+	header->bitrate = bitrateTable[table][bitrateIndex] * 1000;
+	
+	header->samplerate = samplerateTable[samplerateIndex];
+	if (header->version == MP3FrameVersion2) {
+		header->samplerate /= 2;
+	} else if (header->version == MP3FrameVersion25) {
+		header->samplerate /= 4;
+	}
+	
+	header->channels = (((ptr[3] >> 6) & 0x03) == 0x03) ? 1 : 2;
+	header->hasCRC = ((ptr[1] & 0x01) == 0);
+	
+	if (header->layer == 1) {
+		header->samplesPerFrame = 384;
+		header->frameLength = ((12 * header->bitrate / header->samplerate) + padding) * 4;
+	} else if (header->layer == 2 || header->version == MP3FrameVersion1) {
+		header->samplesPerFrame = 1152;
+		header->frameLength = (144 * header->bitrate / header->samplerate) + padding;
+	} else {
+		header->samplesPerFrame = 576;
+		header->frameLength = (72 * header->bitrate / header->samplerate) + padding;
+	}
+	
+	return 1;
+}
+
+size_t
+MP3FrameSync(const uint8_t *data, size_t length, size_t offset)
+{
+	for (size_t pos = offset; pos + MP3FrameHeaderSize <= length; pos++) {
+		MP3FrameHeader first;
+		if (data[pos] != 0xff || !MP3FrameHeaderParse(data + pos, length - pos, &first)) {
+			continue;
+		}
+		
+		// the following frames have to agree on the stream parameters, otherwise this was a false sync
+		size_t next = pos + first.frameLength;
+		int chain = 1;
+		while (chain < MP3FrameSyncChainLength) {
+			MP3FrameHeader h;
+			if (next == length) {
+				// running into the end of the data exactly is fine
+				chain = MP3FrameSyncChainLength;
+				break;
+			} else if (next > length) {
+				break;
+			}
+			if (!MP3FrameHeaderParse(data + next, length - next, &h) ||
+				h.version != first.version || h.layer != first.layer || h.samplerate != first.samplerate) {
+				break;
+			}
+			next += h.frameLength;
+			chain++;
+		}
+		
+		if (chain == MP3FrameSyncChainLength) {
+			return pos;
+		}
+	}
+	
+	return length;
+}
+
+size_t
+MP3FramePrerollOffset(const uint8_t *data, size_t length, size_t offset, size_t prerollBytes)
+{
+	size_t searchStart = (offset > prerollBytes) ? (offset - prerollBytes) : 0;
+	size_t start = MP3FrameSync(data, length, searchStart);
+	if (start >= offset) {
+		return offset;
+	}
+	
+	// the frames from the found sync point must lead exactly onto offset
+	size_t pos = start;
+	while (pos < offset) {
+		MP3FrameHeader h;
+		if (!MP3FrameHeaderParse(data + pos, length - pos, &h)) {
+			return offset;
+		}
+		pos += h.frameLength;
+	}
+	
+	return (pos == offset) ? start : offset;
+}
+
+size_t
+MP3FrameNext(const uint8_t *data, size_t length, size_t offset, const MP3FrameHeader *previous, MP3FrameHeader *header)
+{
+	if (offset >= length) {
+		return length;
+	}
+	
+	// while we are in sync a single matching header is enough
+	if (previous != NULL && MP3FrameHeaderParse(data + offset, length - offset, header) &&
+		header->version == previous->version && header->layer == previous->layer && header->samplerate == previous->samplerate &&
+		offset + header->frameLength <= length) {
+		return offset;
+	}
+	
+	size_t pos = MP3FrameSync(data, length, offset);
+	if (pos < length) {
+		MP3FrameHeaderParse(data + pos, length - pos, header);
+	}
+	
+	return pos;
+}
+
+size_t
+MP3TagLength(const uint8_t *ptr, size_t available)
+{
+	if (available >= 10 && !strncmp((const char *) ptr, "ID3", 3)) {
+		// the size is syncsafe and doesn't include the 10 byte tag header
+		const uint8_t *id3SizeFields = (ptr + 6);
+		size_t id3TagSize = 10;
+		id3TagSize += (id3SizeFields[0] << (3 * 7));
+		id3TagSize += (id3SizeFields[1] << (2 * 7));
+		id3TagSize += (id3SizeFields[2] << (1 * 7));
+		id3TagSize += (id3SizeFields[3] << (0 * 7));
+		return id3TagSize;
+	} else if (available >= 3 && !strncmp((const char *) ptr, "TAG", 3)) {
+		return 128;
+	}
+	
+	return 0;
+}
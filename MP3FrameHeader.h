@@ -0,0 +1,84 @@
+//
+//  MP3FrameHeader.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MP3FRAMEHEADER_H
+#define MP3FRAMEHEADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a frame header is always 4 bytes long
+#define MP3FrameHeaderSize			4
+
+// number of consecutive frame headers that must follow each other to accept a sync point
+#define MP3FrameSyncChainLength		3
+
+// how many bytes before a sync point we start decoding to fill the layer III bit reservoir
+// (main_data_begin can reach back 511 bytes, this leaves room for the frames holding that data)
+#define MP3FramePrerollBytes		4096
+
+typedef enum {
+	MP3FrameVersion1,
+	MP3FrameVersion2,
+	MP3FrameVersion25
+} MP3FrameVersion;
+
+typedef struct {
+	MP3FrameVersion		version;
+	int					layer;				// 1, 2 or 3
+	int					bitrate;			// bits per second
+	int					samplerate;			// samples per second
+	int					channels;
+	int					hasCRC;
+	unsigned int		samplesPerFrame;
+	unsigned int		frameLength;		// complete frame length in bytes including the header
+} MP3FrameHeader;
+
+// parses the 4 header bytes at ptr, returns 0 if they don't form a valid header (free format is not supported)
+int MP3FrameHeaderParse(const uint8_t *ptr, size_t available, MP3FrameHeader *header);
+
+// returns the offset of the first frame at or after offset that starts a chain of
+// MP3FrameSyncChainLength consistent frames, or length if there is none
+size_t MP3FrameSync(const uint8_t *data, size_t length, size_t offset);
+
+// returns an offset up to prerollBytes before the frame at offset from which frames can be
+// walked contiguously up to offset, or offset itself if there is no such frame
+size_t MP3FramePrerollOffset(const uint8_t *data, size_t length, size_t offset, size_t prerollBytes);
+
+// returns the offset of the frame at or after offset and parses its header. if previous is given (the
+// header of the frame right before offset) a matching header at offset is accepted without resyncing.
+// returns length if there are no more frames.
+size_t MP3FrameNext(const uint8_t *data, size_t length, size_t offset, const MP3FrameHeader *previous, MP3FrameHeader *header);
+
+// returns the length of the ID3v2 or ID3v1 tag at ptr, or 0 if there is no complete tag header
+size_t MP3TagLength(const uint8_t *ptr, size_t available);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+//
+//  MP3FrameIndex.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import <Foundation/Foundation.h>
+
+#import "MP3FrameHeader.h"
+
+typedef struct {
+	uint64_t		byteOffset;
+	uint64_t		sampleOffset;		// number of samples in all frames before this one
+} MP3FrameIndexEntry;
+
+// the frames are stored in blocks of this many, each with the absolute offsets of its first frame
+#define MP3FrameIndexBlockSize		64
+
+// the distances from one frame to the next are bit packed, every frame of a block takes as many bits
+// as the largest distance beyond the smallest one needs. frames with the same bitrate take no bits
+// at all, padding takes one.
+typedef struct {
+	uint64_t		byteOffset;			// of the first frame of the block
+	uint64_t		sampleOffset;
+	uint64_t		bitOffset;			// where the distances of the block start
+	uint32_t		baseDistance;		// smallest distance from a frame to the next one in the block
+	uint16_t		samplesPerFrame;	// 0 if the frames of the block differ, then each has its own 2 bit code
+	uint8_t			distanceBits;
+} MP3FrameIndexBlock;
+
+// index of every frame in an mp3 file, built by only looking at the frame headers
+@interface MP3FrameIndex : NSObject {
+	MP3FrameIndexBlock	*blocks;
+	NSUInteger			numBlocks;
+	NSUInteger			allocedBlocks;
+	uint8_t				*bits;
+	uint64_t			numBits;
+	NSUInteger			allocedBytes;
+	NSUInteger			numEntries;
+	
+	int					samplerate;
+	unsigned int		samplesPerFrame;	// 0 if the frames don't all have the same number of samples
+	uint64_t			numSamples;
+}
+
+- (id)initWithBytes:(const uint8_t *)bytes length:(NSUInteger)length;
+- (void)dealloc;
+
+- (NSUInteger)numberOfFrames;
+- (MP3FrameIndexEntry)entryAtIndex:(NSUInteger)index;
+- (NSUInteger)byteOffsetOfFrameAtIndex:(NSUInteger)index;
+
+// index of the frame that contains the given sample or time
+- (NSUInteger)frameIndexForSample:(uint64_t)sample;
+- (NSUInteger)frameIndexForTime:(double)time;
+- (double)timeOfFrameAtIndex:(NSUInteger)index;
+
+- (int)samplerate;
+- (uint64_t)numberOfSamples;
+- (double)duration;
+
+// memory taken by the blocks and the packed distances
+- (NSUInteger)numberOfBytes;
+
+@end
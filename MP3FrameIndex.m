@@ -0,0 +1,350 @@
+//
+//  MP3FrameIndex.m
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import "MP3FrameIndex.h"
+
+// the samples per frame of a mixed block are coded with 2 bits
+static const unsigned int samplesPerFrameForCode[] = { 384, 576, 1152, 0 };
+
+static unsigned int codeForSamplesPerFrame(unsigned int samples);
+static unsigned int bitsForValue(uint32_t value);
+static uint32_t readBits(const uint8_t *bits, uint64_t position, unsigned int count);
+
+@interface MP3FrameIndex (Private)
+- (void)appendBlockWithOffsets:(const uint64_t *)offsets samples:(const unsigned int *)samples count:(NSUInteger)count
+					nextOffset:(uint64_t)nextOffset;
+- (void)writeBits:(uint32_t)value count:(unsigned int)count;
+@end
+
+
+@implementation MP3FrameIndex
+
+- (id)initWithBytes:(const uint8_t *)bytes length:(NSUInteger)length
+{
+	if (self = [super init]) {
+		// guess the capacity from a typical frame size, we'll grow the tables if necessary
+		allocedBlocks = MAX(length / (400 * MP3FrameIndexBlockSize), 16);
+		blocks = (MP3FrameIndexBlock *) malloc(allocedBlocks * sizeof(MP3FrameIndexBlock));
+		numBlocks = 0;
+		allocedBytes = MAX(length / 400 / 4, 1024);
+		bits = (uint8_t *) calloc(allocedBytes, 1);
+		numBits = 0;
+		numEntries = 0;
+		samplerate = 0;
+		samplesPerFrame = 0;
+		numSamples = 0;
+		
+		// the frames of a block are only known completely once the first frame of the next one is found
+		uint64_t		offsets[MP3FrameIndexBlockSize];
+		unsigned int	samples[MP3FrameIndexBlockSize];
+		NSUInteger		numPending = 0;
+		
+		MP3FrameHeader header;
+		MP3FrameHeader previous;
+		NSUInteger pos = MP3FrameNext(bytes, length, 0, NULL, &header);
+		while (pos < length) {
+			if (numPending == MP3FrameIndexBlockSize) {
+				[self appendBlockWithOffsets:offsets samples:samples count:numPending nextOffset:pos];
+				numPending = 0;
+			}
+			offsets[numPending] = pos;
+			samples[numPending] = header.samplesPerFrame;
+			numPending++;
+			numEntries++;
+			
+			if (samplerate == 0) {
+				samplerate = header.samplerate;
+				samplesPerFrame = header.samplesPerFrame;
+			} else if (samplesPerFrame != header.samplesPerFrame) {
+				samplesPerFrame = 0;
+			}
+			numSamples += header.samplesPerFrame;
+			
+			previous = header;
+			pos = MP3FrameNext(bytes, length, pos + header.frameLength, &previous, &header);
+		}
+		if (numPending > 0) {
+			[self appendBlockWithOffsets:offsets samples:samples count:numPending nextOffset:(offsets[numPending - 1] + previous.frameLength)];
+		}
+	}
+	
+	return self;
+}
+
+- (void)dealloc
+{
+	if (blocks != NULL) {
+		free(blocks);
+		blocks = NULL;
+	}
+	if (bits != NULL) {
+		free(bits);
+		bits = NULL;
+	}
+	
+	[super dealloc];
+}
+
+
+#pragma mark -
+
+
+- (NSUInteger)numberOfFrames
+{
+	return numEntries;
+}
+
+// walks at most one block from its anchor
+- (MP3FrameIndexEntry)entryAtIndex:(NSUInteger)index
+{
+	const MP3FrameIndexBlock *block = &blocks[index / MP3FrameIndexBlockSize];
+	NSUInteger frame = index % MP3FrameIndexBlockSize;
+	MP3FrameIndexEntry entry = { block->byteOffset, block->sampleOffset };
+	
+	if (block->samplesPerFrame > 0) {
+		entry.byteOffset += (uint64_t)frame * block->baseDistance;
+		entry.sampleOffset += (uint64_t)frame * block->samplesPerFrame;
+		if (block->distanceBits > 0) {
+			uint64_t position = block->bitOffset;
+			for (NSUInteger i = 0; i < frame; i++) {
+				entry.byteOffset += readBits(bits, position, block->distanceBits);
+				position += block->distanceBits;
+			}
+		}
+	} else {
+		unsigned int frameBits = block->distanceBits + 2;
+		uint64_t position = block->bitOffset;
+		for (NSUInteger i = 0; i < frame; i++) {
+			entry.byteOffset += block->baseDistance + readBits(bits, position, block->distanceBits);
+			entry.sampleOffset += samplesPerFrameForCode[readBits(bits, position + block->distanceBits, 2)];
+			position += frameBits;
+		}
+	}
+	
+	return entry;
+}
+
+- (NSUInteger)byteOffsetOfFrameAtIndex:(NSUInteger)index
+{
+	return (NSUInteger)[self entryAtIndex:index].byteOffset;
+}
+
+- (NSUInteger)frameIndexForSample:(uint64_t)sample
+{
+	if (numEntries == 0) {
+		return 0;
+	}
+	
+	if (samplesPerFrame > 0) {
+		// all frames are the same size, so this is a simple division
+		return (NSUInteger)MIN(sample / samplesPerFrame, numEntries - 1);
+	}
+	
+	// find the last block starting at or before the sample
+	NSUInteger low = 0;
+	NSUInteger high = numBlocks - 1;
+	while (low < high) {
+		NSUInteger mid = low + (high - low + 1) / 2;
+		if (blocks[mid].sampleOffset <= sample) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+	
+	// and the last frame of the block starting at or before it
+	NSUInteger first = low * MP3FrameIndexBlockSize;
+	NSUInteger count = MIN(numEntries - first, MP3FrameIndexBlockSize);
+	const MP3FrameIndexBlock *block = &blocks[low];
+	if (block->samplesPerFrame > 0) {
+		return first + (NSUInteger)MIN((sample - MIN(sample, block->sampleOffset)) / block->samplesPerFrame, count - 1);
+	}
+	
+	uint64_t sampleOffset = block->sampleOffset;
+	uint64_t position = block->bitOffset + block->distanceBits;
+	NSUInteger frame = 0;
+	while (frame + 1 < count) {
+		sampleOffset += samplesPerFrameForCode[readBits(bits, position, 2)];
+		if (sampleOffset > sample) {
+			break;
+		}
+		position += block->distanceBits + 2;
+		frame++;
+	}
+	
+	return first + frame;
+}
+
+- (NSUInteger)frameIndexForTime:(double)time
+{
+	if (time <= 0.0) {
+		return 0;
+	}
+	
+	return [self frameIndexForSample:(uint64_t)(time * samplerate)];
+}
+
+- (double)timeOfFrameAtIndex:(NSUInteger)index
+{
+	if (samplerate == 0) {
+		return 0.0;
+	}
+	
+	return (double)[self entryAtIndex:index].sampleOffset / samplerate;
+}
+
+- (int)samplerate
+{
+	return samplerate;
+}
+
+- (uint64_t)numberOfSamples
+{
+	return numSamples;
+}
+
+- (double)duration
+{
+	if (samplerate == 0) {
+		return 0.0;
+	}
+	
+	return (double)numSamples / samplerate;
+}
+
+- (NSUInteger)numberOfBytes
+{
+	return numBlocks * sizeof(MP3FrameIndexBlock) + (NSUInteger)((numBits + 7) / 8);
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation MP3FrameIndex (Private)
+
+- (void)appendBlockWithOffsets:(const uint64_t *)offsets samples:(const unsigned int *)samples count:(NSUInteger)count
+					nextOffset:(uint64_t)nextOffset
+{
+	if (numBlocks + 1 >= allocedBlocks) {
+		allocedBlocks *= 2;
+		blocks = (MP3FrameIndexBlock *) realloc(blocks, allocedBlocks * sizeof(MP3FrameIndexBlock));
+	}
+	
+	// the distance of the last frame reaches to the next block, or to the end of the frame at the end of the file
+	uint32_t distances[MP3FrameIndexBlockSize];
+	uint32_t minDistance = UINT32_MAX;
+	uint32_t maxDistance = 0;
+	BOOL mixed = NO;
+	for (NSUInteger i = 0; i < count; i++) {
+		distances[i] = (uint32_t)((i + 1 < count ? offsets[i + 1] : nextOffset) - offsets[i]);
+		minDistance = MIN(minDistance, distances[i]);
+		maxDistance = MAX(maxDistance, distances[i]);
+		mixed = mixed || (samples[i] != samples[0]);
+	}
+	
+	// numSamples already counts the frames of this block
+	uint64_t blockSamples = 0;
+	for (NSUInteger i = 0; i < count; i++) {
+		blockSamples += samples[i];
+	}
+	
+	MP3FrameIndexBlock *block = &blocks[numBlocks++];
+	block->byteOffset = offsets[0];
+	block->sampleOffset = numSamples - blockSamples;
+	block->bitOffset = numBits;
+	block->baseDistance = minDistance;
+	block->distanceBits = bitsForValue(maxDistance - minDistance);
+	block->samplesPerFrame = mixed ? 0 : samples[0];
+	
+	for (NSUInteger i = 0; i < count; i++) {
+		[self writeBits:(distances[i] - minDistance) count:block->distanceBits];
+		if (mixed) {
+			[self writeBits:codeForSamplesPerFrame(samples[i]) count:2];
+		}
+	}
+}
+
+- (void)writeBits:(uint32_t)value count:(unsigned int)count
+{
+	// readBits may look at up to 8 bytes past the last bit
+	NSUInteger neededBytes = (NSUInteger)((numBits + count + 7) / 8) + 8;
+	if (neededBytes > allocedBytes) {
+		NSUInteger oldBytes = allocedBytes;
+		while (neededBytes > allocedBytes) {
+			allocedBytes *= 2;
+		}
+		bits = (uint8_t *) realloc(bits, allocedBytes);
+		memset(bits + oldBytes, 0, allocedBytes - oldBytes);
+	}
+	
+	for (unsigned int i = 0; i < count; i++, numBits++) {
+		if (value & (1u << i)) {
+			bits[numBits / 8] |= (uint8_t)(1u << (numBits % 8));
+		}
+	}
+}
+
+@end
+
+
+#pragma mark -
+
+
+static unsigned int
+codeForSamplesPerFrame(unsigned int samples)
+{
+	for (unsigned int code = 0; code < 3; code++) {
+		if (samplesPerFrameForCode[code] == samples) {
+			return code;
+		}
+	}
+	return 3;
+}
+
+static unsigned int
+bitsForValue(uint32_t value)
+{
+	unsigned int count = 0;
+	while (value > 0) {
+		count++;
+		value >>= 1;
+	}
+	return count;
+}
+
+// the bits are stored least significant first
+static uint32_t
+readBits(const uint8_t *bits, uint64_t position, unsigned int count)
+{
+	uint64_t word = 0;
+	const uint8_t *bytes = bits + position / 8;
+	for (int i = 7; i >= 0; i--) {
+		word = (word << 8) | bytes[i];
+	}
+	word >>= position % 8;
+	
+	return (uint32_t)(word & ((count < 32) ? ((1ull << count) - 1) : 0xffffffffull));
+}
@@ -0,0 +1,800 @@
+//
+//  MP3InputSource.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#include "MP3InputSource.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MP3_INPUT_SOURCE_URING	1
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+
+// asks the kernel to read ahead aggressively, the readers go through their sections front to back
+static void
+adviseSequentialRead(int fd)
+{
+#if defined(__APPLE__)
+	fcntl(fd, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+
+#pragma mark -
+
+
+#if MP3_INPUT_SOURCE_URING
+
+typedef struct {
+	int						fd;
+	void					*sqRing;
+	size_t					sqRingSize;
+	void					*cqRing;
+	size_t					cqRingSize;
+	struct io_uring_sqe		*sqes;
+	size_t					sqesSize;
+	
+	unsigned				*sqTail;
+	unsigned				*sqMask;
+	unsigned				*sqArray;
+	unsigned				*cqHead;
+	unsigned				*cqTail;
+	unsigned				*cqMask;
+	struct io_uring_cqe		*cqes;
+} URing;
+
+static void
+uringFinish(URing *ring)
+{
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqesSize);
+	}
+	if (ring->cqRing != NULL && ring->cqRing != MAP_FAILED) {
+		munmap(ring->cqRing, ring->cqRingSize);
+	}
+	if (ring->sqRing != NULL && ring->sqRing != MAP_FAILED) {
+		munmap(ring->sqRing, ring->sqRingSize);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+}
+
+static int
+uringInit(URing *ring, unsigned entries)
+{
+	struct io_uring_params params;
+	
+	memset(ring, 0, sizeof(URing));
+	memset(&params, 0, sizeof(params));
+	ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		return 0;
+	}
+	
+	ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe *) mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+		int error = errno;
+		uringFinish(ring);
+		errno = error;
+		return 0;
+	}
+	
+	ring->sqTail = (unsigned *)((uint8_t *) ring->sqRing + params.sq_off.tail);
+	ring->sqMask = (unsigned *)((uint8_t *) ring->sqRing + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned *)((uint8_t *) ring->sqRing + params.sq_off.array);
+	ring->cqHead = (unsigned *)((uint8_t *) ring->cqRing + params.cq_off.head);
+	ring->cqTail = (unsigned *)((uint8_t *) ring->cqRing + params.cq_off.tail);
+	ring->cqMask = (unsigned *)((uint8_t *) ring->cqRing + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((uint8_t *) ring->cqRing + params.cq_off.cqes);
+	return 1;
+}
+
+static void
+uringQueueRead(URing *ring, int fd, uint8_t *buffer, size_t length, size_t offset, uint64_t userData)
+{
+	unsigned tail = *ring->sqTail;
+	unsigned index = tail & *ring->sqMask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t) buffer;
+	sqe->len = (uint32_t) length;
+	sqe->off = offset;
+	sqe->user_data = userData;
+	ring->sqArray[index] = index;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif
+
+
+#pragma mark -
+
+
+int
+MP3InputSourceOpen(MP3InputSource *source, int fd, size_t length, MP3InputSourceType type)
+{
+	memset(source, 0, sizeof(MP3InputSource));
+	source->fd = -1;
+	if (length == 0 || type >= MP3InputSourceTypeCount) {
+		errno = EINVAL;
+		return 0;
+	}
+	if (!MP3InputSourceTypeAvailable(type)) {
+		errno = ENOSYS;
+		return 0;
+	}
+	
+	void *bytes = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (bytes == MAP_FAILED) {
+		return 0;
+	}
+	if (type != MP3InputSourceMapped) {
+		adviseSequentialRead(fd);
+	}
+	
+	source->type = type;
+	source->fd = fd;
+	source->mapping = bytes;
+	source->mappingLength = length;
+	source->bytes = (const uint8_t *) bytes;
+	source->length = length;
+	return 1;
+}
+
+void
+MP3InputSourceAdvise(const MP3InputSource *source, size_t offset, size_t length, MP3InputSourceAdvice advice)
+{
+	static const int advices[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_WILLNEED, MADV_DONTNEED };
+	
+	if (source->mapping == NULL || offset >= source->length) {
+		return;
+	}
+	if (length > source->length - offset) {
+		length = source->length - offset;
+	}
+	
+	// madvise wants page boundaries, advice about a page partly in the range is fine for all but
+	// dontneed, which may only release pages completely inside it
+	size_t pageSize = (size_t) getpagesize();
+	size_t start = offset - (offset % pageSize);
+	size_t end = offset + length;
+	if (advice == MP3InputSourceAdviceDontNeed) {
+		start = ((offset + pageSize - 1) / pageSize) * pageSize;
+		end -= (end % pageSize);
+		if (end <= start) {
+			return;
+		}
+	}
+	
+	madvise((uint8_t *) source->mapping + start, end - start, advices[advice]);
+}
+
+void
+MP3InputSourceClose(MP3InputSource *source)
+{
+	if (source->mapping != NULL) {
+		munmap(source->mapping, source->mappingLength);
+	}
+	source->mapping = NULL;
+	source->mappingLength = 0;
+	source->bytes = NULL;
+	source->length = 0;
+	source->fd = -1;
+}
+
+int
+MP3InputSourceTypeAvailable(MP3InputSourceType type)
+{
+	switch (type) {
+		case MP3InputSourceMapped:
+		case MP3InputSourceRead:
+			return 1;
+			
+		case MP3InputSourceURing: {
+#if MP3_INPUT_SOURCE_URING
+			// the kernel may be too old, or io_uring may be forbidden in this container
+			URing ring;
+			if (uringInit(&ring, 1)) {
+				uringFinish(&ring);
+				return 1;
+			}
+#endif
+			return 0;
+		}
+			
+		default:
+			return 0;
+	}
+}
+
+const char *
+MP3InputSourceTypeName(MP3InputSourceType type)
+{
+	static const char *names[MP3InputSourceTypeCount] = { "mapped", "read", "uring" };
+	return (type < MP3InputSourceTypeCount) ? names[type] : "unknown";
+}
+
+MP3InputSourceType
+MP3InputSourceTypeForName(const char *name, MP3InputSourceType fallback)
+{
+	if (name == NULL) {
+		return fallback;
+	}
+	for (int type = 0; type < MP3InputSourceTypeCount; type++) {
+		if (strcmp(name, MP3InputSourceTypeName(type)) == 0) {
+			return type;
+		}
+	}
+	return fallback;
+}
+
+
+#pragma mark -
+
+
+typedef struct {
+	uint8_t		*buffer;
+	size_t		offset;			// where in the file the chunk starts
+	size_t		length;			// how much it asks for
+	size_t		filled;			// how much of that has been read
+	int			done;
+	int			error;
+} ReaderChunk;
+
+// the chunks are requested and handed out in file order, chunk n of the section lives in
+// chunks[n % MP3InputReaderReadahead]
+struct MP3InputReader {
+	MP3InputSourceType	type;
+	int					fd;
+	size_t				end;
+	size_t				nextOffset;		// where the next request starts
+	unsigned long		requested;		// how many chunks have been requested
+	unsigned long		handedOut;		// how many chunks have been handed out by MP3InputReaderRead
+	ReaderChunk			chunks[MP3InputReaderReadahead];
+	
+	// the read source
+	pthread_t			thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		condition;
+	int					threaded;
+	int					stopping;
+	
+#if MP3_INPUT_SOURCE_URING
+	// the uring source
+	URing				ring;
+	unsigned			inFlight;
+	unsigned			toSubmit;
+#endif
+};
+
+// takes the next chunk of the section for a request, if it may be read ahead yet
+static ReaderChunk *
+nextChunkToRequest(MP3InputReader *reader)
+{
+	if (reader->nextOffset >= reader->end || reader->requested - reader->handedOut >= MP3InputReaderReadahead) {
+		return NULL;
+	}
+	
+	ReaderChunk *chunk = &reader->chunks[reader->requested % MP3InputReaderReadahead];
+	chunk->offset = reader->nextOffset;
+	chunk->length = reader->end - reader->nextOffset;
+	if (chunk->length > MP3InputReaderChunkSize) {
+		chunk->length = MP3InputReaderChunkSize;
+	}
+	chunk->filled = 0;
+	chunk->done = 0;
+	chunk->error = 0;
+	reader->nextOffset += chunk->length;
+	reader->requested++;
+	return chunk;
+}
+
+static int
+readChunk(int fd, ReaderChunk *chunk)
+{
+	while (chunk->filled < chunk->length) {
+		ssize_t result = pread(fd, chunk->buffer + chunk->filled, chunk->length - chunk->filled, (off_t)(chunk->offset + chunk->filled));
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			// an empty read means the file got shorter since we looked at it
+			return (result < 0) ? errno : EIO;
+		}
+		chunk->filled += result;
+	}
+	return 0;
+}
+
+// reads the chunks one after the other while the decoder works on the ones before them
+static void *
+readThread(void *context)
+{
+	MP3InputReader *reader = (MP3InputReader *) context;
+	
+	pthread_mutex_lock(&reader->lock);
+	while (!reader->stopping) {
+		ReaderChunk *chunk = nextChunkToRequest(reader);
+		if (chunk == NULL) {
+			pthread_cond_wait(&reader->condition, &reader->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&reader->lock);
+		
+		int error = readChunk(reader->fd, chunk);
+		
+		pthread_mutex_lock(&reader->lock);
+		chunk->error = error;
+		chunk->done = 1;
+		pthread_cond_signal(&reader->condition);
+	}
+	pthread_mutex_unlock(&reader->lock);
+	
+	return NULL;
+}
+
+// waits until the next chunk to hand out is read, returns NULL at the end of the section
+static ReaderChunk *
+waitForReadChunk(MP3InputReader *reader)
+{
+	ReaderChunk *chunk = NULL;
+	
+	pthread_mutex_lock(&reader->lock);
+	if (reader->handedOut < reader->requested || reader->nextOffset < reader->end) {
+		// the thread requests it as soon as it is the only one left
+		chunk = &reader->chunks[reader->handedOut % MP3InputReaderReadahead];
+		while (reader->handedOut == reader->requested || !chunk->done) {
+			pthread_cond_wait(&reader->condition, &reader->lock);
+		}
+	}
+	pthread_mutex_unlock(&reader->lock);
+	
+	return chunk;
+}
+
+
+#if MP3_INPUT_SOURCE_URING
+
+static void
+uringQueueChunk(MP3InputReader *reader, ReaderChunk *chunk)
+{
+	uringQueueRead(&reader->ring, reader->fd, chunk->buffer + chunk->filled, chunk->length - chunk->filled,
+				   chunk->offset + chunk->filled, (uint64_t)(chunk - reader->chunks));
+	reader->inFlight++;
+	reader->toSubmit++;
+}
+
+// submits what is queued and waits for minComplete requests, then goes through all that completed
+static int
+uringComplete(MP3InputReader *reader, unsigned minComplete)
+{
+	URing *ring = &reader->ring;
+	
+	if (syscall(__NR_io_uring_enter, ring->fd, reader->toSubmit, minComplete, (minComplete > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0) < 0) {
+		return (errno == EINTR) ? 0 : errno;
+	}
+	reader->toSubmit = 0;
+	
+	unsigned head = *ring->cqHead;
+	unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+		ReaderChunk *chunk = &reader->chunks[cqe->user_data];
+		reader->inFlight--;
+		
+		if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+			uringQueueChunk(reader, chunk);
+		} else if (cqe->res <= 0) {
+			// an empty read means the file got shorter since we looked at it
+			chunk->error = (cqe->res < 0) ? -cqe->res : EIO;
+			chunk->done = 1;
+		} else {
+			chunk->filled += cqe->res;
+			if (chunk->filled < chunk->length) {
+				// short read, ask for the rest of the chunk
+				uringQueueChunk(reader, chunk);
+			} else {
+				chunk->done = 1;
+			}
+		}
+	}
+	__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// keeps the queue full, the kernel works on all of the requests while the decoder works on its chunk
+static ReaderChunk *
+waitForURingChunk(MP3InputReader *reader)
+{
+	ReaderChunk *chunk;
+	while ((chunk = nextChunkToRequest(reader)) != NULL) {
+		uringQueueChunk(reader, chunk);
+	}
+	if (reader->handedOut == reader->requested) {
+		return NULL;
+	}
+	
+	chunk = &reader->chunks[reader->handedOut % MP3InputReaderReadahead];
+	unsigned minComplete = chunk->done ? 0 : 1;
+	while (minComplete > 0 || reader->toSubmit > 0) {
+		int error = uringComplete(reader, minComplete);
+		if (error != 0) {
+			chunk->error = error;
+			chunk->done = 1;
+		}
+		minComplete = chunk->done ? 0 : 1;
+	}
+	
+	return chunk;
+}
+
+#endif
+
+
+MP3InputReader *
+MP3InputReaderCreate(const MP3InputSource *source, size_t start, size_t end)
+{
+	if (source->type == MP3InputSourceMapped || source->fd < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	MP3InputReader *reader = (MP3InputReader *) calloc(1, sizeof(MP3InputReader));
+	if (reader == NULL) {
+		return NULL;
+	}
+	reader->type = source->type;
+	reader->fd = source->fd;
+	reader->end = (end < source->length) ? end : source->length;
+	reader->nextOffset = start;
+	
+	for (int i = 0; i < MP3InputReaderReadahead; i++) {
+		reader->chunks[i].buffer = (uint8_t *) malloc(MP3InputReaderChunkSize);
+		if (reader->chunks[i].buffer == NULL) {
+			MP3InputReaderDestroy(reader);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	
+	switch (reader->type) {
+		case MP3InputSourceRead:
+			pthread_mutex_init(&reader->lock, NULL);
+			pthread_cond_init(&reader->condition, NULL);
+			reader->threaded = (pthread_create(&reader->thread, NULL, readThread, reader) == 0);
+			if (!reader->threaded) {
+				int error = errno;
+				pthread_cond_destroy(&reader->condition);
+				pthread_mutex_destroy(&reader->lock);
+				MP3InputReaderDestroy(reader);
+				errno = error;
+				return NULL;
+			}
+			break;
+			
+#if MP3_INPUT_SOURCE_URING
+		case MP3InputSourceURing:
+			if (!uringInit(&reader->ring, MP3InputReaderReadahead)) {
+				// uringInit cleaned up after itself already
+				int error = errno;
+				memset(&reader->ring, 0, sizeof(URing));
+				MP3InputReaderDestroy(reader);
+				errno = error;
+				return NULL;
+			}
+			break;
+#endif
+			
+		default:
+			MP3InputReaderDestroy(reader);
+			errno = ENOSYS;
+			return NULL;
+	}
+	
+	return reader;
+}
+
+void
+MP3InputReaderDestroy(MP3InputReader *reader)
+{
+	if (reader == NULL) {
+		return;
+	}
+	
+	if (reader->threaded) {
+		pthread_mutex_lock(&reader->lock);
+		reader->stopping = 1;
+		pthread_cond_signal(&reader->condition);
+		pthread_mutex_unlock(&reader->lock);
+		pthread_join(reader->thread, NULL);
+		pthread_cond_destroy(&reader->condition);
+		pthread_mutex_destroy(&reader->lock);
+	}
+#if MP3_INPUT_SOURCE_URING
+	if (reader->type == MP3InputSourceURing && reader->ring.sqRing != NULL) {
+		// requests still in flight write into the chunks, they have to be done before those go away
+		while (reader->inFlight > 0 && uringComplete(reader, 1) == 0) {
+		}
+		uringFinish(&reader->ring);
+	}
+#endif
+	
+	for (int i = 0; i < MP3InputReaderReadahead; i++) {
+		free(reader->chunks[i].buffer);
+	}
+	free(reader);
+}
+
+long
+MP3InputReaderRead(MP3InputReader *reader, uint8_t *buffer)
+{
+	ReaderChunk *chunk = NULL;
+	
+	switch (reader->type) {
+		case MP3InputSourceRead:
+			chunk = waitForReadChunk(reader);
+			break;
+#if MP3_INPUT_SOURCE_URING
+		case MP3InputSourceURing:
+			chunk = waitForURingChunk(reader);
+			break;
+#endif
+		default:
+			break;
+	}
+	if (chunk == NULL) {
+		return 0;
+	}
+	if (chunk->error != 0) {
+		// the chunk stays where it is, every further read fails the same way
+		errno = chunk->error;
+		return -1;
+	}
+	
+	long length = (long) chunk->length;
+	memcpy(buffer, chunk->buffer, chunk->length);
+	
+	// its buffer can take the next request now
+	if (reader->threaded) {
+		pthread_mutex_lock(&reader->lock);
+		reader->handedOut++;
+		pthread_cond_signal(&reader->condition);
+		pthread_mutex_unlock(&reader->lock);
+	} else {
+		reader->handedOut++;
+	}
+	return length;
+}
+
+
+#pragma mark -
+
+
+typedef struct {
+	int			active;
+	size_t		position;		// where the reader is
+	size_t		prefetched;		// everything before this has been touched
+	size_t		end;
+} PrefetchReader;
+
+struct MP3InputPrefetcher {
+	const MP3InputSource	*source;
+	size_t					distance;
+	
+	pthread_t				thread;
+	pthread_mutex_t			lock;
+	pthread_cond_t			condition;
+	int						stopping;
+	
+	PrefetchReader			*readers;
+	long					numReaders;
+	long					allocedReaders;
+};
+
+// the first reader that has less than distance bytes prefetched ahead of it, -1 if there is none
+static long
+nextReaderToPrefetch(MP3InputPrefetcher *prefetcher)
+{
+	for (long i = 0; i < prefetcher->numReaders; i++) {
+		PrefetchReader *reader = &prefetcher->readers[i];
+		size_t target = reader->position + prefetcher->distance;
+		if (target > reader->end) {
+			target = reader->end;
+		}
+		if (reader->active && reader->prefetched < target) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void *
+prefetchThread(void *context)
+{
+	MP3InputPrefetcher *prefetcher = (MP3InputPrefetcher *) context;
+	size_t pageSize = (size_t) getpagesize();
+	
+	pthread_mutex_lock(&prefetcher->lock);
+	while (!prefetcher->stopping) {
+		long i = nextReaderToPrefetch(prefetcher);
+		if (i < 0) {
+			pthread_cond_wait(&prefetcher->condition, &prefetcher->lock);
+			continue;
+		}
+		
+		// one chunk at a time, so that all readers stay ahead
+		size_t start = prefetcher->readers[i].prefetched;
+		size_t end = start + MP3InputSourceChunkSize;
+		if (end > prefetcher->readers[i].end) {
+			end = prefetcher->readers[i].end;
+		}
+		prefetcher->readers[i].prefetched = end;
+		pthread_mutex_unlock(&prefetcher->lock);
+		
+		// faulting the pages in here is what the reader doesn't have to wait for anymore
+		const volatile uint8_t *bytes = prefetcher->source->bytes;
+		for (size_t offset = start - (start % pageSize); offset < end; offset += pageSize) {
+			(void) bytes[offset];
+		}
+		
+		pthread_mutex_lock(&prefetcher->lock);
+	}
+	pthread_mutex_unlock(&prefetcher->lock);
+	
+	return NULL;
+}
+
+MP3InputPrefetcher *
+MP3InputPrefetcherCreate(const MP3InputSource *source, size_t distance)
+{
+	MP3InputPrefetcher *prefetcher = (MP3InputPrefetcher *) calloc(1, sizeof(MP3InputPrefetcher));
+	if (prefetcher == NULL) {
+		return NULL;
+	}
+	
+	prefetcher->source = source;
+	prefetcher->distance = distance;
+	pthread_mutex_init(&prefetcher->lock, NULL);
+	pthread_cond_init(&prefetcher->condition, NULL);
+	if (pthread_create(&prefetcher->thread, NULL, prefetchThread, prefetcher) != 0) {
+		pthread_cond_destroy(&prefetcher->condition);
+		pthread_mutex_destroy(&prefetcher->lock);
+		free(prefetcher);
+		return NULL;
+	}
+	
+	return prefetcher;
+}
+
+void
+MP3InputPrefetcherDestroy(MP3InputPrefetcher *prefetcher)
+{
+	if (prefetcher == NULL) {
+		return;
+	}
+	
+	pthread_mutex_lock(&prefetcher->lock);
+	prefetcher->stopping = 1;
+	pthread_cond_signal(&prefetcher->condition);
+	pthread_mutex_unlock(&prefetcher->lock);
+	pthread_join(prefetcher->thread, NULL);
+	
+	pthread_cond_destroy(&prefetcher->condition);
+	pthread_mutex_destroy(&prefetcher->lock);
+	free(prefetcher->readers);
+	free(prefetcher);
+}
+
+long
+MP3InputPrefetcherAddReader(MP3InputPrefetcher *prefetcher, size_t start, size_t end)
+{
+	long reader = -1;
+	
+	if (prefetcher == NULL) {
+		return -1;
+	}
+	if (end > prefetcher->source->length) {
+		end = prefetcher->source->length;
+	}
+	
+	pthread_mutex_lock(&prefetcher->lock);
+	// reuse the slot of a reader that is done
+	for (long i = 0; i < prefetcher->numReaders; i++) {
+		if (!prefetcher->readers[i].active) {
+			reader = i;
+			break;
+		}
+	}
+	if (reader < 0) {
+		if (prefetcher->numReaders >= prefetcher->allocedReaders) {
+			long alloced = (prefetcher->allocedReaders > 0) ? (prefetcher->allocedReaders * 2) : 16;
+			PrefetchReader *readers = (PrefetchReader *) realloc(prefetcher->readers, alloced * sizeof(PrefetchReader));
+			if (readers == NULL) {
+				pthread_mutex_unlock(&prefetcher->lock);
+				return -1;
+			}
+			prefetcher->readers = readers;
+			prefetcher->allocedReaders = alloced;
+		}
+		reader = prefetcher->numReaders++;
+	}
+	
+	prefetcher->readers[reader].active = 1;
+	prefetcher->readers[reader].position = start;
+	prefetcher->readers[reader].prefetched = start;
+	prefetcher->readers[reader].end = end;
+	pthread_cond_signal(&prefetcher->condition);
+	pthread_mutex_unlock(&prefetcher->lock);
+	
+	return reader;
+}
+
+void
+MP3InputPrefetcherUpdateReader(MP3InputPrefetcher *prefetcher, long reader, size_t position)
+{
+	if (prefetcher == NULL || reader < 0) {
+		return;
+	}
+	
+	pthread_mutex_lock(&prefetcher->lock);
+	prefetcher->readers[reader].position = position;
+	if (prefetcher->readers[reader].prefetched < position) {
+		// the reader overtook us, there is no point in touching what it has read already
+		prefetcher->readers[reader].prefetched = position;
+	}
+	pthread_cond_signal(&prefetcher->condition);
+	pthread_mutex_unlock(&prefetcher->lock);
+}
+
+void
+MP3InputPrefetcherRemoveReader(MP3InputPrefetcher *prefetcher, long reader)
+{
+	if (prefetcher == NULL || reader < 0) {
+		return;
+	}
+	
+	pthread_mutex_lock(&prefetcher->lock);
+	prefetcher->readers[reader].active = 0;
+	pthread_mutex_unlock(&prefetcher->lock);
+}
@@ -0,0 +1,118 @@
+//
+//  MP3InputSource.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MP3INPUTSOURCE_H
+#define MP3INPUTSOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the decoders work on the file as one block of bytes, it is mapped for every input source. seeking,
+// playback and the frame index address it by byte offset. the input sources differ in how the silence
+// analyzers get the bytes of their sections: straight from the mapping, where the pages are faulted in
+// by whoever touches them first, or read through a reader that holds a few chunks at a time.
+typedef enum {
+	MP3InputSourceMapped,		// the analyzers decode the mapping, advice and the prefetcher keep the faults off them
+	MP3InputSourceRead,			// the analyzers read with pread, a thread reads ahead while they decode
+	MP3InputSourceURing,		// the analyzers read with a queue of io_uring requests (linux only)
+	MP3InputSourceTypeCount
+} MP3InputSourceType;
+
+// how much the prefetcher touches at a time
+#define MP3InputSourceChunkSize		(1024 * 1024)
+
+// what the pages of a mapped file will be used for
+typedef enum {
+	MP3InputSourceAdviceNormal,			// random access, like seeking around for playback
+	MP3InputSourceAdviceSequential,		// read front to back, the kernel can read ahead far
+	MP3InputSourceAdviceWillNeed,		// start reading these now, without waiting for them
+	MP3InputSourceAdviceDontNeed		// done with these, the pages can go
+} MP3InputSourceAdvice;
+
+typedef struct {
+	MP3InputSourceType	type;
+	int					fd;				// what the readers read from, it stays owned by the caller
+	const uint8_t		*bytes;
+	size_t				length;
+	
+	void				*mapping;		// what has to be unmapped again
+	size_t				mappingLength;
+} MP3InputSource;
+
+// maps length bytes of the file as one block, returns 0 on failure with errno set. the fd has to stay
+// open as long as the source does.
+int MP3InputSourceOpen(MP3InputSource *source, int fd, size_t length, MP3InputSourceType type);
+void MP3InputSourceClose(MP3InputSource *source);
+
+void MP3InputSourceAdvise(const MP3InputSource *source, size_t offset, size_t length, MP3InputSourceAdvice advice);
+
+int MP3InputSourceTypeAvailable(MP3InputSourceType type);
+const char *MP3InputSourceTypeName(MP3InputSourceType type);
+
+// the type with the given name, or fallback if there is no such type
+MP3InputSourceType MP3InputSourceTypeForName(const char *name, MP3InputSourceType fallback);
+
+
+// reads the bytes from start to end of a read or uring source front to back, one chunk at a time. the
+// reader keeps up to MP3InputReaderReadahead chunks read ahead of the one handed out last, so however
+// large the section is, it never holds more than that in memory.
+
+// size of a single read request
+#define MP3InputReaderChunkSize		(256 * 1024)
+
+// how many chunks are read ahead: the read source has a thread read them one after the other,
+// the uring source queues a request for each of them
+#define MP3InputReaderReadahead		4
+
+typedef struct MP3InputReader MP3InputReader;
+
+// returns NULL with errno set on failure, and for mapped sources, which have nothing to read
+MP3InputReader *MP3InputReaderCreate(const MP3InputSource *source, size_t start, size_t end);
+void MP3InputReaderDestroy(MP3InputReader *reader);
+
+// copies the next chunk to buffer, which has room for MP3InputReaderChunkSize bytes. returns the
+// length of the chunk, 0 at the end, or -1 with errno set if it could not be read
+long MP3InputReaderRead(MP3InputReader *reader, uint8_t *buffer);
+
+
+// a thread that touches the pages of a mapped file a bounded distance ahead of each reader, so that
+// the readers find them in memory instead of waiting for the disk themselves
+typedef struct MP3InputPrefetcher MP3InputPrefetcher;
+
+MP3InputPrefetcher *MP3InputPrefetcherCreate(const MP3InputSource *source, size_t distance);
+void MP3InputPrefetcherDestroy(MP3InputPrefetcher *prefetcher);
+
+// a reader going through the bytes from start to end, returns the reader's number or -1
+long MP3InputPrefetcherAddReader(MP3InputPrefetcher *prefetcher, size_t start, size_t end);
+void MP3InputPrefetcherUpdateReader(MP3InputPrefetcher *prefetcher, long reader, size_t position);
+void MP3InputPrefetcherRemoveReader(MP3InputPrefetcher *prefetcher, long reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
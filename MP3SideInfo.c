@@ -0,0 +1,181 @@
+//
+//  MP3SideInfo.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#include "MP3SideInfo.h"
+
+#include <math.h>
+
+
+// scalefactor bit lengths for MPEG 1 scalefac_compress values
+static const int slen1Table[16] = { 0, 0, 0, 0, 3, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4 };
+static const int slen2Table[16] = { 0, 1, 2, 3, 0, 1, 2, 3, 1, 2, 3, 1, 2, 3, 2, 3 };
+
+typedef struct {
+	const uint8_t	*ptr;
+	size_t			bitPosition;
+} BitReader;
+
+static unsigned int
+readBits(BitReader *reader, int count)
+{
+	unsigned int value = 0;
+	while (count--) {
+		value = (value << 1) | ((reader->ptr[reader->bitPosition >> 3] >> (7 - (reader->bitPosition & 7))) & 1);
+		reader->bitPosition++;
+	}
+	return value;
+}
+
+static int
+sideInfoSize(const MP3FrameHeader *header)
+{
+	if (header->version == MP3FrameVersion1) {
+		return (header->channels == 1) ? 17 : 32;
+	} else {
+		return (header->channels == 1) ? 9 : 17;
+	}
+}
+
+// upper bound for the scalefactor bits in part2_3_length
+static unsigned int
+part2Length(const MP3FrameHeader *header, const MP3GranuleChannelInfo *info)
+{
+	if (header->version == MP3FrameVersion1) {
+		int slen1 = slen1Table[info->scalefacCompress & 0x0f];
+		int slen2 = slen2Table[info->scalefacCompress & 0x0f];
+		if (info->blockType == 2) {
+			return (info->mixedBlock ? 17 : 18) * slen1 + 18 * slen2;
+		} else {
+			return 11 * slen1 + 10 * slen2;
+		}
+	}
+	
+	// the lsf scalefactor partitioning is involved, 21 bands with at most 4 bits each is an upper bound
+	return 84;
+}
+
+
+#pragma mark -
+
+
+unsigned int
+MP3SideInfoMainDataCapacity(const MP3FrameHeader *header)
+{
+	unsigned int used = MP3FrameHeaderSize + (header->hasCRC ? 2 : 0) + sideInfoSize(header);
+	return (header->layer == 3 && header->frameLength > used) ? (header->frameLength - used) : 0;
+}
+
+int
+MP3SideInfoParse(const uint8_t *frame, size_t available, const MP3FrameHeader *header, MP3SideInfo *sideInfo)
+{
+	if (header->layer != 3) {
+		return 0;
+	}
+	
+	size_t offset = MP3FrameHeaderSize + (header->hasCRC ? 2 : 0);
+	int size = sideInfoSize(header);
+	if (available < offset + size || header->frameLength < offset + size) {
+		return 0;
+	}
+	
+	BitReader reader = { frame + offset, 0 };
+	int lsf = (header->version != MP3FrameVersion1);
+	
+	sideInfo->numChannels = header->channels;
+	sideInfo->numGranules = lsf ? 1 : 2;
+	sideInfo->mainDataSize = header->frameLength - (unsigned int)(offset + size);
+	
+	if (lsf) {
+		sideInfo->mainDataBegin = readBits(&reader, 8);
+		readBits(&reader, (header->channels == 1) ? 1 : 2);		// private bits
+	} else {
+		sideInfo->mainDataBegin = readBits(&reader, 9);
+		readBits(&reader, (header->channels == 1) ? 5 : 3);		// private bits
+		readBits(&reader, 4 * header->channels);				// scfsi
+	}
+	
+	for (int gr = 0; gr < sideInfo->numGranules; gr++) {
+		for (int ch = 0; ch < header->channels; ch++) {
+			MP3GranuleChannelInfo *info = &sideInfo->granules[gr][ch];
+			info->part23Length = readBits(&reader, 12);
+			info->bigValues = readBits(&reader, 9);
+			info->globalGain = readBits(&reader, 8);
+			info->scalefacCompress = readBits(&reader, lsf ? 9 : 4);
+			info->subblockGain[0] = info->subblockGain[1] = info->subblockGain[2] = 0;
+			if (readBits(&reader, 1)) {
+				// window switching
+				info->blockType = readBits(&reader, 2);
+				info->mixedBlock = readBits(&reader, 1);
+				readBits(&reader, 2 * 5);							// table select
+				for (int i = 0; i < 3; i++) {
+					info->subblockGain[i] = readBits(&reader, 3);
+				}
+			} else {
+				info->blockType = 0;
+				info->mixedBlock = 0;
+				readBits(&reader, 3 * 5 + 4 + 3);					// table select, region counts
+			}
+			readBits(&reader, lsf ? 2 : 3);							// preflag, scalefac scale, count1 table
+		}
+	}
+	
+	return 1;
+}
+
+double
+MP3SideInfoEstimateVolume(const MP3FrameHeader *header, const MP3SideInfo *sideInfo)
+{
+	double sum = 0.0;
+	
+	for (int gr = 0; gr < sideInfo->numGranules; gr++) {
+		for (int ch = 0; ch < sideInfo->numChannels; ch++) {
+			const MP3GranuleChannelInfo *info = &sideInfo->granules[gr][ch];
+			unsigned int lines = info->bigValues * 2;
+			unsigned int part2 = part2Length(header, info);
+			if (lines == 0 || info->part23Length <= part2) {
+				// at most +-1 values in the count1 region, we don't count on those
+				continue;
+			}
+			
+			// the short blocks may be attenuated further by their subblock gains
+			int gain = info->globalGain - 210;
+			if (info->blockType == 2) {
+				int maxSubblockGain = info->subblockGain[0];
+				if (info->subblockGain[1] > maxSubblockGain) maxSubblockGain = info->subblockGain[1];
+				if (info->subblockGain[2] > maxSubblockGain) maxSubblockGain = info->subblockGain[2];
+				gain -= 8 * maxSubblockGain;
+			}
+			double stepSize = pow(2.0, gain / 4.0);
+			
+			// the huffman codes take about 2 bits per doubling of a quantized value plus the sign bit
+			double bitsPerLine = (double)(info->part23Length - part2) / lines;
+			double quantized = pow(2.0, fmax(0.0, bitsPerLine - 2.0) / 2.0);
+			
+			// each subband with 18 lines of that size gives about one sample of that size in every time slot
+			double subbands = fmin(32.0, ceil(lines / 18.0));
+			sum += subbands * stepSize * pow(quantized, 4.0 / 3.0) * 32768.0;
+		}
+	}
+	
+	return sum / (sideInfo->numGranules * sideInfo->numChannels);
+}
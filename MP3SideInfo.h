@@ -0,0 +1,74 @@
+//
+//  MP3SideInfo.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MP3SIDEINFO_H
+#define MP3SIDEINFO_H
+
+#include "MP3FrameHeader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the largest value main_data_begin can take, the bit reservoir never reaches back further
+#define MP3SideInfoMaxMainDataBegin		511
+
+// how much louder than the volume threshold the side info estimate has to be for a frame to count as loud
+#define MP3SideInfoLoudnessMargin		4.0
+
+typedef struct {
+	unsigned int		part23Length;
+	unsigned int		bigValues;
+	int					globalGain;
+	unsigned int		scalefacCompress;
+	int					blockType;			// 0 if window switching is off
+	int					mixedBlock;
+	int					subblockGain[3];
+} MP3GranuleChannelInfo;
+
+// the layer III side info following the frame header
+typedef struct {
+	unsigned int			mainDataBegin;
+	unsigned int			mainDataSize;		// bytes of main data this frame carries
+	int						numGranules;
+	int						numChannels;
+	MP3GranuleChannelInfo	granules[2][2];
+} MP3SideInfo;
+
+// the bytes of a layer III frame after its header, crc and side info, which hold main data of this
+// or the following frames
+unsigned int MP3SideInfoMainDataCapacity(const MP3FrameHeader *header);
+
+// parses the side info of the layer III frame at frame, returns 0 for other layers or if it doesn't fit
+int MP3SideInfoParse(const uint8_t *frame, size_t available, const MP3FrameHeader *header, MP3SideInfo *sideInfo);
+
+// estimates the average volume of the frame on the same scale as the analyzer's per frame volume,
+// only from global gains, big values and the bits spent on the huffman data. this is a rough
+// estimate, so it has to be compared with a generous margin.
+double MP3SideInfoEstimateVolume(const MP3FrameHeader *header, const MP3SideInfo *sideInfo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
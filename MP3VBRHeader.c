@@ -0,0 +1,259 @@
+//
+//  MP3VBRHeader.c
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#include "MP3VBRHeader.h"
+
+#include <string.h>
+
+
+#define XingFlagFrames			0x0001
+#define XingFlagBytes			0x0002
+#define XingFlagTOC				0x0004
+#define XingFlagQuality			0x0008
+
+// the VBRI header always sits this far behind the frame header
+#define VBRIHeaderOffset		32
+#define VBRIHeaderSize			26
+
+static uint32_t readBigEndian(const uint8_t *ptr, int bytes);
+static int parseXing(const uint8_t *frame, size_t available, MP3VBRHeader *header);
+static int parseVBRI(const uint8_t *frame, size_t available, MP3VBRHeader *header);
+static void linearSeekMap(MP3VBRHeader *header, uint64_t start, uint64_t end);
+
+
+int
+MP3VBRHeaderParse(const uint8_t *data, size_t length, MP3VBRHeader *header)
+{
+	memset(header, 0, sizeof(MP3VBRHeader));
+	
+	size_t offset = MP3FrameNext(data, length, 0, NULL, &header->frameHeader);
+	if (offset >= length || header->frameHeader.layer != 3) {
+		return 0;
+	}
+	header->frameOffset = offset;
+	
+	// the header has to be inside the frame, but the last frame of a short file may be cut off
+	size_t available = length - offset;
+	if (available > header->frameHeader.frameLength) {
+		available = header->frameHeader.frameLength;
+	}
+	
+	if (parseXing(data + offset, available, header) || parseVBRI(data + offset, available, header)) {
+		// some encoders write the header of a file they couldn't finish
+		return (header->numFrames > 0);
+	}
+	
+	return 0;
+}
+
+uint64_t
+MP3VBRHeaderNumberOfSamples(const MP3VBRHeader *header)
+{
+	return ((uint64_t)header->numFrames + 1) * header->frameHeader.samplesPerFrame;
+}
+
+double
+MP3VBRHeaderDuration(const MP3VBRHeader *header)
+{
+	if (header->frameHeader.samplerate == 0) {
+		return 0.0;
+	}
+	
+	return (double)MP3VBRHeaderNumberOfSamples(header) / header->frameHeader.samplerate;
+}
+
+size_t
+MP3VBRHeaderByteOffsetForTime(const MP3VBRHeader *header, double time)
+{
+	double duration = MP3VBRHeaderDuration(header);
+	if (duration <= 0.0 || time <= 0.0) {
+		return (size_t)header->seekOffsets[0];
+	}
+	
+	double percent = time / duration * (MP3VBRHeaderSeekPoints - 1);
+	if (percent >= MP3VBRHeaderSeekPoints - 1) {
+		return (size_t)header->seekOffsets[MP3VBRHeaderSeekPoints - 1];
+	}
+	
+	// linear between the two points around it
+	int point = (int)percent;
+	double a = (double)header->seekOffsets[point];
+	double b = (double)header->seekOffsets[point + 1];
+	return (size_t)(a + (b - a) * (percent - point));
+}
+
+
+#pragma mark -
+
+
+static uint32_t
+readBigEndian(const uint8_t *ptr, int bytes)
+{
+	uint32_t value = 0;
+	while (bytes--) {
+		value = (value << 8) | *ptr++;
+	}
+	return value;
+}
+
+static int
+parseXing(const uint8_t *frame, size_t available, MP3VBRHeader *header)
+{
+	// right behind the side info of the frame
+	size_t pos = MP3FrameHeaderSize;
+	if (header->frameHeader.version == MP3FrameVersion1) {
+		pos += (header->frameHeader.channels == 1) ? 17 : 32;
+	} else {
+		pos += (header->frameHeader.channels == 1) ? 9 : 17;
+	}
+	
+	if (pos + 8 > available || (memcmp(frame + pos, "Xing", 4) != 0 && memcmp(frame + pos, "Info", 4) != 0)) {
+		return 0;
+	}
+	
+	header->type = MP3VBRHeaderXing;
+	uint32_t flags = readBigEndian(frame + pos + 4, 4);
+	pos += 8;
+	
+	if (flags & XingFlagFrames) {
+		if (pos + 4 > available) {
+			return 0;
+		}
+		header->numFrames = readBigEndian(frame + pos, 4);
+		pos += 4;
+	}
+	if (flags & XingFlagBytes) {
+		if (pos + 4 > available) {
+			return 0;
+		}
+		header->numBytes = readBigEndian(frame + pos, 4);
+		pos += 4;
+	}
+	
+	// the toc and the byte count are counted from the header frame
+	uint64_t start = header->frameOffset;
+	uint64_t end = start + header->numBytes;
+	const uint8_t *toc = NULL;
+	if (flags & XingFlagTOC) {
+		if (pos + 100 > available) {
+			return 0;
+		}
+		toc = frame + pos;
+		pos += 100;
+	}
+	if (flags & XingFlagQuality) {
+		pos += 4;
+	}
+	
+	if (toc != NULL && header->numBytes > 0) {
+		// every entry is the position at its percent of the duration, in 256ths of the file
+		for (int i = 0; i < MP3VBRHeaderSeekPoints - 1; i++) {
+			header->seekOffsets[i] = start + ((uint64_t)toc[i] * header->numBytes) / 256;
+			if (i > 0 && header->seekOffsets[i] < header->seekOffsets[i - 1]) {
+				header->seekOffsets[i] = header->seekOffsets[i - 1];
+			}
+		}
+		header->seekOffsets[MP3VBRHeaderSeekPoints - 1] = end;
+	} else if (header->numBytes > 0) {
+		// an Info header of a constant bitrate file often has no toc
+		linearSeekMap(header, start + header->frameHeader.frameLength, end);
+	} else {
+		return 0;
+	}
+	
+	// the LAME tag keeps the encoder delay and padding 21 bytes into it
+	if (pos + 24 <= available &&
+		(memcmp(frame + pos, "LAME", 4) == 0 || memcmp(frame + pos, "Lavf", 4) == 0 || memcmp(frame + pos, "Lavc", 4) == 0)) {
+		uint32_t delayAndPadding = readBigEndian(frame + pos + 21, 3);
+		header->hasEncoderDelay = 1;
+		header->encoderDelay = delayAndPadding >> 12;
+		header->encoderPadding = delayAndPadding & 0x0fff;
+	}
+	
+	return 1;
+}
+
+static int
+parseVBRI(const uint8_t *frame, size_t available, MP3VBRHeader *header)
+{
+	size_t pos = MP3FrameHeaderSize + VBRIHeaderOffset;
+	if (pos + VBRIHeaderSize > available || memcmp(frame + pos, "VBRI", 4) != 0) {
+		return 0;
+	}
+	
+	header->type = MP3VBRHeaderVBRI;
+	header->hasEncoderDelay = 1;
+	header->encoderDelay = readBigEndian(frame + pos + 6, 2);
+	header->numBytes = readBigEndian(frame + pos + 10, 4);
+	header->numFrames = readBigEndian(frame + pos + 14, 4);
+	
+	unsigned int numEntries = readBigEndian(frame + pos + 18, 2);
+	unsigned int scale = readBigEndian(frame + pos + 20, 2);
+	unsigned int entrySize = readBigEndian(frame + pos + 22, 2);
+	unsigned int framesPerEntry = readBigEndian(frame + pos + 24, 2);
+	pos += VBRIHeaderSize;
+	
+	uint64_t start = header->frameOffset + header->frameHeader.frameLength;
+	uint64_t end = header->frameOffset + header->numBytes;
+	if (header->numFrames == 0 || numEntries == 0 || framesPerEntry == 0 || entrySize == 0 || entrySize > 4 ||
+		pos + (size_t)numEntries * entrySize > available) {
+		linearSeekMap(header, start, end);
+		return 1;
+	}
+	
+	// each entry is the size of the next framesPerEntry frames, the seek map points are found between them
+	const uint8_t *table = frame + pos;
+	uint64_t entryStart = start;
+	unsigned int entry = 0;
+	for (int i = 0; i < MP3VBRHeaderSeekPoints; i++) {
+		double targetFrame = (double)header->numFrames * i / (MP3VBRHeaderSeekPoints - 1);
+		while (entry < numEntries && (double)(entry + 1) * framesPerEntry <= targetFrame) {
+			entryStart += (uint64_t)readBigEndian(table + entry * entrySize, entrySize) * scale;
+			entry++;
+		}
+		
+		double fraction = 0.0;
+		uint64_t entryBytes = 0;
+		if (entry < numEntries) {
+			entryBytes = (uint64_t)readBigEndian(table + entry * entrySize, entrySize) * scale;
+			fraction = (targetFrame - (double)entry * framesPerEntry) / framesPerEntry;
+		}
+		header->seekOffsets[i] = entryStart + (uint64_t)(entryBytes * fraction);
+		if (header->numBytes > 0 && header->seekOffsets[i] > end) {
+			header->seekOffsets[i] = end;
+		}
+	}
+	
+	return 1;
+}
+
+static void
+linearSeekMap(MP3VBRHeader *header, uint64_t start, uint64_t end)
+{
+	if (end < start) {
+		end = start;
+	}
+	for (int i = 0; i < MP3VBRHeaderSeekPoints; i++) {
+		header->seekOffsets[i] = start + ((end - start) * i) / (MP3VBRHeaderSeekPoints - 1);
+	}
+}
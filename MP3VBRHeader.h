@@ -0,0 +1,72 @@
+//
+//  MP3VBRHeader.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#ifndef MP3VBRHEADER_H
+#define MP3VBRHEADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MP3FrameHeader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the seek map has a byte offset for every percent of the duration, and one for the end
+#define MP3VBRHeaderSeekPoints		101
+
+typedef enum {
+	MP3VBRHeaderXing,		// Xing or Info header of LAME and most other encoders, maybe with a LAME tag
+	MP3VBRHeaderVBRI		// Fraunhofer's VBRI header
+} MP3VBRHeaderType;
+
+// what the first frame of a file can tell about all of it
+typedef struct {
+	MP3VBRHeaderType	type;
+	MP3FrameHeader		frameHeader;		// of the frame carrying the vbr header, it decodes to silence
+	size_t				frameOffset;
+	uint32_t			numFrames;			// audio frames after the header frame
+	uint32_t			numBytes;			// 0 if not given
+	int					hasEncoderDelay;
+	unsigned int		encoderDelay;		// samples the encoder put before the audio
+	unsigned int		encoderPadding;		// and after it
+	uint64_t			seekOffsets[MP3VBRHeaderSeekPoints];
+} MP3VBRHeader;
+
+// looks for a vbr header in the first frame of data, returns 0 if there is none or it has no frame count
+int MP3VBRHeaderParse(const uint8_t *data, size_t length, MP3VBRHeader *header);
+
+// samples and duration of all frames as the decoder sees them, including the header frame and the
+// encoder delay and padding
+uint64_t MP3VBRHeaderNumberOfSamples(const MP3VBRHeader *header);
+double MP3VBRHeaderDuration(const MP3VBRHeader *header);
+
+// an approximate offset of the time from the seek map, the frame there still has to be synced to
+size_t MP3VBRHeaderByteOffsetForTime(const MP3VBRHeader *header, double time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -67,6 +67,11 @@
 		@"[trackNumber] - [title]",			@"PreferredExportFilenameFormat",
 		[NSNumber numberWithInteger:5],			@"BreakDownSlicesSegmentDurationMinutes",
 		[NSNumber numberWithInteger:15],		@"BreakDownSlicesSegmentDurationTolerance",
+		[NSNumber numberWithInteger:0],			@"AnalysisThreadCount",
+		@"mapped",								@"InputSource",
+		[NSNumber numberWithBool:NO],			@"InputPrefetch",
+		[NSNumber numberWithBool:NO],			@"SideInfoPrescan",
+		@"frame",								@"SilenceResolution",
 		nil]];
 }
 
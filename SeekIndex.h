@@ -21,30 +21,62 @@
 //  along with AudioSlicer; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
 
-#import <Cocoa/Cocoa.h>
+#import <Foundation/Foundation.h>
 
 typedef struct {
 	double			time;
 	NSUInteger		byteOffset;
 } SeekIndexEntry;
 
+// a frozen index is kept as a snapshot: this header, the times of all entries and then their byte
+// offsets, so a lookup only reads the times it searches. it is written in the byte order of the machine
+// and swapped when it is read on another one, otherwise it can be used right from a mapped file.
+#define SeekIndexSnapshotMagic		0x53496478		// 'SIdx'
+#define SeekIndexSnapshotVersion	1
+
+typedef struct {
+	uint32_t		magic;
+	uint32_t		version;
+	uint64_t		numEntries;
+} SeekIndexSnapshotHeader;
+
+// the entries are kept sorted by time. while the index is filled they are added under a lock, preferably
+// in batches. once it is complete it is frozen into a snapshot that never changes again, and any number
+// of threads look up entries in it without the lock.
 @interface SeekIndex : NSObject {
+	// build phase
 	NSUInteger		numEntries;
 	NSUInteger		allocedEntries;
 	SeekIndexEntry	*entries;
+	BOOL			complete;
 	
 	NSLock			*syncLock;
+	
+	// frozen phase, the arrays point into the snapshot
+	NSData			*snapshot;
+	const double	*frozenTimes;
+	const uint64_t	*frozenOffsets;
 }
 
 - (id)initWithCapacity:(NSUInteger)capacity;
 - (id)init;
+- (id)initWithSnapshot:(NSData *)data;
+- (id)initWithContentsOfMappedFile:(NSString *)path;
 - (void)dealloc;
 
 - (id)initWithCoder:(NSCoder *)coder;
 - (void)encodeWithCoder:(NSCoder *)coder;
 
 - (void)addOffset:(NSUInteger)offset forTimeIndex:(double)time;
+- (void)addEntries:(const SeekIndexEntry *)newEntries count:(NSUInteger)count;
+- (void)setComplete;
+- (BOOL)isComplete;
+
+// nil until the index is complete
+- (NSData *)snapshot;
+- (BOOL)writeSnapshotToFile:(NSString *)path;
 
+- (NSUInteger)numberOfEntries;
 - (SeekIndexEntry)entryForTimeIndex:(double)time;
 - (NSUInteger)offsetForTimeIndex:(double)time;
 
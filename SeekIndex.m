@@ -23,17 +23,30 @@
 
 #import "SeekIndex.h"
 
+static int compareEntryTimes(const void *a, const void *b);
+static NSUInteger lastEntryNotAfter(const void *times, size_t stride, NSUInteger count, double time);
+static NSData *snapshotWithEntries(const SeekIndexEntry *entries, NSUInteger count);
+
+@interface SeekIndex (Private)
+- (BOOL)adoptSnapshot:(NSData *)data;
+@end
+
 
 @implementation SeekIndex
 
 - (id)initWithCapacity:(NSUInteger)capacity
 {
 	if (self = [super init]) {
-		allocedEntries = capacity;
+		allocedEntries = MAX(capacity, 1);
 		entries = (SeekIndexEntry *) malloc(allocedEntries * sizeof(SeekIndexEntry));
 		numEntries = 0;
+		complete = NO;
 		
 		syncLock = [[NSLock alloc] init];
+		
+		snapshot = nil;
+		frozenTimes = NULL;
+		frozenOffsets = NULL;
 	}
 	
 	return self;
@@ -44,6 +57,34 @@
 	return [self initWithCapacity:1000];
 }
 
+// returns nil if the data isn't a snapshot of a seek index
+- (id)initWithSnapshot:(NSData *)data
+{
+	if (self = [self initWithCapacity:1]) {
+		free(entries);
+		entries = NULL;
+		allocedEntries = 0;
+		
+		if (![self adoptSnapshot:data]) {
+			[self release];
+			return nil;
+		}
+	}
+	
+	return self;
+}
+
+- (id)initWithContentsOfMappedFile:(NSString *)path
+{
+	NSData *data = [NSData dataWithContentsOfMappedFile:path];
+	if (data == nil) {
+		[self release];
+		return nil;
+	}
+	
+	return [self initWithSnapshot:data];
+}
+
 - (void)dealloc
 {
 	if (entries != NULL) {
@@ -52,6 +93,7 @@
 	}
 	
 	[syncLock release];
+	[snapshot release];
 	
 	[super dealloc];
 }
@@ -63,15 +105,26 @@
 - (id)initWithCoder:(NSCoder *)coder
 {
 	if ([coder allowsKeyedCoding]) {
+		if ([coder containsValueForKey:@"snapshot"]) {
+			// copied, the bytes in the archive don't have to be aligned for the entries
+			NSUInteger length;
+			const uint8_t *bytes = [coder decodeBytesForKey:@"snapshot" returnedLength:&length];
+			return [self initWithSnapshot:[NSData dataWithBytes:bytes length:length]];
+		}
+		
 		NSArray *entriesArr = [coder decodeObjectForKey:@"entries"];
 		NSUInteger count = [entriesArr count];
 		if (self = [self initWithCapacity:count]) {
+			SeekIndexEntry *decodedEntries = (SeekIndexEntry *) malloc(MAX(count, 1) * sizeof(SeekIndexEntry));
 			for (NSUInteger i = 0; i < count; i++) {
 				NSDictionary *entryDict = [entriesArr objectAtIndex:i];
-				entries[i].time = [[entryDict objectForKey:@"time"] unsignedLongValue];
-				entries[i].byteOffset = [[entryDict objectForKey:@"offset"] doubleValue];
+				decodedEntries[i].time = [[entryDict objectForKey:@"time"] doubleValue];
+				decodedEntries[i].byteOffset = [[entryDict objectForKey:@"offset"] unsignedLongValue];
 			}
-			numEntries = count;
+			// older documents weren't stored in order
+			[self addEntries:decodedEntries count:count];
+			[self setComplete];
+			free(decodedEntries);
 		}
 		
 		return self;
@@ -84,15 +137,13 @@
 - (void)encodeWithCoder:(NSCoder *)coder
 {
     if ([coder allowsKeyedCoding]) {
-        NSMutableArray *entriesArr = [NSMutableArray arrayWithCapacity:numEntries];
-		for (NSUInteger i = 0; i < numEntries; i++) {
-			NSDictionary *entryDict = [NSDictionary dictionaryWithObjectsAndKeys:
-				[NSNumber numberWithUnsignedLong:entries[i].byteOffset], @"offset",
-				[NSNumber numberWithDouble:entries[i].time], @"time",
-				nil];
-			[entriesArr addObject:entryDict];
+		NSData *data = [self snapshot];
+		if (data == nil) {
+			[syncLock lock];
+			data = snapshotWithEntries(entries, numEntries);
+			[syncLock unlock];
 		}
-		[coder encodeObject:entriesArr forKey:@"entries"];
+		[coder encodeBytes:[data bytes] length:[data length] forKey:@"snapshot"];
 	} else {
         [NSException raise:NSInvalidArchiveOperationException format:@"Only supports NSKeyedArchiver coders"];
 	}
@@ -104,61 +155,133 @@
 
 - (void)addOffset:(NSUInteger)offset forTimeIndex:(double)time
 {
+	SeekIndexEntry entry = { time, offset };
+	[self addEntries:&entry count:1];
+}
+
+// merges the entries into the index, entries for times that are already in it are left out
+- (void)addEntries:(const SeekIndexEntry *)newEntries count:(NSUInteger)count
+{
+	if (count == 0) {
+		return;
+	}
+	
+	SeekIndexEntry *sorted = (SeekIndexEntry *) malloc(count * sizeof(SeekIndexEntry));
+	memcpy(sorted, newEntries, count * sizeof(SeekIndexEntry));
+	mergesort(sorted, count, sizeof(SeekIndexEntry), compareEntryTimes);
+	
 	[syncLock lock];
 	
+	if (complete) {
+		NSLog(@"seek index is already complete, not adding %lu entries", (unsigned long)count);
+		[syncLock unlock];
+		free(sorted);
+		return;
+	}
+	
 	// enlarge index if necessary
-	if (numEntries + 1 >= allocedEntries) {
-		allocedEntries *= 2;
+	if (numEntries + count >= allocedEntries) {
+		while (numEntries + count >= allocedEntries) {
+			allocedEntries *= 2;
+		}
 		entries = (SeekIndexEntry *) realloc(entries, allocedEntries * sizeof(SeekIndexEntry));
 	}
 	
-	// check for duplicates
-	for (NSUInteger i = 0; i < numEntries; i++) {
-		if (entries[i].time == time) {
-			// already inserted
-			[syncLock unlock];
-			return;
+	// merge from the back, so that the merged entries can go right into the end of the array. the analyzers
+	// add their entries in order, so most of the time the new ones all go behind the old ones.
+	NSUInteger i = numEntries;
+	NSUInteger j = count;
+	NSUInteger k = numEntries + count;
+	while (j > 0) {
+		if (i > 0 && entries[i - 1].time > sorted[j - 1].time) {
+			entries[--k] = entries[--i];
+		} else {
+			entries[--k] = sorted[--j];
 		}
 	}
 	
-	// insert new index entry
-	entries[numEntries].time = time;
-	entries[numEntries].byteOffset = offset;
-	numEntries++;
+	// the gap left by duplicates is closed again, the first entry for a time stays. the entries before k
+	// weren't touched by the merge.
+	NSUInteger merged = numEntries + count;
+	NSUInteger unique = k;
+	for (NSUInteger n = k; n < merged; n++) {
+		if (unique == 0 || entries[n].time != entries[unique - 1].time) {
+			entries[unique++] = entries[n];
+		}
+	}
+	numEntries = unique;
 	
 	[syncLock unlock];
+	
+	free(sorted);
 }
 
-- (SeekIndexEntry)entryForTimeIndex:(double)time
+// freezes the entries into the snapshot, from now on lookups don't need the lock
+- (void)setComplete
 {
-	static SeekIndexEntry zeroEntry = {0.0, 0};
+	[syncLock lock];
+	if (!complete && [self adoptSnapshot:snapshotWithEntries(entries, numEntries)]) {
+		free(entries);
+		entries = NULL;
+		allocedEntries = 0;
+	}
+	[syncLock unlock];
+}
+
+- (BOOL)isComplete
+{
+	return __atomic_load_n(&complete, __ATOMIC_ACQUIRE);
+}
+
+- (NSData *)snapshot
+{
+	return [self isComplete] ? snapshot : nil;
+}
+
+- (BOOL)writeSnapshotToFile:(NSString *)path
+{
+	NSData *data = [self snapshot];
+	return (data != nil) && [data writeToFile:path atomically:YES];
+}
+
+- (NSUInteger)numberOfEntries
+{
+	if ([self isComplete]) {
+		return numEntries;
+	}
 	
 	[syncLock lock];
+	NSUInteger count = numEntries;
+	[syncLock unlock];
+	return count;
+}
+
+// the closest entry at or before the given time
+- (SeekIndexEntry)entryForTimeIndex:(double)time
+{
+	static SeekIndexEntry zeroEntry = {0.0, 0};
+	SeekIndexEntry result = zeroEntry;
 	
-	// find closest time index that is BEFORE the given time
-	double diff = (double)LONG_MAX;
-	NSUInteger bestEntryIndex = 0;
-	BOOL found = NO;
-	for (NSUInteger i = 0; i < numEntries; i++) {
-		if (entries[i].time <= time) {
-			double d = time - entries[i].time;
-			if (d < diff) {
-				diff = d;
-				bestEntryIndex = i;
-				found = YES;
+	if (![self isComplete]) {
+		[syncLock lock];
+		// the index may have been frozen while we waited for the lock
+		if (!complete) {
+			NSUInteger index = lastEntryNotAfter(entries, sizeof(SeekIndexEntry), numEntries, time);
+			if (index < numEntries) {
+				result = entries[index];
 			}
+			[syncLock unlock];
+			return result;
 		}
+		[syncLock unlock];
 	}
 	
-	SeekIndexEntry result;
-	if (found) {
-		result = entries[bestEntryIndex];
-	} else {
-		result = zeroEntry;
+	NSUInteger index = lastEntryNotAfter(frozenTimes, sizeof(double), numEntries, time);
+	if (index < numEntries) {
+		result.time = frozenTimes[index];
+		result.byteOffset = (NSUInteger)frozenOffsets[index];
 	}
 	
-	[syncLock unlock];
-	
 	return result;
 }
 
@@ -168,3 +291,115 @@
 }
 
 @end
+
+
+#pragma mark -
+
+
+@implementation SeekIndex (Private)
+
+// checks the snapshot and makes it the frozen index. a snapshot from a machine of the other byte order
+// is swapped in a copy, as is one whose bytes aren't aligned for the entries.
+- (BOOL)adoptSnapshot:(NSData *)data
+{
+	NSUInteger length = [data length];
+	if (length < sizeof(SeekIndexSnapshotHeader)) {
+		return NO;
+	}
+	
+	const SeekIndexSnapshotHeader *header = (const SeekIndexSnapshotHeader *)[data bytes];
+	BOOL swapped = (header->magic == CFSwapInt32(SeekIndexSnapshotMagic));
+	if (header->magic != SeekIndexSnapshotMagic && !swapped) {
+		return NO;
+	}
+	uint32_t version = swapped ? CFSwapInt32(header->version) : header->version;
+	uint64_t count = swapped ? CFSwapInt64(header->numEntries) : header->numEntries;
+	if (version != SeekIndexSnapshotVersion ||
+		count > (length - sizeof(SeekIndexSnapshotHeader)) / (sizeof(double) + sizeof(uint64_t))) {
+		return NO;
+	}
+	
+	if (swapped || ((uintptr_t)[data bytes] & (sizeof(uint64_t) - 1)) != 0) {
+		NSMutableData *copy = [NSMutableData dataWithData:data];
+		if (swapped) {
+			SeekIndexSnapshotHeader *copyHeader = (SeekIndexSnapshotHeader *)[copy mutableBytes];
+			copyHeader->magic = SeekIndexSnapshotMagic;
+			copyHeader->version = version;
+			copyHeader->numEntries = count;
+			
+			// times and offsets are both 64 bits wide
+			uint64_t *words = (uint64_t *)(copyHeader + 1);
+			for (uint64_t i = 0; i < 2 * count; i++) {
+				words[i] = CFSwapInt64(words[i]);
+			}
+		}
+		data = copy;
+	}
+	
+	[snapshot release];
+	snapshot = [data retain];
+	frozenTimes = (const double *)((const SeekIndexSnapshotHeader *)[snapshot bytes] + 1);
+	frozenOffsets = (const uint64_t *)(frozenTimes + count);
+	numEntries = (NSUInteger)count;
+	
+	// readers that see the index complete also see the snapshot
+	__atomic_store_n(&complete, YES, __ATOMIC_RELEASE);
+	
+	return YES;
+}
+
+@end
+
+
+#pragma mark -
+
+
+static int
+compareEntryTimes(const void *a, const void *b)
+{
+	double timeA = ((const SeekIndexEntry *)a)->time;
+	double timeB = ((const SeekIndexEntry *)b)->time;
+	return (timeA < timeB) ? -1 : ((timeA > timeB) ? 1 : 0);
+}
+
+// binary search in sorted times that are stride bytes apart, returns count if all of them are after the time
+static NSUInteger
+lastEntryNotAfter(const void *times, size_t stride, NSUInteger count, double time)
+{
+	NSUInteger low = 0;
+	NSUInteger high = count;
+	
+	// the first entry after the time is at low when this is done
+	while (low < high) {
+		NSUInteger middle = low + (high - low) / 2;
+		if (*(const double *)((const char *)times + middle * stride) <= time) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	
+	return (low > 0) ? (low - 1) : count;
+}
+
+// the times come first, so that a lookup only touches the cache lines of the times it compares
+static NSData *
+snapshotWithEntries(const SeekIndexEntry *entries, NSUInteger count)
+{
+	NSUInteger length = sizeof(SeekIndexSnapshotHeader) + count * (sizeof(double) + sizeof(uint64_t));
+	NSMutableData *data = [NSMutableData dataWithLength:length];
+	
+	SeekIndexSnapshotHeader *header = (SeekIndexSnapshotHeader *)[data mutableBytes];
+	header->magic = SeekIndexSnapshotMagic;
+	header->version = SeekIndexSnapshotVersion;
+	header->numEntries = count;
+	
+	double *times = (double *)(header + 1);
+	uint64_t *offsets = (uint64_t *)(times + count);
+	for (NSUInteger i = 0; i < count; i++) {
+		times[i] = entries[i].time;
+		offsets[i] = entries[i].byteOffset;
+	}
+	
+	return data;
+}
@@ -31,6 +31,9 @@
 #import "SplitDocumentToolbar.h"
 #import "ProgressPanel.h"
 
+// how long the silence thresholds in the defaults have to stay the same before the slices are found again
+#define SplitDocumentThresholdChangeDelay	0.5
+
 @interface SplitDocument : NSDocument <NSWindowDelegate> {
 	IBOutlet OutlineViewController		*outlineViewController;
 	IBOutlet NSOutlineView				*outlineView;
@@ -58,6 +61,10 @@
 	double								playSilenceIntervalBefore;
 	double								playSilenceIntervalAfter;
 	double								relativeSilenceSplitPoint;
+	double								silenceDurationThreshold;	// the thresholds the slices were found with
+	double								silenceVolumeThreshold;
+	double								defaultSilenceDurationThreshold;	// the thresholds in the defaults when we last looked,
+	double								defaultSilenceVolumeThreshold;		// other defaults changing doesn't rescan
 	
 	NSUInteger							documentID;
 	BOOL								documentWasModifiedDuringOpen;
@@ -23,6 +23,7 @@
 
 #import "SplitDocument.h"
 #import "ProgressPanel.h"
+#import "SplitDocumentArchive.h"
 
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -55,6 +56,11 @@
 - (void)modelDidChange:(NSNotification *)notification;
 - (void)progressDidChange:(NSNotification *)notification;
 - (void)analyzingDidFinish:(NSNotification *)notification;
+- (void)decodingDidFail:(NSNotification *)notification;
+- (BOOL)analyzeSilencesLongerThan:(double)time quieterThan:(double)volume;
+- (void)setAudioSegmentTree:(AudioSegmentTree *)tree silencesLongerThan:(double)time quieterThan:(double)volume;
+- (void)defaultsDidChange:(NSNotification *)notification;
+- (void)applyThresholdDefaults;
 @end
 
 NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentContinuousControlFinishedNotification";
@@ -70,6 +76,10 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 		playSilenceIntervalBefore = [[defaults objectForKey:@"PlayBeforeSilenceDuration"] doubleValue];
 		playSilenceIntervalAfter = [[defaults objectForKey:@"PlayAfterSilenceDuration"] doubleValue];
 		relativeSilenceSplitPoint = [[defaults objectForKey:@"RelativeSilenceSplitPoint"] doubleValue] / 100.0;
+		silenceDurationThreshold = [[defaults objectForKey:@"SilenceDurationThreshold"] doubleValue];
+		silenceVolumeThreshold = [[defaults objectForKey:@"SilenceVolumeThreshold"] doubleValue] / 100.0;
+		defaultSilenceDurationThreshold = silenceDurationThreshold;
+		defaultSilenceVolumeThreshold = silenceVolumeThreshold;
 		audioFile = nil;
 		audioSegmentTree = nil;
 		
@@ -85,6 +95,18 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 												 selector:@selector(modelDidChange:)
 													 name:AudioSegmentTreeDidChangeNotification
 												   object:nil];
+		
+		// the audio file may fail to decode whenever it is analyzed, played or exported, not only while opening
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(decodingDidFail:)
+													 name:AudioFileDecodingFailedNotification
+												   object:nil];
+		
+		// find the silences again when the thresholds are changed in the preferences
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(defaultsDidChange:)
+													 name:NSUserDefaultsDidChangeNotification
+												   object:nil];
     }
 	
     return self;
@@ -193,6 +215,10 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 	// stop playing
 	[audioFile abortPlaying];
 	
+	// a pending threshold change would otherwise analyze a file nobody looks at anymore
+	[[NSNotificationCenter defaultCenter] removeObserver:self name:NSUserDefaultsDidChangeNotification object:nil];
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(applyThresholdDefaults) object:nil];
+	
 	// get rid of the KV-observing toolbar
 	[toolbar unbind];
 	[toolbar release];
@@ -205,19 +231,13 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 - (NSData *)dataRepresentationOfType:(NSString *)aType
 {
 	if ([aType isEqualToString:@"AudioSlicer Document"]) {
-		NSMutableData   *data = [NSMutableData data];
-		NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
-		
-		[archiver encodeInt64:documentID forKey:@"documentID"];
-		[archiver encodeObject:audioFile forKey:@"audioFile"];
-		[archiver encodeObject:audioSegmentTree forKey:@"audioSegmentTree"];
-		[archiver encodeDouble:playSilenceIntervalBefore forKey:@"playSilenceIntervalBefore"];
-		[archiver encodeDouble:playSilenceIntervalAfter forKey:@"playSilenceIntervalAfter"];
-		
-		[archiver finishEncoding];
-		[archiver release];
-		
-		return data;
+		return [SplitDocumentArchive dataRepresentationWithAudioFile:audioFile
+													audioSegmentTree:audioSegmentTree
+														  documentID:documentID
+											silenceDurationThreshold:silenceDurationThreshold
+													 volumeThreshold:silenceVolumeThreshold
+										   playSilenceIntervalBefore:playSilenceIntervalBefore
+													   intervalAfter:playSilenceIntervalAfter];
 	} else {
 		return nil;
 	}
@@ -250,6 +270,12 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 		
 		audioSegmentTree = [[unarchiver decodeObjectForKey:@"audioSegmentTree"] retain];
 		[audioSegmentTree setUndoManager:[self undoManager]];
+		// older documents don't know their thresholds, the ones in the defaults are the best guess
+		if ([unarchiver containsValueForKey:@"silenceDurationThreshold"]) {
+			silenceDurationThreshold = [unarchiver decodeDoubleForKey:@"silenceDurationThreshold"];
+			silenceVolumeThreshold = [unarchiver decodeDoubleForKey:@"silenceVolumeThreshold"];
+		}
+		[audioFile setAudioSegmentTree:audioSegmentTree silencesLongerThan:silenceDurationThreshold quieterThan:silenceVolumeThreshold];
 		[outlineViewController setAudioFile:audioFile audioSegmentTree:audioSegmentTree];
 		
 		playSilenceIntervalBefore = [unarchiver decodeDoubleForKey:@"playSilenceIntervalBefore"];
@@ -267,38 +293,8 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 - (BOOL)readFromFile:(NSString *)fileName ofType:(NSString *)docType
 {
 	if ([docType isEqualToString:@"MP3 Document"]) {
-		NSUserDefaults  *defaults = [NSUserDefaults standardUserDefaults];
 		audioFile = [[AudioFile audioFileWithPath:fileName] retain];
-		
-		progressPanel = [ProgressPanel progressPanelWithTitle:@"Analyzing File..."
-												  messageText:@"Finding all silences in file"
-													 minValue:[audioFile progressMinValue]
-													 maxValue:[audioFile progressMaxValue]];
-		
-		// register for progress and finished notifications
-		[[NSNotificationCenter defaultCenter] addObserver:self
-												 selector:@selector(progressDidChange:)
-													 name:AudioFileProgressChangedNotification
-												   object:audioFile];
-		[[NSNotificationCenter defaultCenter] addObserver:self
-												 selector:@selector(analyzingDidFinish:)
-													 name:AudioFileAnalyzingFinishedNotification
-												   object:audioFile];
-		
-		// kick off the analyzer thread
-		[audioFile analyzeSilencesLongerThan:[[defaults objectForKey:@"SilenceDurationThreshold"] doubleValue]
-								 quieterThan:([[defaults objectForKey:@"SilenceVolumeThreshold"] doubleValue] / 100.0)];
-		
-		// run modally now until thread finishes
-		[progressPanel runModalForWindow];
-		
-		// unregister ourselves as observer
-		[[NSNotificationCenter defaultCenter] removeObserver:self
-														name:AudioFileProgressChangedNotification
-													  object:audioFile];
-		[[NSNotificationCenter defaultCenter] removeObserver:self
-														name:AudioFileAnalyzingFinishedNotification
-													  object:audioFile];
+		[self analyzeSilencesLongerThan:silenceDurationThreshold quieterThan:silenceVolumeThreshold];
 		
 		audioSegmentTree = [[audioFile audioSegmentTree] retain];
 		[audioSegmentTree setUndoManager:[self undoManager]];
@@ -789,20 +785,11 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 	
 	for (NSInteger i = 0; i < [audioSegmentTree numberOfSlices]; i++) {
 		AudioSlice			*s = [audioSegmentTree sliceAtIndex:i];
-		AudioSegmentNode	*left = [s leftSilenceSegment];
-		AudioSegmentNode	*right = [s rightSilenceSegment];
 		NSString			*filePath = [dirPath stringByAppendingPathComponent:[self filenameUsingFormat:chosenFormat forSlice:s]];
 		double				start = 0.0;
 		double				end = AudioFileEndTime;
 		
-		if (left) {
-			start = [left endTime];
-			start -= ([left duration] * (1.0 - relativeSilenceSplitPoint));
-		}
-		if (right) {
-			end = [right startTime];
-			end += ([right duration] * relativeSilenceSplitPoint);
-		}
+		[s getSplitStartTime:&start endTime:&end relativeSilenceSplitPoint:relativeSilenceSplitPoint];
 		
 		[progressPanel setMessageText:[NSString stringWithFormat:@"Writing %@", [filePath lastPathComponent]]];
 		[progressPanel setProgress:(i + 1)];
@@ -831,35 +818,7 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 
 - (NSString *)filenameUsingFormat:(NSString *)format forSlice:(AudioSlice *)slice
 {
-	NSMutableString		*name = [[format mutableCopy] autorelease];
-	NSUInteger			trackNumberDigits = [(NSString *)[NSString stringWithFormat:@"%lu", (unsigned long)[slice trackCount]] length];
-	NSUInteger			cdNumberDigits = [(NSString *)[NSString stringWithFormat:@"%lu", (unsigned long)[slice cdCount]] length];
-	NSString			*key;
-	NSEnumerator		*keys = [[NSArray arrayWithObjects:@"title", @"artist", @"album", @"composer", @"genre", @"year",
-														   @"trackNumber", @"trackCount", @"cdNumber", @"cdCount",
-														   nil] objectEnumerator];
-	
-	while (key = [keys nextObject]) {
-		id  replacement = [slice valueForKey:key];
-		if (replacement) {
-			if (trackNumberDigits > 0 && [key isEqualToString:@"trackNumber"]) {
-				replacement = [NSString stringWithFormat:[NSString stringWithFormat:@"%%0%lud", (unsigned long)trackNumberDigits], [replacement integerValue]];
-			} else if (cdNumberDigits > 0 && [key isEqualToString:@"cdNumber"]) {
-				replacement = [NSString stringWithFormat:[NSString stringWithFormat:@"%%0%lud", (unsigned long)cdNumberDigits], [replacement integerValue]];
-			}
-		} else {
-			replacement = @"";
-		}
-		[name replaceOccurrencesOfString:[NSString stringWithFormat:@"[%@]", key]
-							  withString:[NSString stringWithFormat:@"%@", replacement]
-								 options:NSCaseInsensitiveSearch
-								   range:NSMakeRange(0, [name length])];
-	}
-	
-	[name replaceOccurrencesOfString:@":" withString:@"_" options:0 range:NSMakeRange(0, [name length])];
-	[name replaceOccurrencesOfString:@"/" withString:@":" options:0 range:NSMakeRange(0, [name length])];
-	
-	return [name stringByAppendingPathExtension:[audioFile fileExtension]];
+	return [slice filenameUsingFormat:format extension:[audioFile fileExtension]];
 }
 
 - (void)modelDidChange:(NSNotification *)notification
@@ -880,4 +839,115 @@ NSString	*SplitDocumentContinuousControlFinishedNotification = @"SplitDocumentCo
 	[progressPanel endModalPanel];
 }
 
+- (void)decodingDidFail:(NSNotification *)notification
+{
+	if ([notification object] != audioFile) {
+		return;
+	}
+	
+	NSRunAlertPanel(@"Too many decoding errors",
+					@"There were too many errors while decoding this file. Maybe it's corrupted or not an MP3 file at all.",
+					@"OK", nil, nil);
+}
+
+// analyzes the whole audio file, behind a modal progress panel
+- (BOOL)analyzeSilencesLongerThan:(double)time quieterThan:(double)volume
+{
+	progressPanel = [ProgressPanel progressPanelWithTitle:@"Analyzing File..."
+											  messageText:@"Finding all silences in file"
+												 minValue:[audioFile progressMinValue]
+												 maxValue:[audioFile progressMaxValue]];
+	
+	// register for progress and finished notifications
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(progressDidChange:)
+												 name:AudioFileProgressChangedNotification
+											   object:audioFile];
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(analyzingDidFinish:)
+												 name:AudioFileAnalyzingFinishedNotification
+											   object:audioFile];
+	
+	// kick off the analyzer thread
+	[audioFile analyzeSilencesLongerThan:time quieterThan:volume];
+	
+	// run modally now until thread finishes
+	[progressPanel runModalForWindow];
+	
+	// unregister ourselves as observer
+	[[NSNotificationCenter defaultCenter] removeObserver:self
+													name:AudioFileProgressChangedNotification
+												  object:audioFile];
+	[[NSNotificationCenter defaultCenter] removeObserver:self
+													name:AudioFileAnalyzingFinishedNotification
+												  object:audioFile];
+	
+	return ([audioFile audioSegmentTree] != nil);
+}
+
+// replaces the slices by the ones found with other thresholds, undoing brings the old ones and their
+// thresholds back, in the audio file as well
+- (void)setAudioSegmentTree:(AudioSegmentTree *)tree silencesLongerThan:(double)time quieterThan:(double)volume
+{
+	[[[self undoManager] prepareWithInvocationTarget:self] setAudioSegmentTree:audioSegmentTree
+															silencesLongerThan:silenceDurationThreshold
+																   quieterThan:silenceVolumeThreshold];
+	
+	[tree retain];
+	[audioSegmentTree release];
+	audioSegmentTree = tree;
+	[audioSegmentTree setUndoManager:[self undoManager]];
+	silenceDurationThreshold = time;
+	silenceVolumeThreshold = volume;
+	[audioFile setAudioSegmentTree:audioSegmentTree silencesLongerThan:time quieterThan:volume];
+	
+	[outlineViewController setAudioFile:audioFile audioSegmentTree:audioSegmentTree];
+	[silenceRangeSlider setMinValue:[audioSegmentTree shortestSilenceInTree]];
+	[silenceRangeSlider setMaxValue:[audioSegmentTree longestSilenceInTree]];
+	[self updateUI];
+}
+
+// every default that changes sends this, only the silence thresholds are of interest
+- (void)defaultsDidChange:(NSNotification *)notification
+{
+	NSUserDefaults	*defaults = [NSUserDefaults standardUserDefaults];
+	double			time = [[defaults objectForKey:@"SilenceDurationThreshold"] doubleValue];
+	double			volume = [[defaults objectForKey:@"SilenceVolumeThreshold"] doubleValue] / 100.0;
+	
+	if (time == defaultSilenceDurationThreshold && volume == defaultSilenceVolumeThreshold) {
+		return;
+	}
+	defaultSilenceDurationThreshold = time;
+	defaultSilenceVolumeThreshold = volume;
+	
+	// dragging a slider in the preferences changes them many times in a row, only the last one counts
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(applyThresholdDefaults) object:nil];
+	[self performSelector:@selector(applyThresholdDefaults) withObject:nil afterDelay:SplitDocumentThresholdChangeDelay];
+}
+
+- (void)applyThresholdDefaults
+{
+	double	time = defaultSilenceDurationThreshold;
+	double	volume = defaultSilenceVolumeThreshold;
+	
+	if (time == silenceDurationThreshold && volume == silenceVolumeThreshold) {
+		return;
+	}
+	if (audioFile == nil || audioSegmentTree == nil) {
+		// still opening, there are no slices to find again yet
+		return;
+	}
+	
+	// the loudness envelope of the last analysis finds the silences right away, without it the file is decoded again
+	[audioFile abortPlaying];
+	if (![audioFile rescanSilencesLongerThan:time quieterThan:volume] && ![self analyzeSilencesLongerThan:time quieterThan:volume]) {
+		// the audio file lost its slices, the document still shows the old ones
+		[audioFile setAudioSegmentTree:audioSegmentTree silencesLongerThan:silenceDurationThreshold quieterThan:silenceVolumeThreshold];
+		return;
+	}
+	
+	[self setAudioSegmentTree:[audioFile audioSegmentTree] silencesLongerThan:time quieterThan:volume];
+	[[self undoManager] setActionName:@"Change Silence Thresholds"];
+}
+
 @end
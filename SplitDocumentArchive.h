@@ -0,0 +1,42 @@
+//
+//  SplitDocumentArchive.h
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import <Foundation/Foundation.h>
+
+#import "AudioFile.h"
+#import "AudioSegmentTree.h"
+
+// the contents of a document file. the batch analyzer writes documents without the document class,
+// which needs AppKit, so the archive is put together here.
+@interface SplitDocumentArchive : NSObject {
+}
+
++ (NSData *)dataRepresentationWithAudioFile:(AudioFile *)file
+							audioSegmentTree:(AudioSegmentTree *)tree
+								  documentID:(NSUInteger)docID
+					silenceDurationThreshold:(double)time
+							 volumeThreshold:(double)volume
+				   playSilenceIntervalBefore:(double)before
+							  intervalAfter:(double)after;
+
+@end
@@ -0,0 +1,55 @@
+//
+//  SplitDocumentArchive.m
+//  AudioSlicer
+//
+//  Created by Bernd Heller on 17.10.26.
+//  Copyright (c) 2004-2006 Bernd Heller. All rights reserved.
+//  
+//  This file is part of AudioSlicer.
+//  
+//  AudioSlicer is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//  
+//  AudioSlicer is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//  
+//  You should have received a copy of the GNU General Public License
+//  along with AudioSlicer; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA
+
+#import "SplitDocumentArchive.h"
+
+
+@implementation SplitDocumentArchive
+
++ (NSData *)dataRepresentationWithAudioFile:(AudioFile *)file
+							audioSegmentTree:(AudioSegmentTree *)tree
+								  documentID:(NSUInteger)docID
+					silenceDurationThreshold:(double)time
+							 volumeThreshold:(double)volume
+				   playSilenceIntervalBefore:(double)before
+							  intervalAfter:(double)after
+{
+	NSMutableData   *data = [NSMutableData data];
+	NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
+	
+	[archiver encodeInt64:docID forKey:@"documentID"];
+	[archiver encodeObject:file forKey:@"audioFile"];
+	[archiver encodeObject:tree forKey:@"audioSegmentTree"];
+	// the thresholds the slices were found with, so that changing them later starts from the right ones
+	[archiver encodeDouble:time forKey:@"silenceDurationThreshold"];
+	[archiver encodeDouble:volume forKey:@"silenceVolumeThreshold"];
+	[archiver encodeDouble:before forKey:@"playSilenceIntervalBefore"];
+	[archiver encodeDouble:after forKey:@"playSilenceIntervalAfter"];
+	
+	[archiver finishEncoding];
+	[archiver release];
+	
+	return data;
+}
+
+@end